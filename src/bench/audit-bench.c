@@ -0,0 +1,256 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "nica/util.h"
+
+/**
+ * Measure what LD_AUDIT costs the processes libintercept has no interest in,
+ * i.e. the shells and helpers the Steam client spawns.
+ *
+ *      lsi-audit-bench [-n runs] liblsi-intercept.so
+ *
+ * Times `/bin/sh -c true` from fork() to exit without the module, with the
+ * module detaching itself, with it kept loaded as a passthrough (as on glibc
+ * releases that can't unload an auditor), and with it making decisions as
+ * it did for every process before detaching was possible.
+ */
+
+#define BENCH_SHELL "/bin/sh"
+
+typedef enum {
+        BENCH_MODE_BASELINE = 0,
+        BENCH_MODE_DETACHED,
+        BENCH_MODE_PASSTHROUGH,
+        BENCH_MODE_INTERCEPTED,
+        BENCH_N_MODES,
+} BenchMode;
+
+static const char *bench_mode_names[BENCH_N_MODES] = {
+        "baseline (no LD_AUDIT)",
+        "detached (la_version returns 0)",
+        "passthrough (LSI_INTERCEPT_NO_DETACH)",
+        "intercepted (treated as a game)",
+};
+
+typedef struct BenchEnv {
+        const char *intercept;
+        char cache[64]; /**<Stands in for XDG_CACHE_HOME */
+} BenchEnv;
+
+static inline uint64_t bench_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a;
+        uint64_t y = *(const uint64_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+static inline double bench_percentile(const uint64_t *sorted, size_t n, double p)
+{
+        return (double)sorted[(size_t)(p * (double)(n - 1))];
+}
+
+/**
+ * Set up the environment of the child for @mode
+ */
+static void bench_child_env(const BenchEnv *env, BenchMode mode)
+{
+        unsetenv("LD_AUDIT");
+        unsetenv("LD_PRELOAD");
+        unsetenv("SteamAppId");
+        unsetenv("SteamGameId");
+        unsetenv("LSI_INTERCEPT_NO_DETACH");
+        unsetenv("LSI_INTERCEPT_TRACE");
+        unsetenv("LSI_INTERCEPT_CAPTURE");
+        unsetenv("LSI_STATS");
+        setenv("XDG_CACHE_HOME", env->cache, 1);
+
+        switch (mode) {
+        case BENCH_MODE_DETACHED:
+                setenv("LD_AUDIT", env->intercept, 1);
+                break;
+        case BENCH_MODE_PASSTHROUGH:
+                setenv("LD_AUDIT", env->intercept, 1);
+                setenv("LSI_INTERCEPT_NO_DETACH", "1", 1);
+                break;
+        case BENCH_MODE_INTERCEPTED:
+                setenv("LD_AUDIT", env->intercept, 1);
+                setenv("SteamAppId", "1", 1);
+                break;
+        case BENCH_MODE_BASELINE:
+        default:
+                break;
+        }
+}
+
+/**
+ * Run a single shell in @mode, returning how long it took from fork() to
+ * exit in @elapsed
+ */
+static bool bench_spawn(const BenchEnv *env, BenchMode mode, uint64_t *elapsed)
+{
+        int status = 0;
+        uint64_t start;
+        pid_t pid;
+
+        start = bench_now();
+        pid = fork();
+        if (pid < 0) {
+                return false;
+        }
+        if (pid == 0) {
+                char *argv[] = { BENCH_SHELL, "-c", "true", NULL };
+                bench_child_env(env, mode);
+                execv(BENCH_SHELL, argv);
+                _exit(EXIT_FAILURE);
+        }
+
+        if (waitpid(pid, &status, 0) != pid) {
+                return false;
+        }
+        *elapsed = bench_now() - start;
+        return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static bool bench_mode(const BenchEnv *env, BenchMode mode, int runs, double *p50)
+{
+        uint64_t *samples = calloc((size_t)runs, sizeof(uint64_t));
+        uint64_t elapsed = 0;
+        bool ret = false;
+
+        if (!samples) {
+                return false;
+        }
+
+        /* First run warms up the page cache and the persistent caches */
+        if (!bench_spawn(env, mode, &elapsed)) {
+                fprintf(stderr, "%s: child failed\n", bench_mode_names[mode]);
+                goto end;
+        }
+        for (int i = 0; i < runs; i++) {
+                if (!bench_spawn(env, mode, &samples[i])) {
+                        fprintf(stderr, "%s: child failed\n", bench_mode_names[mode]);
+                        goto end;
+                }
+        }
+        qsort(samples, (size_t)runs, sizeof(uint64_t), bench_compare);
+
+        *p50 = bench_percentile(samples, (size_t)runs, 0.50) / 1000.0;
+        printf("%-40s p50 %6.0f us, p90 %6.0f us, max %6.0f us\n",
+               bench_mode_names[mode],
+               *p50,
+               bench_percentile(samples, (size_t)runs, 0.90) / 1000.0,
+               (double)samples[runs - 1] / 1000.0);
+        ret = true;
+
+end:
+        free(samples);
+        return ret;
+}
+
+static int bench_remove_entry(const char *path, __lsi_unused__ const struct stat *st,
+                              __lsi_unused__ int flag, __lsi_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+        BenchEnv env = { 0 };
+        double p50[BENCH_N_MODES] = { 0 };
+        int runs = 200;
+        int ret = EXIT_FAILURE;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "n:")) != -1) {
+                switch (opt) {
+                case 'n':
+                        runs = atoi(optarg);
+                        if (runs < 1) {
+                                goto usage;
+                        }
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+        if (argc - optind != 1) {
+                goto usage;
+        }
+        env.intercept = argv[optind];
+
+        strcpy(env.cache, "/tmp/lsi-audit-bench.XXXXXX");
+        if (!mkdtemp(env.cache)) {
+                fprintf(stderr, "Unable to create cache directory: %s\n", strerror(errno));
+                env.cache[0] = '\0';
+                goto end;
+        }
+
+        printf("%s -c true, %d runs per mode\n", BENCH_SHELL, runs);
+        for (int mode = 0; mode < BENCH_N_MODES; mode++) {
+                fflush(stdout);
+                if (!bench_mode(&env, (BenchMode)mode, runs, &p50[mode])) {
+                        goto end;
+                }
+        }
+        printf("overhead vs baseline (p50): detached %+.0f us, passthrough %+.0f us, "
+               "intercepted %+.0f us\n",
+               p50[BENCH_MODE_DETACHED] - p50[BENCH_MODE_BASELINE],
+               p50[BENCH_MODE_PASSTHROUGH] - p50[BENCH_MODE_BASELINE],
+               p50[BENCH_MODE_INTERCEPTED] - p50[BENCH_MODE_BASELINE]);
+        ret = EXIT_SUCCESS;
+
+end:
+        if (env.cache[0]) {
+                nftw(env.cache, bench_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+        return ret;
+
+usage:
+        fprintf(stderr, "usage: %s [-n runs] intercept-module\n", argv[0]);
+        fprintf(stderr, "  -n  processes to start per mode\n");
+        return EXIT_FAILURE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,158 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/common.h"
+#include "../intercept/matcher.h"
+
+/**
+ * Compare the compiled pattern automaton against the linear strstr() loops
+ * it replaced, using the kind of names la_objsearch sees during startup.
+ */
+
+static const char *sample_names[] = {
+        "libSDL2-2.0.so.0",
+        "libstdc++.so.6",
+        "libGL.so.1",
+        "libX11.so.6",
+        "libc.so.6",
+        "libcurl-gnutls.so.3",
+        "libopenal-soft.so.1",
+        "./libsteam_api.so",
+        "/usr/lib64/libpthread.so.0",
+        "/usr/lib/x86_64-linux-gnu/libdrm.so.2",
+        "/home/user/.local/share/Steam/ubuntu12_32/steamui.so",
+        "/home/user/.local/share/Steam/ubuntu12_32/libSDL2-2.0.so.0",
+        "/home/user/.local/share/Steam/ubuntu12_32/steam-runtime/i386/lib/i386-linux-gnu/libz.so.1",
+        "/home/user/.local/share/Steam/ubuntu12_64/libcef.so",
+        "/home/user/.local/share/Steam/steamapps/common/Game/Game_Data/Plugins/x86_64/"
+        "ScreenSelector.so",
+        "/home/user/.local/share/Steam/steamapps/common/Game/lib64/libfreetype.so.6",
+        "/mnt/games/SteamLibrary/steamapps/common/Other/bin/libSDL2_image-2.0.so.0",
+        "/mnt/games/SteamLibrary/steamapps/common/Other/bin/libgcc_s.so.1",
+};
+
+/**
+ * Result of classifying a single name, identical for both strategies
+ */
+typedef struct Classification {
+        int allowed;
+        int blacklisted;
+        int transmute;
+        int steam_path;
+        int library_path;
+} Classification;
+
+static int first_strstr(const char *name, LsiPatternGroup group)
+{
+        const LsiAutomaton *a = &lsi_builtin_patterns;
+        int n = (int)(a->group_start[group + 1] - a->group_start[group]);
+
+        for (int i = 0; i < n; i++) {
+                if (strstr(name, lsi_automaton_pattern(a, group, i))) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+static void classify_strstr(const char *name, Classification *c)
+{
+        c->allowed = first_strstr(name, LSI_PATTERN_STEAM_ALLOWED);
+        c->blacklisted = first_strstr(name, LSI_PATTERN_VENDOR_BLACKLIST);
+        c->transmute = first_strstr(name, LSI_PATTERN_VENDOR_TRANSMUTE);
+        c->steam_path = first_strstr(name, LSI_PATTERN_STEAM_PATH);
+        c->library_path = first_strstr(name, LSI_PATTERN_LIBRARY_PATH);
+}
+
+static void classify_automaton(const char *name, Classification *c)
+{
+        const LsiAutomaton *a = &lsi_builtin_patterns;
+        LsiPatternMatch m;
+
+        lsi_automaton_scan(a, name, &m);
+        c->allowed = lsi_pattern_match_next(a, &m, LSI_PATTERN_STEAM_ALLOWED, -1);
+        c->blacklisted = lsi_pattern_match_next(a, &m, LSI_PATTERN_VENDOR_BLACKLIST, -1);
+        c->transmute = lsi_pattern_match_next(a, &m, LSI_PATTERN_VENDOR_TRANSMUTE, -1);
+        c->steam_path = lsi_pattern_match_next(a, &m, LSI_PATTERN_STEAM_PATH, -1);
+        c->library_path = lsi_pattern_match_next(a, &m, LSI_PATTERN_LIBRARY_PATH, -1);
+}
+
+static inline double now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double run(void (*classify)(const char *, Classification *), int rounds)
+{
+        volatile int sink = 0;
+        Classification c;
+        double start = now_ns();
+
+        for (int r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < ARRAY_SIZE(sample_names); i++) {
+                        classify(sample_names[i], &c);
+                        sink += c.allowed + c.blacklisted + c.transmute;
+                }
+        }
+        (void)sink;
+        return (now_ns() - start) / ((double)rounds * ARRAY_SIZE(sample_names));
+}
+
+int main(int argc, char **argv)
+{
+        int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+        double t_strstr, t_automaton;
+
+        /* Both strategies must agree before timing means anything */
+        for (size_t i = 0; i < ARRAY_SIZE(sample_names); i++) {
+                Classification a, b;
+                classify_strstr(sample_names[i], &a);
+                classify_automaton(sample_names[i], &b);
+                if (memcmp(&a, &b, sizeof(a)) != 0) {
+                        fprintf(stderr, "Mismatched classification for %s\n", sample_names[i]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        t_strstr = run(classify_strstr, rounds);
+        t_automaton = run(classify_automaton, rounds);
+
+        printf("patterns:  %u (%u states, %u classes)\n",
+               lsi_builtin_patterns.n_patterns,
+               lsi_builtin_patterns.n_states,
+               lsi_builtin_patterns.n_classes);
+        printf("strstr:    %8.1f ns/name\n", t_strstr);
+        printf("automaton: %8.1f ns/name\n", t_automaton);
+        printf("speedup:   %8.2fx\n", t_strstr / t_automaton);
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,430 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../intercept/host-resolver.h"
+#include "../intercept/overlay.h"
+#include "../intercept/rules-db.h"
+#include "nica/files.h"
+#include "nica/util.h"
+
+/**
+ * Compare the two ways of running libintercept: as an rtld-audit module via
+ * LD_AUDIT, or through the libredirect dlopen() hook with the library overlay
+ * on LD_LIBRARY_PATH (use-intercept-preload).
+ *
+ *      lsi-dlopen-bench [-n runs] [-d rounds] liblsi-intercept.so liblsi-redirect.so
+ *
+ * Each mode re-executes this program as a game within a synthetic steamapps
+ * tree holding a vendored libz.so.1, timing process startup from fork() to
+ * exit, and then dlopen() + dlclose() of the bare soname, the vendored path
+ * and an unrelated host library from within the game.
+ */
+
+typedef enum {
+        BENCH_MODE_BASELINE = 0,
+        BENCH_MODE_AUDIT,
+        BENCH_MODE_PRELOAD,
+        BENCH_N_MODES,
+} BenchMode;
+
+static const char *bench_mode_names[BENCH_N_MODES] = {
+        "baseline (no interception)",
+        "audit (LD_AUDIT)",
+        "preload (dlopen hook + overlay)",
+};
+
+typedef struct BenchEnv {
+        const char *intercept;
+        const char *redirect;
+        char *self;
+        char *library_path; /**<Directory holding the vendored libraries */
+        char *vendored;     /**<The vendored libz.so.1 */
+        char *overlay;      /**<Overlay root */
+        char *cache;        /**<Stands in for XDG_CACHE_HOME */
+        char root[64];
+} BenchEnv;
+
+static inline uint64_t bench_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a;
+        uint64_t y = *(const uint64_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+static inline double bench_percentile(const uint64_t *sorted, size_t n, double p)
+{
+        return (double)sorted[(size_t)(p * (double)(n - 1))];
+}
+
+/**
+ * Runs within the child, reporting dlopen() percentiles on stdout
+ */
+static int bench_child(int rounds, const char *vendored)
+{
+        const char *names[] = { "libz.so.1", vendored, "libm.so.6" };
+        size_t n_samples = (size_t)rounds * ARRAY_SIZE(names);
+        uint64_t *samples = NULL;
+
+        if (rounds < 1) {
+                return EXIT_SUCCESS;
+        }
+        samples = calloc(n_samples, sizeof(uint64_t));
+        if (!samples) {
+                return EXIT_FAILURE;
+        }
+
+        for (int r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+                        uint64_t start = bench_now();
+                        void *handle = dlopen(names[i], RTLD_NOW);
+                        if (!handle) {
+                                fprintf(stderr, "dlopen(%s) failed: %s\n", names[i], dlerror());
+                                free(samples);
+                                return EXIT_FAILURE;
+                        }
+                        dlclose(handle);
+                        samples[(size_t)r * ARRAY_SIZE(names) + i] = bench_now() - start;
+                }
+        }
+
+        qsort(samples, n_samples, sizeof(uint64_t), bench_compare);
+        printf("%.0f %.0f %.0f\n",
+               bench_percentile(samples, n_samples, 0.50),
+               bench_percentile(samples, n_samples, 0.90),
+               bench_percentile(samples, n_samples, 0.99));
+        free(samples);
+        return EXIT_SUCCESS;
+}
+
+/**
+ * Set up the environment of the child for @mode, just as the shim would
+ */
+static void bench_child_env(const BenchEnv *env, BenchMode mode)
+{
+        autofree(char) *overlay_32 = NULL;
+        autofree(char) *overlay_64 = NULL;
+        autofree(char) *path = NULL;
+
+        unsetenv("LD_AUDIT");
+        unsetenv("LD_PRELOAD");
+        unsetenv(LSI_OVERLAY_ENV);
+        setenv("XDG_CACHE_HOME", env->cache, 1);
+        setenv("LD_LIBRARY_PATH", env->library_path, 1);
+
+        switch (mode) {
+        case BENCH_MODE_AUDIT:
+                setenv("LD_AUDIT", env->intercept, 1);
+                break;
+        case BENCH_MODE_PRELOAD:
+                overlay_32 = lsi_overlay_class_dir(env->overlay, 32);
+                overlay_64 = lsi_overlay_class_dir(env->overlay, 64);
+                if (!overlay_32 || !overlay_64 ||
+                    asprintf(&path, "%s:%s:%s", overlay_32, overlay_64, env->library_path) < 0) {
+                        _exit(EXIT_FAILURE);
+                }
+                setenv("LD_LIBRARY_PATH", path, 1);
+                setenv("LD_PRELOAD", env->redirect, 1);
+                setenv(LSI_OVERLAY_ENV, env->overlay, 1);
+                break;
+        case BENCH_MODE_BASELINE:
+        default:
+                break;
+        }
+}
+
+/**
+ * Run a single child in @mode, returning how long it took from fork() to
+ * exit in @elapsed, and whatever it reported in @report
+ */
+static bool bench_spawn(const BenchEnv *env, BenchMode mode, int rounds, uint64_t *elapsed,
+                        char *report, size_t report_size)
+{
+        char rounds_arg[16];
+        size_t len = 0;
+        int pipe_fds[2] = { -1, -1 };
+        int status = 0;
+        uint64_t start;
+        pid_t pid;
+
+        snprintf(rounds_arg, sizeof(rounds_arg), "%d", rounds);
+        if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+                return false;
+        }
+
+        start = bench_now();
+        pid = fork();
+        if (pid < 0) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+                return false;
+        }
+        if (pid == 0) {
+                char *argv[] = { env->self, "--child", rounds_arg, env->vendored, NULL };
+                dup2(pipe_fds[1], STDOUT_FILENO);
+                bench_child_env(env, mode);
+                execv(env->self, argv);
+                _exit(EXIT_FAILURE);
+        }
+
+        close(pipe_fds[1]);
+        while (len + 1 < report_size) {
+                ssize_t r = read(pipe_fds[0], report + len, report_size - len - 1);
+                if (r <= 0) {
+                        break;
+                }
+                len += (size_t)r;
+        }
+        report[len] = '\0';
+        close(pipe_fds[0]);
+
+        if (waitpid(pid, &status, 0) != pid) {
+                return false;
+        }
+        *elapsed = bench_now() - start;
+        return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static bool bench_mode(const BenchEnv *env, BenchMode mode, int runs, int rounds)
+{
+        uint64_t *samples = calloc((size_t)runs, sizeof(uint64_t));
+        double p50 = 0, p90 = 0, p99 = 0;
+        char report[128];
+        uint64_t elapsed = 0;
+        bool ret = false;
+
+        if (!samples) {
+                return false;
+        }
+
+        /* First run warms up the page cache and the persistent caches */
+        if (!bench_spawn(env, mode, 0, &elapsed, report, sizeof(report))) {
+                fprintf(stderr, "%s: child failed\n", bench_mode_names[mode]);
+                goto end;
+        }
+        for (int i = 0; i < runs; i++) {
+                if (!bench_spawn(env, mode, 0, &samples[i], report, sizeof(report))) {
+                        goto end;
+                }
+        }
+        qsort(samples, (size_t)runs, sizeof(uint64_t), bench_compare);
+
+        if (!bench_spawn(env, mode, rounds, &elapsed, report, sizeof(report)) ||
+            sscanf(report, "%lf %lf %lf", &p50, &p90, &p99) != 3) {
+                fprintf(stderr, "%s: dlopen() child failed\n", bench_mode_names[mode]);
+                goto end;
+        }
+
+        printf("mode:       %s\n", bench_mode_names[mode]);
+        printf("startup us: p50 %.0f, p90 %.0f, max %.0f (%d runs)\n",
+               bench_percentile(samples, (size_t)runs, 0.50) / 1000.0,
+               bench_percentile(samples, (size_t)runs, 0.90) / 1000.0,
+               (double)samples[runs - 1] / 1000.0,
+               runs);
+        printf("dlopen ns:  p50 %.0f, p90 %.0f, p99 %.0f (%d rounds)\n", p50, p90, p99, rounds);
+        ret = true;
+
+end:
+        free(samples);
+        return ret;
+}
+
+static bool bench_copy(const char *source, const char *dest)
+{
+        char buf[65536];
+        bool ret = false;
+        ssize_t r;
+        int in = -1;
+        int out = -1;
+
+        in = open(source, O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+                return false;
+        }
+        out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 00755);
+        if (out < 0) {
+                goto end;
+        }
+        while ((r = read(in, buf, sizeof(buf))) > 0) {
+                if (write(out, buf, (size_t)r) != r) {
+                        goto end;
+                }
+        }
+        ret = r == 0;
+
+end:
+        close(in);
+        if (out >= 0) {
+                close(out);
+        }
+        return ret;
+}
+
+static int bench_remove_entry(const char *path, __lsi_unused__ const struct stat *st,
+                              __lsi_unused__ int flag, __lsi_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+/**
+ * Create the synthetic game tree and the overlay
+ */
+static bool bench_env_init(BenchEnv *env)
+{
+        const char *host_libz = lsi_host_resolver_find("libz.so.1");
+        LsiRules rules = { 0 };
+
+        if (!host_libz) {
+                fprintf(stderr, "This benchmark requires a host libz.so.1\n");
+                return false;
+        }
+
+        env->self = lsi_file_realpath("/proc/self/exe");
+        if (!env->self) {
+                return false;
+        }
+
+        strcpy(env->root, "/tmp/lsi-dlopen-bench.XXXXXX");
+        if (!mkdtemp(env->root)) {
+                fprintf(stderr, "Unable to create synthetic tree: %s\n", strerror(errno));
+                return false;
+        }
+        if (asprintf(&env->library_path, "%s/steamapps/common/game/lib", env->root) < 0 ||
+            asprintf(&env->vendored, "%s/libz.so.1", env->library_path) < 0 ||
+            asprintf(&env->overlay, "%s/overlay", env->root) < 0 ||
+            asprintf(&env->cache, "%s/cache", env->root) < 0) {
+                return false;
+        }
+        if (!nc_mkdir_p(env->library_path, 00755) || !bench_copy(host_libz, env->vendored)) {
+                fprintf(stderr, "Unable to create synthetic tree: %s\n", strerror(errno));
+                return false;
+        }
+
+        /* What the shim does for use-intercept-preload */
+        lsi_rules_db_load(0, &rules);
+        if (!lsi_overlay_prepare(env->overlay, &rules)) {
+                fprintf(stderr, "Unable to prepare the library overlay\n");
+                return false;
+        }
+        return true;
+}
+
+static void bench_env_free(BenchEnv *env)
+{
+        if (env->root[0]) {
+                nftw(env->root, bench_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+        free(env->self);
+        free(env->library_path);
+        free(env->vendored);
+        free(env->overlay);
+        free(env->cache);
+}
+
+int main(int argc, char **argv)
+{
+        BenchEnv env = { 0 };
+        int runs = 50;
+        int rounds = 200;
+        int ret = EXIT_FAILURE;
+        int opt;
+
+        if (argc == 4 && streq(argv[1], "--child")) {
+                return bench_child(atoi(argv[2]), argv[3]);
+        }
+
+        while ((opt = getopt(argc, argv, "n:d:")) != -1) {
+                switch (opt) {
+                case 'n':
+                        runs = atoi(optarg);
+                        if (runs < 1) {
+                                goto usage;
+                        }
+                        break;
+                case 'd':
+                        rounds = atoi(optarg);
+                        if (rounds < 1) {
+                                goto usage;
+                        }
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+        if (argc - optind != 2) {
+                goto usage;
+        }
+        env.intercept = argv[optind];
+        env.redirect = argv[optind + 1];
+
+        if (!bench_env_init(&env)) {
+                goto end;
+        }
+        for (int mode = 0; mode < BENCH_N_MODES; mode++) {
+                if (mode > 0) {
+                        putchar('\n');
+                }
+                fflush(stdout);
+                if (!bench_mode(&env, (BenchMode)mode, runs, rounds)) {
+                        goto end;
+                }
+        }
+        ret = EXIT_SUCCESS;
+
+end:
+        bench_env_free(&env);
+        return ret;
+
+usage:
+        fprintf(stderr, "usage: %s [-n runs] [-d rounds] intercept-module redirect-module\n",
+                argv[0]);
+        fprintf(stderr, "  -n  processes to start per mode\n");
+        fprintf(stderr, "  -d  dlopen() rounds per mode\n");
+        return EXIT_FAILURE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,544 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../intercept/cache.h"
+#include "../intercept/capture.h"
+#include "../intercept/search.h"
+#include "nica/util.h"
+
+/**
+ * Replay la_objsearch captures (see LSI_INTERCEPT_CAPTURE) through the real
+ * intercept decision code, against a synthetic filesystem tree recreating
+ * every library that existed when the capture was made.
+ *
+ *      lsi-intercept-bench [-n rounds] [-N] [-S] capture...
+ *
+ * Absolute names and working directories are rebased into the tree, so
+ * decisions match the captured process as long as the patterns don't depend
+ * on the leading path. Host libraries still come from this machine's
+ * ld.so.cache, and the persistent disk cache is never consulted.
+ */
+
+typedef struct BenchOp {
+        LsiCaptureKind kind; /**<LSI_CAPTURE_CWD or LSI_CAPTURE_SEARCH */
+        InterceptMode mode;
+        unsigned int flag;
+        char *name; /**<Rebased into the synthetic tree where needed */
+} BenchOp;
+
+typedef struct BenchLog {
+        char *process;
+        BenchOp *ops;
+        size_t n_ops;
+        size_t n_searches;
+        size_t n_cwds;
+        char root[64];
+} BenchLog;
+
+typedef struct BenchOutcome {
+        unsigned long pass;
+        unsigned long block;
+        unsigned long replace;
+} BenchOutcome;
+
+static inline uint64_t bench_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Create every directory leading up to @path
+ */
+static void bench_mkdir_parents(char *path)
+{
+        for (char *c = strchr(path + 1, '/'); c; c = strchr(c + 1, '/')) {
+                *c = '\0';
+                (void)mkdir(path, 00755);
+                *c = '/';
+        }
+}
+
+/**
+ * Recreate a file or directory that existed in the captured process
+ */
+static void bench_create(const char *path, bool directory)
+{
+        autofree(char) *copy = strdup(path);
+        int fd;
+
+        if (!copy) {
+                return;
+        }
+        bench_mkdir_parents(copy);
+
+        if (directory) {
+                (void)mkdir(path, 00755);
+                return;
+        }
+        fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 00644);
+        if (fd >= 0) {
+                close(fd);
+        }
+}
+
+static int bench_remove_entry(const char *path, __lsi_unused__ const struct stat *st,
+                              __lsi_unused__ int type, __lsi_unused__ struct FTW *ftw)
+{
+        (void)remove(path);
+        return 0;
+}
+
+static void bench_log_free(BenchLog *log)
+{
+        if (log->root[0]) {
+                nftw(log->root, bench_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+        for (size_t i = 0; i < log->n_ops; i++) {
+                free(log->ops[i].name);
+        }
+        free(log->ops);
+        free(log->process);
+        memset(log, 0, sizeof(*log));
+}
+
+/**
+ * Rebase @name into the synthetic tree if it's anchored to the working
+ * directory or filesystem root, leaving plain sonames untouched.
+ */
+static char *bench_rebase(const BenchLog *log, const char *cwd, const char *name, bool anchor)
+{
+        char *ret = NULL;
+
+        if (name[0] == '/') {
+                if (asprintf(&ret, "%s%s", log->root, name) < 0) {
+                        return NULL;
+                }
+        } else if (anchor) {
+                if (asprintf(&ret, "%s%s/%s", log->root, cwd, name) < 0) {
+                        return NULL;
+                }
+        } else {
+                ret = strdup(name);
+        }
+        return ret;
+}
+
+/**
+ * Parse a capture and build its synthetic tree
+ */
+static bool bench_log_load(const char *path, BenchLog *log)
+{
+        LsiCaptureHeader header = { 0 };
+        const char *cwd = "/";
+        char *data = NULL;
+        size_t size = 0;
+        size_t offset = 0;
+        bool ret = false;
+        FILE *fp = NULL;
+        long end = 0;
+
+        fp = fopen(path, "re");
+        if (!fp) {
+                fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+                return false;
+        }
+        if (fread(&header, sizeof(header), 1, fp) != 1 ||
+            memcmp(header.magic, LSI_CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != LSI_CAPTURE_VERSION) {
+                fprintf(stderr, "%s is not a supported capture\n", path);
+                goto end;
+        }
+        if (fseek(fp, 0, SEEK_END) != 0 || (end = ftell(fp)) < (long)sizeof(header) ||
+            fseek(fp, (long)sizeof(header), SEEK_SET) != 0) {
+                goto end;
+        }
+        size = (size_t)end - sizeof(header);
+        data = malloc(size ? size : 1);
+        log->ops = calloc(header.n_records ? header.n_records : 1, sizeof(BenchOp));
+        if (!data || !log->ops || fread(data, 1, size, fp) != size) {
+                goto end;
+        }
+
+        strcpy(log->root, "/tmp/lsi-intercept-bench-XXXXXX");
+        if (!mkdtemp(log->root)) {
+                fprintf(stderr, "Unable to create synthetic tree: %s\n", strerror(errno));
+                log->root[0] = '\0';
+                goto end;
+        }
+
+        for (uint32_t i = 0; i < header.n_records; i++) {
+                const LsiCaptureRecord *record = (const LsiCaptureRecord *)(data + offset);
+                const char *s = (const char *)(record + 1);
+                BenchOp *op = &log->ops[log->n_ops];
+
+                if (size - offset < sizeof(*record) || record->length == 0 ||
+                    record->length > size - offset ||
+                    size - offset < lsi_capture_record_size(record->length) ||
+                    s[record->length - 1] != '\0') {
+                        fprintf(stderr, "%s is truncated at record %u\n", path, i);
+                        goto end;
+                }
+                offset += lsi_capture_record_size(record->length);
+
+                switch (record->kind) {
+                case LSI_CAPTURE_PROCESS:
+                        free(log->process);
+                        log->process = strdup(s);
+                        break;
+                case LSI_CAPTURE_CWD:
+                        op->kind = LSI_CAPTURE_CWD;
+                        op->name = bench_rebase(log, "", s, true);
+                        if (!op->name) {
+                                goto end;
+                        }
+                        cwd = s;
+                        bench_create(op->name, true);
+                        ++log->n_cwds;
+                        ++log->n_ops;
+                        break;
+                case LSI_CAPTURE_SEARCH:
+                        op->kind = LSI_CAPTURE_SEARCH;
+                        op->mode = (InterceptMode)record->mode;
+                        op->flag = record->flag;
+                        op->name = bench_rebase(log, cwd, s, false);
+                        if (!op->name) {
+                                goto end;
+                        }
+                        if (record->exists) {
+                                autofree(char) *file = bench_rebase(log, cwd, s, true);
+                                if (file) {
+                                        bench_create(file, false);
+                                }
+                        }
+                        ++log->n_searches;
+                        ++log->n_ops;
+                        break;
+                default:
+                        break;
+                }
+        }
+        ret = true;
+
+end:
+        free(data);
+        fclose(fp);
+        return ret;
+}
+
+/**
+ * Decide a single search exactly as la_objsearch does, minus the disk cache
+ */
+static char *bench_decide(const BenchOp *op, bool use_cache)
+{
+        char *ret = NULL;
+
+        if (op->mode == INTERCEPT_MODE_NONE) {
+                return op->name;
+        }
+        if (use_cache && lsi_decision_cache_lookup(op->name, op->flag, op->mode, &ret)) {
+                return ret;
+        }
+        ret = lsi_search_decide(op->mode, op->flag, op->name);
+        if (use_cache && lsi_search_is_cacheable(op->mode, op->flag, op->name, ret)) {
+                ret = lsi_decision_cache_store(op->name, op->flag, op->mode, ret);
+        }
+        return ret;
+}
+
+/**
+ * Replay the whole log once from cold decision and file caches, timing each search
+ * into @samples if given.
+ *
+ * @returns false if the synthetic tree can't be walked as captured
+ */
+static bool bench_replay(const BenchLog *log, bool use_cache, uint64_t *samples,
+                         BenchOutcome *outcome)
+{
+        size_t n = 0;
+
+        lsi_decision_cache_clear();
+        lsi_file_cache_invalidate();
+        if (chdir(log->root) != 0) {
+                fprintf(stderr, "Unable to enter %s: %s\n", log->root, strerror(errno));
+                return false;
+        }
+
+        for (size_t i = 0; i < log->n_ops; i++) {
+                const BenchOp *op = &log->ops[i];
+                uint64_t start;
+                char *ret;
+
+                if (op->kind == LSI_CAPTURE_CWD) {
+                        if (chdir(op->name) != 0) {
+                                fprintf(stderr,
+                                        "Unable to enter %s: %s\n",
+                                        op->name,
+                                        strerror(errno));
+                                return false;
+                        }
+                        continue;
+                }
+
+                start = samples ? bench_now() : 0;
+                ret = bench_decide(op, use_cache);
+                if (samples) {
+                        samples[n++] = bench_now() - start;
+                }
+                if (!outcome) {
+                        continue;
+                }
+                if (!ret) {
+                        ++outcome->block;
+                } else if (ret == op->name) {
+                        ++outcome->pass;
+                } else {
+                        ++outcome->replace;
+                }
+        }
+        return true;
+}
+
+/**
+ * Replay once in a traced child, counting every system call it makes
+ *
+ * @returns the count, or -1 if tracing isn't permitted here
+ */
+static long bench_count_syscalls(const BenchLog *log, bool use_cache)
+{
+        long calls = 0;
+        bool entering = true;
+        int status = 0;
+        pid_t pid;
+
+        pid = fork();
+        if (pid < 0) {
+                return -1;
+        }
+        if (pid == 0) {
+                if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) {
+                        _exit(EXIT_FAILURE);
+                }
+                raise(SIGSTOP);
+                _exit(bench_replay(log, use_cache, NULL, NULL) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status) ||
+            ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD) != 0) {
+                kill(pid, SIGKILL);
+                waitpid(pid, NULL, 0);
+                return -1;
+        }
+
+        for (;;) {
+                if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) != 0 ||
+                    waitpid(pid, &status, 0) != pid) {
+                        return -1;
+                }
+                if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                        break;
+                }
+                if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+                        calls += entering;
+                        entering = !entering;
+                }
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+                return -1;
+        }
+        /* Don't count the final exit_group() */
+        return calls - 1;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a;
+        uint64_t y = *(const uint64_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+static inline double bench_percentile(const uint64_t *sorted, size_t n, double p)
+{
+        return (double)sorted[(size_t)(p * (double)(n - 1))];
+}
+
+static bool bench_run(const char *path, int rounds, bool use_cache, bool count_syscalls)
+{
+        BenchLog log = { 0 };
+        BenchOutcome outcome = { 0 };
+        uint64_t *samples = NULL;
+        size_t n_samples = 0;
+        uint64_t start, elapsed;
+        long syscalls = -1;
+        bool ret = false;
+
+        if (!bench_log_load(path, &log)) {
+                goto end;
+        }
+        if (log.n_searches == 0) {
+                fprintf(stderr, "%s has no searches to replay\n", path);
+                goto end;
+        }
+
+        n_samples = log.n_searches * (size_t)rounds;
+        samples = calloc(n_samples, sizeof(uint64_t));
+        if (!samples) {
+                goto end;
+        }
+
+        /* Warm up, and note what was decided */
+        if (!bench_replay(&log, use_cache, NULL, &outcome)) {
+                goto end;
+        }
+
+        start = bench_now();
+        for (int r = 0; r < rounds; r++) {
+                if (!bench_replay(&log, use_cache, samples + log.n_searches * (size_t)r, NULL)) {
+                        goto end;
+                }
+        }
+        elapsed = bench_now() - start;
+        qsort(samples, n_samples, sizeof(uint64_t), bench_compare);
+
+        if (count_syscalls) {
+                syscalls = bench_count_syscalls(&log, use_cache);
+        }
+
+        printf("capture:    %s (%s, %zu searches, %zu directories)\n",
+               path,
+               log.process ? log.process : "unknown",
+               log.n_searches,
+               log.n_cwds);
+        printf("decisions:  %lu pass, %lu block, %lu replace\n",
+               outcome.pass,
+               outcome.block,
+               outcome.replace);
+        printf("rounds:     %d, decision cache %s\n", rounds, use_cache ? "on" : "off");
+        printf("ns/call:    p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f\n",
+               bench_percentile(samples, n_samples, 0.50),
+               bench_percentile(samples, n_samples, 0.90),
+               bench_percentile(samples, n_samples, 0.99),
+               bench_percentile(samples, n_samples, 0.999),
+               (double)samples[n_samples - 1]);
+        printf("throughput: %.0f decisions/s\n", (double)n_samples * 1e9 / (double)elapsed);
+        if (syscalls >= 0) {
+                printf("syscalls:   %ld per replay, %.2f per search\n",
+                       syscalls,
+                       (double)syscalls / (double)log.n_searches);
+        } else if (count_syscalls) {
+                printf("syscalls:   unavailable (ptrace not permitted)\n");
+        }
+        ret = true;
+
+end:
+        free(samples);
+        bench_log_free(&log);
+        return ret;
+}
+
+int main(int argc, char **argv)
+{
+        bool count_syscalls = true;
+        bool use_cache = true;
+        int rounds = 20;
+        int ret = EXIT_SUCCESS;
+        int cwd_fd = -1;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "n:NS")) != -1) {
+                switch (opt) {
+                case 'n':
+                        rounds = atoi(optarg);
+                        if (rounds < 1) {
+                                goto usage;
+                        }
+                        break;
+                case 'N':
+                        use_cache = false;
+                        break;
+                case 'S':
+                        count_syscalls = false;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+        if (optind == argc) {
+                goto usage;
+        }
+
+        /* Match the process defaults rather than whatever the user configured */
+        lsi_search_init(&lsi_builtin_patterns);
+
+        /* Replays move around the synthetic tree, so come back between captures */
+        cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cwd_fd < 0) {
+                fprintf(stderr, "Unable to open working directory: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        for (int i = optind; i < argc; i++) {
+                if (i > optind) {
+                        putchar('\n');
+                }
+                if (!bench_run(argv[i], rounds, use_cache, count_syscalls)) {
+                        ret = EXIT_FAILURE;
+                }
+                if (fchdir(cwd_fd) != 0) {
+                        fprintf(stderr, "Unable to return to working directory: %s\n",
+                                strerror(errno));
+                        ret = EXIT_FAILURE;
+                        break;
+                }
+        }
+        close(cwd_fd);
+        return ret;
+
+usage:
+        fprintf(stderr, "usage: %s [-n rounds] [-N] [-S] capture...\n", argv[0]);
+        fprintf(stderr, "  -N  disable the in-process decision cache\n");
+        fprintf(stderr, "  -S  skip counting system calls\n");
+        return EXIT_FAILURE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,259 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../redirect/redirect.h"
+#include "nica/util.h"
+
+/**
+ * Measure what libredirect adds to every open() of a game with a redirect
+ * profile, comparing the source index against resolving each path and
+ * walking the op_table chain as the hooks used to.
+ *
+ *      lsi-redirect-bench [rounds]
+ *
+ * The synthetic game has BENCH_DIRS * BENCH_FILES assets, more than the file
+ * cache holds, of which BENCH_REDIRECTS are redirected. Assets are opened by
+ * relative path from the game directory, as most engines do.
+ */
+
+#define BENCH_DIRS 64
+#define BENCH_FILES 64
+#define BENCH_REDIRECTS 4
+#define BENCH_N_PATHS (BENCH_DIRS * BENCH_FILES)
+
+typedef LsiRedirect *(*BenchLookup)(LsiRedirectProfile *profile, const char *p);
+
+static inline double now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * The lookup as it was before the index
+ */
+static LsiRedirect *lookup_chain(LsiRedirectProfile *profile, const char *p)
+{
+        autofree(char) *path = lsi_file_realpath(p);
+
+        if (!path) {
+                return NULL;
+        }
+        for (LsiRedirect *r = profile->op_table[LSI_OPERATION_OPEN]; r; r = r->next) {
+                if (r->type == LSI_REDIRECT_PATH && strcmp(r->path_source, path) == 0) {
+                        return r;
+                }
+        }
+        return NULL;
+}
+
+static LsiRedirect *lookup_index(LsiRedirectProfile *profile, const char *p)
+{
+        const LsiRedirectIndex *index = &profile->op_index[LSI_OPERATION_OPEN];
+        autofree(char) *path = NULL;
+
+        if (!lsi_redirect_index_filter(index, p)) {
+                return NULL;
+        }
+        path = lsi_file_realpath(p);
+        if (!path) {
+                return NULL;
+        }
+        return lsi_redirect_index_find(index, path);
+}
+
+static double run(BenchLookup lookup, LsiRedirectProfile *profile, char **paths, int rounds)
+{
+        volatile uintptr_t sink = 0;
+        double start = now_ns();
+
+        for (int r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < BENCH_N_PATHS; i++) {
+                        sink += (uintptr_t)lookup(profile, paths[i]);
+                }
+        }
+        (void)sink;
+        return (now_ns() - start) / ((double)rounds * BENCH_N_PATHS);
+}
+
+static bool touch(const char *path)
+{
+        int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 00644);
+
+        if (fd < 0) {
+                return false;
+        }
+        close(fd);
+        return true;
+}
+
+/**
+ * Lay out the synthetic game within @root and build its profile
+ */
+static LsiRedirectProfile *bench_setup(const char *root, char **paths)
+{
+        LsiRedirectProfile *profile = NULL;
+        char dir[PATH_MAX];
+
+        profile = lsi_redirect_profile_new("bench");
+        if (!profile) {
+                return NULL;
+        }
+
+        if (mkdir("Content", 00755) < 0) {
+                goto failed;
+        }
+        for (int d = 0; d < BENCH_DIRS; d++) {
+                snprintf(dir, sizeof(dir), "Content/Maps%02d", d);
+                if (mkdir(dir, 00755) < 0) {
+                        goto failed;
+                }
+                for (int f = 0; f < BENCH_FILES; f++) {
+                        char **path = &paths[d * BENCH_FILES + f];
+                        if (asprintf(path, "%s/Texture_%03d.uasset", dir, f) < 0) {
+                                *path = NULL;
+                                goto failed;
+                        }
+                        if (!touch(*path)) {
+                                goto failed;
+                        }
+                }
+        }
+
+        if (mkdir("Mods", 00755) < 0) {
+                goto failed;
+        }
+        for (int i = 0; i < BENCH_REDIRECTS; i++) {
+                autofree(char) *source = NULL;
+                autofree(char) *target = NULL;
+                LsiRedirect *redirect = NULL;
+
+                /* Spread across the tree so the walk isn't always short */
+                const char *rel = paths[(size_t)i * (BENCH_N_PATHS / BENCH_REDIRECTS) + 7];
+                if (asprintf(&source, "%s/%s", root, rel) < 0 ||
+                    asprintf(&target, "%s/Mods/Fixed_%d.uasset", root, i) < 0 || !touch(target)) {
+                        goto failed;
+                }
+                redirect = lsi_redirect_new_path_replacement(source, target);
+                if (!redirect) {
+                        goto failed;
+                }
+                lsi_redirect_profile_insert_rule(profile, redirect);
+        }
+        return profile;
+
+failed:
+        fprintf(stderr, "Unable to set up the game in %s: %s\n", root, strerror(errno));
+        lsi_redirect_profile_free(profile);
+        return NULL;
+}
+
+static int bench_remove_entry(const char *path, __lsi_unused__ const struct stat *st,
+                              __lsi_unused__ int flag, __lsi_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+        int rounds = argc > 1 ? atoi(argv[1]) : 20;
+        char root[] = "/tmp/lsi-redirect-bench.XXXXXX";
+        char **paths = NULL;
+        LsiRedirectProfile *profile = NULL;
+        const LsiRedirectIndex *index = NULL;
+        double t_chain, t_index;
+        size_t n_filtered = 0;
+        int ret = EXIT_FAILURE;
+
+        if (rounds < 1) {
+                fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        paths = calloc(BENCH_N_PATHS, sizeof(char *));
+        if (!paths || !mkdtemp(root) || chdir(root) < 0) {
+                fprintf(stderr, "Unable to create %s: %s\n", root, strerror(errno));
+                root[0] = '\0';
+                goto end;
+        }
+
+        /* As libredirect runs it */
+        lsi_file_cache_init(LSI_FILE_CACHE_WATCH);
+
+        profile = bench_setup(root, paths);
+        if (!profile) {
+                goto end;
+        }
+        index = &profile->op_index[LSI_OPERATION_OPEN];
+
+        /* Both strategies must agree before timing means anything */
+        for (size_t i = 0; i < BENCH_N_PATHS; i++) {
+                if (lookup_chain(profile, paths[i]) != lookup_index(profile, paths[i])) {
+                        fprintf(stderr, "Mismatched lookup for %s\n", paths[i]);
+                        goto end;
+                }
+                n_filtered += lsi_redirect_index_filter(index, paths[i]) ? 1 : 0;
+        }
+
+        t_chain = run(lookup_chain, profile, paths, rounds);
+        t_index = run(lookup_index, profile, paths, rounds);
+
+        printf("assets:    %d (%d redirected, %zu past the filter)\n",
+               BENCH_N_PATHS,
+               BENCH_REDIRECTS,
+               n_filtered);
+        printf("realpath:  %8.1f ns/open\n", t_chain);
+        printf("index:     %8.1f ns/open\n", t_index);
+        printf("speedup:   %8.2fx\n", t_chain / t_index);
+        ret = EXIT_SUCCESS;
+
+end:
+        lsi_redirect_profile_free(profile);
+        if (paths) {
+                for (size_t i = 0; i < BENCH_N_PATHS; i++) {
+                        free(paths[i]);
+                }
+                free(paths);
+        }
+        if (root[0]) {
+                nftw(root, bench_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
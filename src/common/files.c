@@ -12,11 +12,18 @@
 #define _GNU_SOURCE
 
 #include <ctype.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <pwd.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common.h"
@@ -28,10 +35,480 @@
 
 DEF_AUTOFREE(VdfFile, vdf_file_close)
 
+/**
+ * Pending inotify events are drained at most this often, bounding how long a
+ * change made by another process can go unnoticed.
+ */
+#define LSI_FILE_CACHE_POLL_NS (50 * 1000 * 1000ull)
+
+typedef enum {
+        LSI_FILE_UNKNOWN = 0,
+        LSI_FILE_ABSENT,
+        LSI_FILE_PRESENT,
+} LsiFileState;
+
+/**
+ * A single slot in the direct mapped metadata cache
+ */
+typedef struct LsiFileEntry {
+        uint32_t hash;
+        uint32_t generation; /**<Stale unless it matches file_cache_generation */
+        char *path;
+        char *canonical; /**<realpath() result when resolves is LSI_FILE_PRESENT */
+        LsiFileState exists;
+        LsiFileState resolves;
+        LsiFileState elf;     /**<LSI_FILE_PRESENT when ident holds a valid header */
+        LsiElfIdent ident;
+} LsiFileEntry;
+
+/**
+ * A directory we tried to watch, and whether that worked
+ */
+typedef struct LsiFileWatch {
+        char *dir;
+        bool watched;
+} LsiFileWatch;
+
+static LsiFileEntry file_cache[LSI_FILE_CACHE_SLOTS];
+static uint32_t file_cache_generation = 1;
+static unsigned int file_cache_flags = LSI_FILE_CACHE_DEFAULT;
+
+/* Only held for table updates, never across the filesystem calls themselves */
+static atomic_flag file_cache_lock = ATOMIC_FLAG_INIT;
+
+/* Twice the watch limit keeps the open addressing table at most half full */
+static LsiFileWatch file_watches[LSI_FILE_CACHE_MAX_WATCHES * 2];
+static size_t n_file_watches = 0;
+static int watch_fd = -1;
+static pid_t watch_pid = 0;
+static uint64_t watch_last_poll = 0;
+
+/* Counters emitted when LSI_DEBUG is set */
+static unsigned long file_cache_hits = 0;
+static unsigned long file_cache_misses = 0;
+
+static inline void lsi_file_cache_lock(void)
+{
+        while (atomic_flag_test_and_set_explicit(&file_cache_lock, memory_order_acquire)) {
+                sched_yield();
+        }
+}
+
+static inline void lsi_file_cache_unlock(void)
+{
+        atomic_flag_clear_explicit(&file_cache_lock, memory_order_release);
+}
+
+static inline uint32_t lsi_file_hash(const char *s, size_t len)
+{
+        uint32_t h = 2166136261u;
+
+        for (size_t i = 0; i < len; i++) {
+                h ^= (uint8_t)s[i];
+                h *= 16777619u;
+        }
+        return h;
+}
+
+/**
+ * Forget every watched directory, along with the inotify instance
+ */
+static void lsi_file_cache_drop_watches(void)
+{
+        for (size_t i = 0; i < ARRAY_SIZE(file_watches); i++) {
+                free(file_watches[i].dir);
+                file_watches[i].dir = NULL;
+        }
+        n_file_watches = 0;
+        if (watch_fd >= 0) {
+                close(watch_fd);
+                watch_fd = -1;
+        }
+}
+
+/**
+ * Start watching when the first answer is about to be cached, so processes
+ * that never cache anything don't hold an inotify instance. Falls back to no
+ * caching at all if inotify is unavailable as we'd otherwise serve stale
+ * answers forever. Called with the lock held.
+ */
+static bool lsi_file_cache_start_watch(void)
+{
+        if (watch_fd >= 0) {
+                return true;
+        }
+        watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        watch_pid = getpid();
+        if (watch_fd < 0) {
+                lsi_log_debug("file cache: inotify unavailable, caching disabled");
+                file_cache_flags |= LSI_FILE_CACHE_DISABLE;
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Drain pending inotify events, invalidating everything if there were any.
+ * Called with the lock held.
+ */
+static void lsi_file_cache_poll(void)
+{
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        struct timespec ts = { 0 };
+        bool changed = false;
+        uint64_t now;
+
+        if (!(file_cache_flags & LSI_FILE_CACHE_WATCH) || watch_fd < 0) {
+                return;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        if (now - watch_last_poll < LSI_FILE_CACHE_POLL_NS) {
+                return;
+        }
+        watch_last_poll = now;
+
+        /* A forked child shares our inotify queue, so it needs its own */
+        if (getpid() != watch_pid) {
+                lsi_file_cache_drop_watches();
+                ++file_cache_generation;
+                return;
+        }
+
+        while (read(watch_fd, buf, sizeof(buf)) > 0) {
+                changed = true;
+        }
+        if (changed) {
+                ++file_cache_generation;
+        }
+}
+
+/**
+ * Ensure changes to the directory holding @path will be seen.
+ * Called with the lock held.
+ *
+ * @returns false if they can't be, so the answer mustn't be cached
+ */
+static bool lsi_file_cache_watch_parent(const char *path)
+{
+        const uint32_t mask = ARRAY_SIZE(file_watches) - 1;
+        const char *slash = strrchr(path, '/');
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        uint32_t hash = lsi_file_hash(path, len);
+        LsiFileWatch *w = NULL;
+
+        if (!lsi_file_cache_start_watch()) {
+                return false;
+        }
+
+        for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+                w = &file_watches[i];
+                if (!w->dir) {
+                        break;
+                }
+                if (strncmp(w->dir, path, len) == 0 && w->dir[len] == '\0') {
+                        return w->watched;
+                }
+        }
+
+        if (n_file_watches == LSI_FILE_CACHE_MAX_WATCHES) {
+                return false;
+        }
+        w->dir = strndup(path, len);
+        if (!w->dir) {
+                return false;
+        }
+        ++n_file_watches;
+        w->watched = inotify_add_watch(watch_fd,
+                                       w->dir,
+                                       IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF |
+                                           IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO |
+                                           IN_ONLYDIR) >= 0;
+        return w->watched;
+}
+
+/**
+ * Absolute paths are the only ones whose answer doesn't depend on the
+ * working directory. Also starts polling for changes. Called with the lock held.
+ */
+static bool lsi_file_cache_usable(const char *path)
+{
+        if (path[0] != '/' || (file_cache_flags & LSI_FILE_CACHE_DISABLE)) {
+                return false;
+        }
+        lsi_file_cache_poll();
+        return !(file_cache_flags & LSI_FILE_CACHE_DISABLE);
+}
+
+/**
+ * Return the current entry for @path, if any. Called with the lock held.
+ */
+static LsiFileEntry *lsi_file_cache_find(const char *path, uint32_t hash)
+{
+        LsiFileEntry *e = &file_cache[hash & (LSI_FILE_CACHE_SLOTS - 1)];
+
+        if (e->generation != file_cache_generation || e->hash != hash || !e->path ||
+            strcmp(e->path, path) != 0) {
+                return NULL;
+        }
+        return e;
+}
+
+/**
+ * Return the slot to record an answer for @path in, evicting whatever was
+ * there, unless the cache was invalidated since @generation was sampled.
+ * Called with the lock held.
+ */
+static LsiFileEntry *lsi_file_cache_claim(const char *path, uint32_t hash, uint32_t generation)
+{
+        LsiFileEntry *e = NULL;
+
+        if (generation != file_cache_generation) {
+                return NULL;
+        }
+        e = lsi_file_cache_find(path, hash);
+        if (e) {
+                return e;
+        }
+        if ((file_cache_flags & LSI_FILE_CACHE_WATCH) && !lsi_file_cache_watch_parent(path)) {
+                return NULL;
+        }
+
+        e = &file_cache[hash & (LSI_FILE_CACHE_SLOTS - 1)];
+        free(e->path);
+        free(e->canonical);
+        memset(e, 0, sizeof(*e));
+        e->path = strdup(path);
+        if (!e->path) {
+                return NULL;
+        }
+        e->hash = hash;
+        e->generation = generation;
+        return e;
+}
+
+void lsi_file_cache_init(unsigned int flags)
+{
+        lsi_file_cache_lock();
+        file_cache_flags = flags;
+        lsi_file_cache_drop_watches();
+        ++file_cache_generation;
+        lsi_file_cache_unlock();
+}
+
+void lsi_file_cache_invalidate(void)
+{
+        lsi_file_cache_lock();
+        ++file_cache_generation;
+        lsi_file_cache_unlock();
+}
+
 bool lsi_file_exists(const char *path)
 {
         __lsi_unused__ struct stat st = { 0 };
-        return lstat(path, &st) == 0;
+        LsiFileState state = LSI_FILE_UNKNOWN;
+        LsiFileEntry *e = NULL;
+        uint32_t generation = 0;
+        uint32_t hash = 0;
+        bool exists = false;
+
+        lsi_file_cache_lock();
+        if (!lsi_file_cache_usable(path)) {
+                lsi_file_cache_unlock();
+                return lstat(path, &st) == 0;
+        }
+        hash = lsi_file_hash(path, strlen(path));
+        generation = file_cache_generation;
+        e = lsi_file_cache_find(path, hash);
+        if (e && e->exists != LSI_FILE_UNKNOWN) {
+                state = e->exists;
+                ++file_cache_hits;
+        } else {
+                ++file_cache_misses;
+        }
+        lsi_file_cache_unlock();
+
+        if (state != LSI_FILE_UNKNOWN) {
+                return state == LSI_FILE_PRESENT;
+        }
+
+        exists = lstat(path, &st) == 0;
+
+        lsi_file_cache_lock();
+        e = lsi_file_cache_claim(path, hash, generation);
+        if (e) {
+                e->exists = exists ? LSI_FILE_PRESENT : LSI_FILE_ABSENT;
+        }
+        lsi_file_cache_unlock();
+        return exists;
+}
+
+char *lsi_file_realpath(const char *path)
+{
+        LsiFileState state = LSI_FILE_UNKNOWN;
+        LsiFileEntry *e = NULL;
+        char *ret = NULL;
+        uint32_t generation = 0;
+        uint32_t hash = 0;
+        int err;
+
+        lsi_file_cache_lock();
+        if (!lsi_file_cache_usable(path)) {
+                lsi_file_cache_unlock();
+                return realpath(path, NULL);
+        }
+        hash = lsi_file_hash(path, strlen(path));
+        generation = file_cache_generation;
+        e = lsi_file_cache_find(path, hash);
+        if (e && e->resolves != LSI_FILE_UNKNOWN) {
+                state = e->resolves;
+                ret = state == LSI_FILE_PRESENT ? strdup(e->canonical) : NULL;
+                ++file_cache_hits;
+        } else {
+                ++file_cache_misses;
+        }
+        lsi_file_cache_unlock();
+
+        if (state == LSI_FILE_ABSENT) {
+                errno = ENOENT;
+                return NULL;
+        }
+        if (state == LSI_FILE_PRESENT) {
+                return ret;
+        }
+
+        ret = realpath(path, NULL);
+        err = errno;
+
+        /* Only remember definite answers, not transient failures */
+        if (!ret && err != ENOENT && err != ENOTDIR) {
+                return NULL;
+        }
+
+        lsi_file_cache_lock();
+        e = lsi_file_cache_claim(path, hash, generation);
+        if (e && ret) {
+                e->canonical = strdup(ret);
+                if (e->canonical) {
+                        e->resolves = LSI_FILE_PRESENT;
+                        e->exists = LSI_FILE_PRESENT;
+                }
+        } else if (e) {
+                e->resolves = LSI_FILE_ABSENT;
+        }
+        lsi_file_cache_unlock();
+
+        errno = err;
+        return ret;
+}
+
+/**
+ * Read the first 20 bytes of @path, which is all of e_ident plus e_type and
+ * e_machine in either ELF class
+ *
+ * @returns 1 for an ELF file, 0 for a definite non-ELF answer, -1 on a
+ * transient failure
+ */
+static int lsi_file_read_elf_ident(const char *path, LsiElfIdent *ident)
+{
+        unsigned char buf[EI_NIDENT + 4];
+        ssize_t n;
+        int fd;
+        int err;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+        if (fd < 0) {
+                return errno == ENOENT || errno == ENOTDIR || errno == ELOOP ? 0 : -1;
+        }
+        do {
+                n = pread(fd, buf, sizeof(buf), 0);
+        } while (n < 0 && errno == EINTR);
+        err = errno;
+        close(fd);
+
+        if (n < 0) {
+                return err == EISDIR ? 0 : -1;
+        }
+        if ((size_t)n < sizeof(buf) || memcmp(buf, ELFMAG, SELFMAG) != 0) {
+                return 0;
+        }
+
+        ident->elf_class = buf[EI_CLASS];
+        if (buf[EI_DATA] == ELFDATA2MSB) {
+                ident->machine = (uint16_t)(buf[EI_NIDENT + 2] << 8 | buf[EI_NIDENT + 3]);
+        } else {
+                ident->machine = (uint16_t)(buf[EI_NIDENT + 3] << 8 | buf[EI_NIDENT + 2]);
+        }
+        return 1;
+}
+
+bool lsi_file_elf_ident(const char *path, LsiElfIdent *ident)
+{
+        LsiFileState state = LSI_FILE_UNKNOWN;
+        LsiFileEntry *e = NULL;
+        uint32_t generation = 0;
+        uint32_t hash = 0;
+        int ret;
+
+        lsi_file_cache_lock();
+        if (!lsi_file_cache_usable(path)) {
+                lsi_file_cache_unlock();
+                return lsi_file_read_elf_ident(path, ident) > 0;
+        }
+        hash = lsi_file_hash(path, strlen(path));
+        generation = file_cache_generation;
+        e = lsi_file_cache_find(path, hash);
+        if (e && e->elf != LSI_FILE_UNKNOWN) {
+                state = e->elf;
+                *ident = e->ident;
+                ++file_cache_hits;
+        } else {
+                ++file_cache_misses;
+        }
+        lsi_file_cache_unlock();
+
+        if (state != LSI_FILE_UNKNOWN) {
+                return state == LSI_FILE_PRESENT;
+        }
+
+        ret = lsi_file_read_elf_ident(path, ident);
+
+        /* Only remember definite answers, not transient failures */
+        if (ret < 0) {
+                return false;
+        }
+
+        lsi_file_cache_lock();
+        e = lsi_file_cache_claim(path, hash, generation);
+        if (e) {
+                e->elf = ret > 0 ? LSI_FILE_PRESENT : LSI_FILE_ABSENT;
+                if (ret > 0) {
+                        e->ident = *ident;
+                }
+        }
+        lsi_file_cache_unlock();
+        return ret > 0;
+}
+
+/**
+ * Report how effective the cache was and release it
+ */
+__attribute__((destructor)) static void lsi_file_cache_shutdown(void)
+{
+        lsi_file_cache_lock();
+        if (file_cache_hits || file_cache_misses) {
+                lsi_log_debug("file cache: %lu hits, %lu misses",
+                              file_cache_hits,
+                              file_cache_misses);
+        }
+        for (size_t i = 0; i < LSI_FILE_CACHE_SLOTS; i++) {
+                free(file_cache[i].path);
+                free(file_cache[i].canonical);
+        }
+        memset(file_cache, 0, sizeof(file_cache));
+        lsi_file_cache_drop_watches();
+        lsi_file_cache_unlock();
 }
 
 const char *lsi_get_home_dir()
@@ -59,7 +536,7 @@ char *lsi_get_user_config_dir()
 
         /* Respect the XDG_CONFIG_HOME variable if it is set */
         if (xdg_config) {
-                p = realpath(xdg_config, NULL);
+                p = lsi_file_realpath(xdg_config);
                 if (p) {
                         return p;
                 }
@@ -70,7 +547,7 @@ char *lsi_get_user_config_dir()
         if (asprintf(&c, "%s/.config", home) < 0) {
                 return NULL;
         }
-        p = realpath(c, NULL);
+        p = lsi_file_realpath(c);
         if (p) {
                 free(c);
                 return p;
@@ -78,6 +555,27 @@ char *lsi_get_user_config_dir()
         return c;
 }
 
+char *lsi_get_user_cache_dir()
+{
+        const char *home = NULL;
+        char *c = NULL;
+        char *xdg_cache = getenv("XDG_CACHE_HOME");
+
+        /* Respect the XDG_CACHE_HOME variable if it is set */
+        if (xdg_cache && *xdg_cache) {
+                return strdup(xdg_cache);
+        }
+
+        home = lsi_get_home_dir();
+        if (!home) {
+                return NULL;
+        }
+        if (asprintf(&c, "%s/.cache", home) < 0) {
+                return NULL;
+        }
+        return c;
+}
+
 /**
  * Just use .local/share/Steam at this point..
  */
@@ -111,38 +609,13 @@ char *lsi_get_steam_dir()
                 return NULL;
         }
 
-        resolv = realpath(candidate, NULL);
+        resolv = lsi_file_realpath(candidate);
         if (!resolv || !lsi_file_exists(resolv)) {
                 return lsi_get_fallback_steam_dir(homedir);
         }
         return strdup(resolv);
 }
 
-char *lsi_get_process_name(void)
-{
-        char *realp = NULL;
-
-        realp = realpath("/proc/self/exe", NULL);
-        if (!realp) {
-                return NULL;
-        }
-        return realp;
-}
-
-char *lsi_get_process_base_name(void)
-{
-        autofree(char) *p = NULL;
-        char *basep = NULL;
-
-        p = lsi_get_process_name();
-        if (!p) {
-                return NULL;
-        }
-
-        basep = basename(p);
-        return strdup(basep);
-}
-
 /**
  * Quickly determine if a string is numeric..
  */
@@ -163,6 +636,26 @@ static inline bool lsi_is_string_numeric(char *p)
         return true;
 }
 
+uint32_t lsi_get_steam_app_id(void)
+{
+        const char *vars[] = { "SteamAppId", "SteamGameId" };
+
+        for (size_t i = 0; i < ARRAY_SIZE(vars); i++) {
+                char *value = getenv(vars[i]);
+                unsigned long id;
+
+                /* SteamGameId may also hold a 64-bit shortcut ID, skip those */
+                if (!value || !lsi_is_string_numeric(value)) {
+                        continue;
+                }
+                id = strtoul(value, NULL, 10);
+                if (id > 0 && id <= UINT32_MAX) {
+                        return (uint32_t)id;
+                }
+        }
+        return 0;
+}
+
 char **lsi_get_steam_paths(void)
 {
         autofree(char) *steam_root = NULL;
@@ -14,6 +14,7 @@
 #define _GNU_SOURCE
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /**
@@ -26,6 +27,11 @@ const char *lsi_get_home_dir(void);
  */
 char *lsi_get_user_config_dir(void);
 
+/**
+ * Determine the home cache directory
+ */
+char *lsi_get_user_cache_dir(void);
+
 /**
  * Find out where Steam is installed
  */
@@ -37,19 +43,76 @@ char *lsi_get_steam_dir(void);
 char **lsi_get_steam_paths(void);
 
 /**
- * Quick helper to determine if the path exists
+ * Return the Steam application ID of this process, from SteamAppId or
+ * SteamGameId, or 0 if it isn't running as part of a Steam app.
+ */
+uint32_t lsi_get_steam_app_id(void);
+
+/**
+ * Quick helper to determine if the path exists (without following a final
+ * symlink), answered from the metadata cache where possible
  */
 bool lsi_file_exists(const char *path);
 
 /**
- * Return the full process name
+ * realpath() answered from the metadata cache where possible
+ *
+ * @returns A newly allocated canonical path, or NULL if it can't be resolved
+ */
+char *lsi_file_realpath(const char *path);
+
+/**
+ * The parts of an ELF header that decide whether ld.so can load a file
+ * into this process at all
+ */
+typedef struct LsiElfIdent {
+        uint8_t elf_class; /**<ELFCLASS32 or ELFCLASS64 */
+        uint16_t machine;  /**<EM_* value, in host byte order */
+} LsiElfIdent;
+
+/**
+ * Read just the ELF identification and e_machine of @path, following
+ * symlinks, answered from the metadata cache where possible
+ *
+ * @returns False if @path isn't a readable ELF file
+ */
+bool lsi_file_elf_ident(const char *path, LsiElfIdent *ident);
+
+/**
+ * Absolute paths given to lsi_file_exists(), lsi_file_realpath() and
+ * lsi_file_elf_ident() are remembered, both positive and negative answers,
+ * in a fixed size table shared by every module. Relative paths always go to
+ * the filesystem.
+ *
+ * By default entries live until the process exits, which suits the short
+ * lived tools. Long running processes should enable LSI_FILE_CACHE_WATCH,
+ * which only keeps answers for directories that inotify can watch and drops
+ * everything whenever one of them changes. The inotify instance is only
+ * opened once the first answer is cached, and instances are a scarce per-user
+ * resource, so only one module in a process should ask for it.
+ */
+#define LSI_FILE_CACHE_SLOTS 1024
+
+/**
+ * Upper bound on directories watched for invalidation
+ */
+#define LSI_FILE_CACHE_MAX_WATCHES 256
+
+typedef enum {
+        LSI_FILE_CACHE_DEFAULT = 0,
+        LSI_FILE_CACHE_WATCH = 1 << 0,  /**<Invalidate via inotify */
+        LSI_FILE_CACHE_DISABLE = 1 << 1, /**<Always go to the filesystem */
+} LsiFileCacheFlags;
+
+/**
+ * Configure the metadata cache, before first use
  */
-char *lsi_get_process_name(void);
+void lsi_file_cache_init(unsigned int flags);
 
 /**
- * Determine the basename'd process
+ * Forget every cached answer, i.e. after changing the filesystem ourselves
  */
-char *lsi_get_process_base_name(void);
+void lsi_file_cache_invalidate(void);
 
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
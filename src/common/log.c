@@ -11,97 +11,351 @@
 
 #define _GNU_SOURCE
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "common.h"
 #include "log.h"
-#include "nica/util.h"
+
+typedef enum {
+        LSI_LOG_DEBUG = 0,
+        LSI_LOG_INFO,
+        LSI_LOG_WARN,
+        LSI_LOG_ERROR,
+} LsiLogLevel;
+
+/**
+ * A single formatted message. Slots are reused every LSI_LOG_SLOTS tickets:
+ * the sequence is the start of the lap when the slot is free for a ticket in
+ * that lap, and one past it once the message is complete.
+ */
+typedef struct LsiLogSlot {
+        atomic_uint sequence;
+        LsiLogLevel level;
+        const char *id;
+        char text[LSI_LOG_LINE];
+} LsiLogSlot;
+
+typedef struct LsiLogRing {
+        atomic_uint head; /**<Next ticket to hand out */
+        atomic_uint tail; /**<Next ticket to write out, only moved while flushing */
+        atomic_flag flushing;
+        LsiLogSlot slots[LSI_LOG_SLOTS];
+} LsiLogRing;
+
+typedef enum {
+        LSI_LOG_UNINIT = 0,
+        LSI_LOG_LOADING,
+        LSI_LOG_READY,
+} LsiLogState;
+
+/* Starts out non-zero so the first lsi_log_debug gets to look at LSI_DEBUG */
+atomic_int lsi_log_debug_state = -1;
 
 static const char *_log_id = "__init__";
 
+static atomic_int log_state = LSI_LOG_UNINIT;
+static LsiLogRing *log_ring = NULL;
+
+/* Once we're shutting down nobody else will flush, so write immediately */
+static atomic_bool log_sync = false;
+
+static const char *log_dir = NULL;
+static int log_fd = -1;
+static pid_t log_fd_pid = 0;
+
 void lsi_log_set_id(const char *id)
 {
         _log_id = id;
 }
 
-void lsi_log_debug(const char *format, ...)
+/**
+ * Resolve the configuration and map the ring, exactly once
+ */
+static LsiLogRing *lsi_log_ring(void)
 {
-        if (!getenv("LSI_DEBUG")) {
-                return;
+        int expected = LSI_LOG_UNINIT;
+        void *map = NULL;
+
+        if (atomic_load_explicit(&log_state, memory_order_acquire) == LSI_LOG_READY) {
+                return log_ring;
+        }
+        if (!atomic_compare_exchange_strong(&log_state, &expected, LSI_LOG_LOADING)) {
+                while (atomic_load_explicit(&log_state, memory_order_acquire) != LSI_LOG_READY) {
+                        sched_yield();
+                }
+                return log_ring;
         }
 
-        autofree(char) *p = NULL;
-        va_list va;
-        va_start(va, format);
+        atomic_store(&lsi_log_debug_state, getenv("LSI_DEBUG") ? 1 : 0);
+        log_dir = getenv("LSI_LOG_DIR");
+        if (log_dir && !*log_dir) {
+                log_dir = NULL;
+        }
 
-        if (!vasprintf(&p, format, va)) {
-                /* At least print *something */
-                fprintf(stderr, "%s\n", format);
-                goto end;
+        map = mmap(NULL,
+                   sizeof(LsiLogRing),
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1,
+                   0);
+        if (map != MAP_FAILED) {
+                /* Children start empty, the parent writes out what it logged. When the
+                 * kernel can't do that, flushing before fork() is the next best thing,
+                 * though that won't see forks from another namespace's libc.
+                 */
+                if (madvise(map, sizeof(LsiLogRing), MADV_WIPEONFORK) != 0) {
+                        pthread_atfork(lsi_log_flush, NULL, NULL);
+                }
+                log_ring = map;
         }
 
-        fprintf(stderr, "\033[32;1m[lsi:%s]\033[0m %s\n", _log_id, p);
+        atomic_store_explicit(&log_state, LSI_LOG_READY, memory_order_release);
+        return log_ring;
+}
 
-end:
-        va_end(va);
+/**
+ * Where output goes, opening the per-process log file if there is one
+ */
+static int lsi_log_fd(void)
+{
+        char *path = NULL;
+        pid_t pid;
+
+        if (!log_dir) {
+                return STDERR_FILENO;
+        }
+
+        pid = getpid();
+        if (log_fd >= 0 && log_fd_pid == pid) {
+                return log_fd;
+        }
+        if (log_fd >= 0) {
+                close(log_fd);
+        }
+        log_fd = -1;
+        log_fd_pid = pid;
+        if (asprintf(&path, "%s/lsi-%d.log", log_dir, (int)pid) >= 0) {
+                log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 00644);
+                free(path);
+        }
+        return log_fd >= 0 ? log_fd : STDERR_FILENO;
 }
 
-void lsi_log_info(const char *format, ...)
+static void lsi_log_write(int fd, const char *buf, size_t len)
 {
-        autofree(char) *p = NULL;
-        va_list va;
-        va_start(va, format);
+        while (len > 0) {
+                ssize_t n = write(fd, buf, len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return;
+                }
+                buf += n;
+                len -= (size_t)n;
+        }
+}
+
+/**
+ * Format a complete output line into @buf
+ *
+ * @returns The length of the line, which may have been truncated
+ */
+static size_t lsi_log_line(char *buf, size_t size, bool colors, LsiLogLevel level,
+                           const char *id, const char *text)
+{
+        static const char *colors_for[] = {
+                [LSI_LOG_DEBUG] = "32",
+                [LSI_LOG_INFO] = "34",
+                [LSI_LOG_WARN] = "33",
+                [LSI_LOG_ERROR] = "31",
+        };
+        int len;
 
-        if (!vasprintf(&p, format, va)) {
-                /* At least print *something */
-                fprintf(stderr, "%s\n", format);
-                goto end;
+        if (colors) {
+                len = snprintf(buf,
+                               size,
+                               "\033[%s;1m[lsi:%s]\033[0m %s\n",
+                               colors_for[level],
+                               id,
+                               text);
+        } else {
+                len = snprintf(buf, size, "[lsi:%s] %s\n", id, text);
         }
+        if (len < 0) {
+                return 0;
+        }
+        if ((size_t)len >= size) {
+                /* Keep the line break on truncated lines */
+                buf[size - 2] = '\n';
+                return size - 1;
+        }
+        return (size_t)len;
+}
 
-        fprintf(stderr, "\033[34;1m[lsi:%s]\033[0m %s\n", _log_id, p);
+void lsi_log_flush(void)
+{
+        LsiLogRing *ring = log_ring;
+        char buf[8192];
+        size_t n = 0;
+        unsigned int tail;
+        bool colors;
+        int fd;
 
-end:
-        va_end(va);
+        if (!ring || atomic_load_explicit(&ring->tail, memory_order_relaxed) ==
+                         atomic_load_explicit(&ring->head, memory_order_relaxed)) {
+                return;
+        }
+        if (atomic_flag_test_and_set_explicit(&ring->flushing, memory_order_acquire)) {
+                return;
+        }
+
+        fd = lsi_log_fd();
+        colors = fd == STDERR_FILENO;
+
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        for (;;) {
+                LsiLogSlot *slot = &ring->slots[tail % LSI_LOG_SLOTS];
+                unsigned int lap = tail - tail % LSI_LOG_SLOTS;
+
+                /* Stop at the first message still being written */
+                if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != lap + 1) {
+                        break;
+                }
+                if (sizeof(buf) - n < LSI_LOG_LINE + 64) {
+                        lsi_log_write(fd, buf, n);
+                        n = 0;
+                }
+                n += lsi_log_line(buf + n,
+                                  sizeof(buf) - n,
+                                  colors,
+                                  slot->level,
+                                  slot->id,
+                                  slot->text);
+
+                /* Hand the slot over to the next lap */
+                atomic_store_explicit(&slot->sequence, lap + LSI_LOG_SLOTS, memory_order_release);
+                ++tail;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_relaxed);
+        lsi_log_write(fd, buf, n);
+
+        atomic_flag_clear_explicit(&ring->flushing, memory_order_release);
 }
 
-void lsi_log_warn(const char *format, ...)
+/**
+ * Queue a message, writing it out straight away when we can't queue
+ */
+static void lsi_log_emit(LsiLogLevel level, const char *format, va_list va)
 {
-        autofree(char) *p = NULL;
-        va_list va;
-        va_start(va, format);
+        LsiLogRing *ring = lsi_log_ring();
+        LsiLogSlot *slot = NULL;
+        unsigned int ticket;
+        unsigned int lap;
+
+        if (!ring || atomic_load_explicit(&log_sync, memory_order_relaxed)) {
+                char text[LSI_LOG_LINE];
+                char line[LSI_LOG_LINE + 64];
+                int fd;
 
-        if (!vasprintf(&p, format, va)) {
-                /* At least print *something */
-                fprintf(stderr, "%s\n", format);
-                goto end;
+                vsnprintf(text, sizeof(text), format, va);
+                lsi_log_flush();
+                fd = lsi_log_fd();
+                lsi_log_write(fd,
+                              line,
+                              lsi_log_line(line,
+                                           sizeof(line),
+                                           fd == STDERR_FILENO,
+                                           level,
+                                           _log_id,
+                                           text));
+                return;
         }
 
-        fprintf(stderr, "\033[33;1m[lsi:%s]\033[0m %s\n", _log_id, p);
+        ticket = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+        slot = &ring->slots[ticket % LSI_LOG_SLOTS];
+        lap = ticket - ticket % LSI_LOG_SLOTS;
+
+        /* Ring is full, make room */
+        while (atomic_load_explicit(&slot->sequence, memory_order_acquire) != lap) {
+                lsi_log_flush();
+                sched_yield();
+        }
 
-end:
+        vsnprintf(slot->text, sizeof(slot->text), format, va);
+        slot->level = level;
+        slot->id = _log_id;
+        atomic_store_explicit(&slot->sequence, lap + 1, memory_order_release);
+
+        /* Problems should be seen promptly, and don't let producers stall */
+        if (level >= LSI_LOG_WARN ||
+            ticket - atomic_load_explicit(&ring->tail, memory_order_relaxed) >= LSI_LOG_SLOTS / 2) {
+                lsi_log_flush();
+        }
+}
+
+void lsi_log_debug_emit(const char *format, ...)
+{
+        va_list va;
+
+        lsi_log_ring();
+        if (!atomic_load_explicit(&lsi_log_debug_state, memory_order_relaxed)) {
+                return;
+        }
+
+        va_start(va, format);
+        lsi_log_emit(LSI_LOG_DEBUG, format, va);
         va_end(va);
 }
 
-void lsi_log_error(const char *format, ...)
+void lsi_log_info(const char *format, ...)
 {
-        autofree(char) *p = NULL;
         va_list va;
+
         va_start(va, format);
+        lsi_log_emit(LSI_LOG_INFO, format, va);
+        va_end(va);
+}
 
-        if (!vasprintf(&p, format, va)) {
-                /* At least print *something */
-                fprintf(stderr, "%s\n", format);
-                goto end;
-        }
+void lsi_log_warn(const char *format, ...)
+{
+        va_list va;
+
+        va_start(va, format);
+        lsi_log_emit(LSI_LOG_WARN, format, va);
+        va_end(va);
+}
 
-        fprintf(stderr, "\033[31;1m[lsi:%s]\033[0m %s\n", _log_id, p);
+void lsi_log_error(const char *format, ...)
+{
+        va_list va;
 
-end:
+        va_start(va, format);
+        lsi_log_emit(LSI_LOG_ERROR, format, va);
         va_end(va);
 }
 
+/**
+ * Write out whatever is left. Destructors running after us may still log, so
+ * from here on everything is written immediately.
+ */
+__attribute__((destructor)) static void lsi_log_shutdown(void)
+{
+        atomic_store(&log_sync, true);
+        lsi_log_flush();
+}
+
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -13,17 +13,44 @@
 
 #define _GNU_SOURCE
 
+#include <stdatomic.h>
 #include <stdlib.h>
 
+/**
+ * Messages are formatted into a fixed ring without allocating and written
+ * out in batches: when the ring fills up, on warnings and errors, at exit,
+ * before fork() and wherever lsi_log_flush is called. Output goes to stderr,
+ * or to $LSI_LOG_DIR/lsi-$pid.log when set.
+ */
+#define LSI_LOG_SLOTS 128
+#define LSI_LOG_LINE 512
+
+/**
+ * Non-zero while debug output might be wanted. LSI_DEBUG is only consulted
+ * on first use, after which disabled debug logging is a single branch.
+ */
+extern atomic_int lsi_log_debug_state;
+
 /**
  * Set the ID used in all log output
  */
 void lsi_log_set_id(const char *id);
 
 /**
- * Emit some debug information if LSI_DEBUG is set
+ * Emit some debug information if LSI_DEBUG is set. Arguments aren't
+ * evaluated when it isn't.
  */
-void lsi_log_debug(const char *format, ...) __attribute__((format(printf, 1, 2)));
+#define lsi_log_debug(...)                                                                         \
+        do {                                                                                       \
+                if (atomic_load_explicit(&lsi_log_debug_state, memory_order_relaxed)) {            \
+                        lsi_log_debug_emit(__VA_ARGS__);                                           \
+                }                                                                                  \
+        } while (0)
+
+/**
+ * Backend for lsi_log_debug, use that instead
+ */
+void lsi_log_debug_emit(const char *format, ...) __attribute__((format(printf, 1, 2)));
 
 /**
  * Emit information, always shown
@@ -40,6 +67,12 @@ void lsi_log_warn(const char *format, ...) __attribute__((format(printf, 1, 2)))
  */
 void lsi_log_error(const char *format, ...) __attribute__((format(printf, 1, 2)));
 
+/**
+ * Write out everything logged so far, i.e. before exec() replaces us
+ */
+void lsi_log_flush(void);
+
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -0,0 +1,160 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/auxv.h>
+
+#include "files.h"
+#include "process.h"
+
+typedef enum {
+        LSI_PROCESS_UNINIT = 0,
+        LSI_PROCESS_LOADING,
+        LSI_PROCESS_READY,
+} LsiProcessState;
+
+static atomic_int name_state = LSI_PROCESS_UNINIT;
+static const char *process_name = NULL;
+static uint32_t process_name_hash = 0;
+
+static atomic_int path_state = LSI_PROCESS_UNINIT;
+static const char *process_path = NULL;
+static uint32_t process_path_hash = 0;
+
+uint32_t lsi_process_hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = s; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+/**
+ * Returns true if the caller won the right to initialise @state, otherwise
+ * waits until whoever did has finished.
+ */
+static bool lsi_process_begin(atomic_int *state)
+{
+        int expected = LSI_PROCESS_UNINIT;
+
+        if (atomic_load_explicit(state, memory_order_acquire) == LSI_PROCESS_READY) {
+                return false;
+        }
+        if (atomic_compare_exchange_strong(state, &expected, LSI_PROCESS_LOADING)) {
+                return true;
+        }
+        while (atomic_load_explicit(state, memory_order_acquire) != LSI_PROCESS_READY) {
+                sched_yield();
+        }
+        return false;
+}
+
+static inline void lsi_process_end(atomic_int *state)
+{
+        atomic_store_explicit(state, LSI_PROCESS_READY, memory_order_release);
+}
+
+static inline const char *lsi_process_base(const char *path)
+{
+        const char *slash = strrchr(path, '/');
+
+        return slash ? slash + 1 : path;
+}
+
+const char *lsi_process_path(void)
+{
+        if (!lsi_process_begin(&path_state)) {
+                return process_path;
+        }
+
+        /* Never freed, it lives as long as we do */
+        process_path = lsi_file_realpath("/proc/self/exe");
+        if (process_path) {
+                process_path_hash = lsi_process_hash(process_path);
+        }
+        lsi_process_end(&path_state);
+        return process_path;
+}
+
+const char *lsi_process_execfn(void)
+{
+        /* The kernel keeps this string on the initial stack for our lifetime */
+        return (const char *)getauxval(AT_EXECFN);
+}
+
+const char *lsi_process_name(void)
+{
+        const char *execfn = NULL;
+        const char *name = NULL;
+
+        if (!lsi_process_begin(&name_state)) {
+                return process_name;
+        }
+
+        execfn = lsi_process_execfn();
+        if (execfn) {
+                name = lsi_process_base(execfn);
+        }
+
+        /* For scripts AT_EXECFN is the script, whereas argv[0] is the interpreter */
+        if (!name || !*name || !program_invocation_short_name ||
+            strcmp(name, program_invocation_short_name) != 0) {
+                name = lsi_process_path();
+                if (name) {
+                        name = lsi_process_base(name);
+                }
+        }
+
+        if (name) {
+                process_name = name;
+                process_name_hash = lsi_process_hash(name);
+        }
+        lsi_process_end(&name_state);
+        return process_name;
+}
+
+bool lsi_process_has_name(const char *name)
+{
+        if (!lsi_process_name()) {
+                return false;
+        }
+        return process_name_hash == lsi_process_hash(name) && strcmp(process_name, name) == 0;
+}
+
+bool lsi_process_has_path(const char *path)
+{
+        if (!lsi_process_path()) {
+                return false;
+        }
+        return process_path_hash == lsi_process_hash(path) && strcmp(process_path, path) == 0;
+}
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
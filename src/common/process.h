@@ -0,0 +1,75 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Hash used for process identity comparisons
+ */
+uint32_t lsi_process_hash(const char *s);
+
+/**
+ * Return the base name of the running executable, as it was executed.
+ *
+ * This comes straight from the auxiliary vector without any system calls,
+ * unless argv[0] disagrees with it (i.e. a script interpreter) in which case
+ * we fall back to resolving /proc/self/exe. Symlinked executables therefore
+ * keep the name they were run as, just as /proc/self/comm does.
+ *
+ * @returns A string valid for the process lifetime, or NULL if unknown
+ */
+const char *lsi_process_name(void);
+
+/**
+ * Return the canonical path of the running executable, resolving it on the
+ * first call only.
+ *
+ * @returns A string valid for the process lifetime, or NULL if unknown
+ */
+const char *lsi_process_path(void);
+
+/**
+ * Return the path the program was executed as. For scripts this is the
+ * script itself rather than its interpreter.
+ *
+ * @returns A string valid for the process lifetime, or NULL if unknown
+ */
+const char *lsi_process_execfn(void);
+
+/**
+ * Determine if the executable has the base name @name. This never touches
+ * the filesystem, so use it to rule processes out before lsi_process_has_path
+ */
+bool lsi_process_has_name(const char *name);
+
+/**
+ * Determine if the executable's canonical path is @path
+ */
+bool lsi_process_has_path(const char *path);
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
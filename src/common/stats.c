@@ -0,0 +1,211 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "log.h"
+#include "stats.h"
+
+LsiStatsSegment *lsi_stats = NULL;
+
+static inline bool lsi_stats_pid_alive(pid_t pid)
+{
+        return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+bool lsi_stats_session_alive(const LsiStatsSegment *segment)
+{
+        return lsi_stats_pid_alive((pid_t)segment->session);
+}
+
+/**
+ * Unlink segments whose session has ended, as nothing else will
+ */
+static void lsi_stats_reap(void)
+{
+        const size_t prefix_len = strlen(LSI_STATS_PREFIX);
+        struct dirent *ent = NULL;
+        DIR *dir = NULL;
+
+        dir = opendir(LSI_STATS_DIR);
+        if (!dir) {
+                return;
+        }
+        while ((ent = readdir(dir)) != NULL) {
+                char *end = NULL;
+                long pid;
+
+                if (strncmp(ent->d_name, LSI_STATS_PREFIX, prefix_len) != 0) {
+                        continue;
+                }
+                pid = strtol(ent->d_name + prefix_len, &end, 10);
+                if (*end || pid <= 0 || lsi_stats_pid_alive((pid_t)pid)) {
+                        continue;
+                }
+                (void)unlinkat(dirfd(dir), ent->d_name, 0);
+        }
+        closedir(dir);
+}
+
+bool lsi_stats_create(void)
+{
+        char path[PATH_MAX];
+        LsiStatsSegment *segment = NULL;
+        bool ret = false;
+        int fd = -1;
+
+        lsi_stats_reap();
+
+        if (snprintf(path, sizeof(path), "%s/%s%d", LSI_STATS_DIR, LSI_STATS_PREFIX, getpid()) <
+            0) {
+                return false;
+        }
+
+        /* Never adopt a file somebody else left under our name, a stale one
+         * from a recycled pid is replaced, anything we can't unlink isn't */
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 00600);
+        if (fd < 0 && errno == EEXIST && unlink(path) == 0) {
+                fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 00600);
+        }
+        if (fd < 0) {
+                lsi_log_debug("stats: unable to create %s: %s", path, strerror(errno));
+                return false;
+        }
+        if (ftruncate(fd, sizeof(LsiStatsSegment)) != 0) {
+                goto end;
+        }
+        segment = mmap(NULL, sizeof(LsiStatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (segment == MAP_FAILED) {
+                goto end;
+        }
+
+        segment->version = LSI_STATS_VERSION;
+        segment->n_counters = LSI_STAT_MAX;
+        segment->session = (int32_t)getpid();
+        segment->created = (int64_t)time(NULL);
+        /* Written last, readers ignore the segment until it's complete */
+        atomic_thread_fence(memory_order_release);
+        segment->magic = LSI_STATS_MAGIC;
+        munmap(segment, sizeof(LsiStatsSegment));
+
+        setenv(LSI_STATS_ENV, path, 1);
+        ret = true;
+
+end:
+        if (!ret) {
+                unlink(path);
+        }
+        close(fd);
+        return ret;
+}
+
+/**
+ * Map the segment at @path, if it really is one we understand
+ */
+static LsiStatsSegment *lsi_stats_map(const char *path, bool writable)
+{
+        struct stat st = { 0 };
+        LsiStatsSegment *segment = NULL;
+        int fd;
+
+        fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+                return NULL;
+        }
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LsiStatsSegment)) {
+                close(fd);
+                return NULL;
+        }
+        segment = mmap(NULL,
+                       sizeof(LsiStatsSegment),
+                       writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                       MAP_SHARED,
+                       fd,
+                       0);
+        close(fd);
+        if (segment == MAP_FAILED) {
+                return NULL;
+        }
+
+        if (segment->magic != LSI_STATS_MAGIC || segment->version != LSI_STATS_VERSION ||
+            segment->n_counters != LSI_STAT_MAX) {
+                munmap(segment, sizeof(LsiStatsSegment));
+                return NULL;
+        }
+        return segment;
+}
+
+void lsi_stats_attach(void)
+{
+        const char *path = getenv(LSI_STATS_ENV);
+
+        if (lsi_stats || !path || !*path) {
+                return;
+        }
+        lsi_stats = lsi_stats_map(path, true);
+        lsi_stats_add(LSI_STAT_MODULES, 1);
+}
+
+const LsiStatsSegment *lsi_stats_open(const char *path)
+{
+        return lsi_stats_map(path, false);
+}
+
+void lsi_stats_close(const LsiStatsSegment *segment)
+{
+        munmap((void *)segment, sizeof(LsiStatsSegment));
+}
+
+const char *lsi_stats_describe(LsiStat stat)
+{
+        static const char *descriptions[] = {
+                [LSI_STAT_MODULES] = "modules attached",
+                [LSI_STAT_LOOKUPS] = "library lookups",
+                [LSI_STAT_CACHE_HITS] = "cache hits",
+                [LSI_STAT_BLACKLISTED] = "blacklisted loads",
+                [LSI_STAT_TRANSMUTED] = "transmuted sonames",
+                [LSI_STAT_HOST_REPLACED] = "host replacements",
+                [LSI_STAT_REDIRECTED] = "redirected opens",
+                [LSI_STAT_HOOK_NS] = "time in hooks",
+        };
+
+        if ((size_t)stat >= ARRAY_SIZE(descriptions)) {
+                return "unknown";
+        }
+        return descriptions[stat];
+}
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,148 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "config.h"
+
+/**
+ * Session statistics live in a small shared memory segment created by the
+ * shim before launching Steam. Its path is exported in the environment so the
+ * modules in every process of the session count into the same place.
+ */
+#define LSI_STATS_ENV "LSI_STATS"
+#define LSI_STATS_DIR "/dev/shm"
+
+#ifdef HAVE_SNAPD_SUPPORT
+/* Confinement only permits segments carrying the snap's own prefix */
+#define LSI_STATS_PREFIX "snap.linux-steam-integration.lsi-stats-"
+#else
+#define LSI_STATS_PREFIX "lsi-stats-"
+#endif
+
+#define LSI_STATS_MAGIC 0x5349534cu /* "LSIS" */
+#define LSI_STATS_VERSION 1
+
+typedef enum {
+        LSI_STAT_MODULES = 0,   /**<Module instances attached to the session */
+        LSI_STAT_LOOKUPS,       /**<la_objsearch requests */
+        LSI_STAT_CACHE_HITS,    /**<Requests answered from a decision cache */
+        LSI_STAT_BLACKLISTED,   /**<Library loads refused */
+        LSI_STAT_TRANSMUTED,    /**<Sonames rewritten to another soname */
+        LSI_STAT_HOST_REPLACED, /**<Libraries swapped for a path on the host */
+        LSI_STAT_REDIRECTED,    /**<Files opened from a redirected path */
+        LSI_STAT_HOOK_NS,       /**<Nanoseconds spent deciding in our hooks */
+        LSI_STAT_MAX,
+} LsiStat;
+
+/**
+ * Every counter gets a cache line to itself, so processes bumping different
+ * counters never contend.
+ */
+typedef struct LsiStatsCounter {
+        alignas(64) _Atomic uint64_t value;
+} LsiStatsCounter;
+
+/**
+ * 32-bit and 64-bit processes share the segment, so everything here has a
+ * fixed size and explicit alignment.
+ */
+typedef struct LsiStatsSegment {
+        alignas(64) uint32_t magic;
+        uint32_t version;
+        uint32_t n_counters;
+        int32_t session; /**<pid of the shim that created the segment */
+        int64_t created; /**<Creation time, in seconds since the epoch */
+        LsiStatsCounter counters[LSI_STAT_MAX];
+} LsiStatsSegment;
+
+/**
+ * The attached segment, or NULL when this process isn't counting
+ */
+extern LsiStatsSegment *lsi_stats;
+
+/**
+ * Create the segment for a new session and export it to our children,
+ * clearing away segments left by sessions that have since ended.
+ */
+bool lsi_stats_create(void);
+
+/**
+ * Attach to the session segment named in the environment, if any
+ */
+void lsi_stats_attach(void);
+
+/**
+ * Map an existing segment read-only, i.e. to display it
+ *
+ * @returns The segment, to be released with lsi_stats_close, or NULL
+ */
+const LsiStatsSegment *lsi_stats_open(const char *path);
+
+/**
+ * Release a segment returned by lsi_stats_open
+ */
+void lsi_stats_close(const LsiStatsSegment *segment);
+
+/**
+ * Determine whether the session owning @segment is still running
+ */
+bool lsi_stats_session_alive(const LsiStatsSegment *segment);
+
+/**
+ * Human readable description of a counter
+ */
+const char *lsi_stats_describe(LsiStat stat);
+
+/**
+ * Monotonic timestamp in nanoseconds, for LSI_STAT_HOOK_NS
+ */
+static inline uint64_t lsi_stats_now(void)
+{
+        struct timespec ts = { 0 };
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Bump a counter, costing nothing more than a branch when detached
+ */
+static inline void lsi_stats_add(LsiStat stat, uint64_t n)
+{
+        if (lsi_stats) {
+                atomic_fetch_add_explicit(&lsi_stats->counters[stat].value,
+                                          n,
+                                          memory_order_relaxed);
+        }
+}
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -27,6 +27,8 @@ struct _LsiSettingsWindow {
         /* Only when libintercept is enabled will we have this option */
 #ifdef HAVE_LIBINTERCEPT
         GtkWidget *check_intercept;
+        GtkWidget *check_intercept_upgrades;
+        GtkWidget *check_hybrid;
 #endif
 
         /* Only when libredirect is enabled will we have this option */
@@ -35,6 +37,11 @@ struct _LsiSettingsWindow {
         GtkWidget *check_unity_hack;
 #endif
 
+        /* Only with both libraries can one stand in for the other */
+#if defined(HAVE_LIBINTERCEPT) && defined(HAVE_LIBREDIRECT)
+        GtkWidget *check_intercept_preload;
+#endif
+
         /* Always have these guys */
         GtkWidget *check_native;
         GtkWidget *check_emul32;
@@ -220,6 +227,25 @@ static void lsi_settings_window_init(LsiSettingsWindow *self)
             _("Force Steam applications to use more native libraries to maximise compatibility."));
         set_row_sensitive(self->check_intercept, FALSE);
         gtk_switch_set_active(GTK_SWITCH(self->check_intercept), self->config.use_libintercept);
+
+        self->check_intercept_upgrades =
+            insert_grid_toggle(grid,
+                               &row,
+                               _("Replace outdated game libraries"),
+                               _("Use faster system builds of libraries such as libpng and "
+                                 "libvorbis when they are fully compatible."));
+        set_row_sensitive(self->check_intercept_upgrades, FALSE);
+        gtk_switch_set_active(GTK_SWITCH(self->check_intercept_upgrades),
+                              self->config.use_intercept_upgrades);
+
+        self->check_hybrid =
+            insert_grid_toggle(grid,
+                               &row,
+                               _("Use system graphics libraries with the Steam runtime"),
+                               _("Keep the bundled Steam runtime, but use the system builds of "
+                                 "Mesa, Vulkan, SDL2, OpenAL and X11."));
+        set_row_sensitive(self->check_hybrid, FALSE);
+        gtk_switch_set_active(GTK_SWITCH(self->check_hybrid), self->config.use_hybrid_runtime);
 #endif
 
 #ifdef HAVE_LIBREDIRECT
@@ -241,6 +267,18 @@ static void lsi_settings_window_init(LsiSettingsWindow *self)
         gtk_switch_set_active(GTK_SWITCH(self->check_unity_hack), self->config.use_unity_hack);
 #endif
 
+#if defined(HAVE_LIBINTERCEPT) && defined(HAVE_LIBREDIRECT)
+        self->check_intercept_preload =
+            insert_grid_toggle(grid,
+                               &row,
+                               _("Use the intercept library without auditing"),
+                               _("Start games faster by only intercepting libraries they load "
+                                 "at runtime. Some games may pick up their own libraries."));
+        set_row_sensitive(self->check_intercept_preload, FALSE);
+        gtk_switch_set_active(GTK_SWITCH(self->check_intercept_preload),
+                              self->config.use_intercept_preload);
+#endif
+
         /* Hook up our signals. Basically the "native runtime" option controls the two library
          * options, they must be used in conjunction.
          */
@@ -255,6 +293,14 @@ static void lsi_settings_window_init(LsiSettingsWindow *self)
                                  G_CALLBACK(lsi_native_swapped),
                                  self);
 
+#ifdef HAVE_LIBINTERCEPT
+        /* Upgrades, and running without auditing, depend on intercept */
+        g_signal_connect_swapped(self->check_intercept,
+                                 "notify::active",
+                                 G_CALLBACK(lsi_native_swapped),
+                                 self);
+#endif
+
         /* Ensure our properties are now in sync. */
         lsi_native_swapped(self, self->check_native);
 
@@ -376,6 +422,16 @@ static void lsi_native_swapped(LsiSettingsWindow *self, __lsi_unused__ gpointer
 
 #ifdef HAVE_LIBINTERCEPT
         set_row_sensitive(self->check_intercept, native_runtime);
+        set_row_sensitive(self->check_intercept_upgrades,
+                          native_runtime &&
+                              gtk_switch_get_active(GTK_SWITCH(self->check_intercept)));
+        set_row_sensitive(self->check_hybrid, !native_runtime);
+#endif
+
+#if defined(HAVE_LIBINTERCEPT) && defined(HAVE_LIBREDIRECT)
+        set_row_sensitive(self->check_intercept_preload,
+                          native_runtime && redirect &&
+                              gtk_switch_get_active(GTK_SWITCH(self->check_intercept)));
 #endif
 }
 
@@ -396,6 +452,14 @@ static gboolean lsi_window_closed(LsiSettingsWindow *self, __lsi_unused__ GdkEve
 
 #ifdef HAVE_LIBINTERCEPT
         self->config.use_libintercept = gtk_switch_get_active(GTK_SWITCH(self->check_intercept));
+        self->config.use_intercept_upgrades =
+            gtk_switch_get_active(GTK_SWITCH(self->check_intercept_upgrades));
+        self->config.use_hybrid_runtime = gtk_switch_get_active(GTK_SWITCH(self->check_hybrid));
+#endif
+
+#if defined(HAVE_LIBINTERCEPT) && defined(HAVE_LIBREDIRECT)
+        self->config.use_intercept_preload =
+            gtk_switch_get_active(GTK_SWITCH(self->check_intercept_preload));
 #endif
 
         /* Try to write new config */
@@ -0,0 +1,628 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "abi-check.h"
+#include "nica/files.h"
+#include "nica/util.h"
+
+/**
+ * Verdicts live at $XDG_CACHE_HOME/linux-steam-integration/abi-check.cache
+ * as fixed size records, appended by whichever process made them. Both ELF
+ * classes share the file as their files never share an inode.
+ */
+#define LSI_ABI_CACHE_DIR "linux-steam-integration"
+#define LSI_ABI_CACHE_FILE "abi-check.cache"
+
+/**
+ * Bump whenever the check itself changes, so old verdicts are ignored
+ */
+#define LSI_ABI_CHECK_VERSION 1
+
+/**
+ * Start over once the file reaches this many records
+ */
+#define LSI_ABI_CACHE_MAX 4096
+
+/**
+ * Identity of a single file, as of the check
+ */
+typedef struct LsiAbiFile {
+        uint64_t dev;
+        uint64_t ino;
+        int64_t mtime;
+        int64_t mtime_nsec;
+} LsiAbiFile;
+
+typedef struct LsiAbiVerdict {
+        LsiAbiFile vendored;
+        LsiAbiFile host;
+        uint32_t version;
+        uint32_t compatible;
+} LsiAbiVerdict;
+
+_Static_assert(sizeof(LsiAbiVerdict) == 72, "LsiAbiVerdict must be identical for both classes");
+
+/**
+ * The parts of a mapped shared library needed to compare exports
+ */
+typedef struct LsiElfImage {
+        void *map;
+        size_t size;
+        ElfW(Half) machine;
+        const ElfW(Sym) *syms;
+        size_t n_syms;
+        const char *strtab;
+        size_t strtab_size;
+        const ElfW(Half) *versym;   /**<NULL if unversioned */
+        const char **version_names; /**<Indexed by version, NULL for local and global */
+        size_t n_versions;
+} LsiElfImage;
+
+/**
+ * Exported symbols of the host library, hashed by name
+ */
+typedef struct LsiElfExports {
+        const LsiElfImage *image;
+        uint32_t *slots; /**<Symbol index + 1, 0 when empty */
+        size_t n_slots;
+} LsiElfExports;
+
+static LsiAbiVerdict *verdicts = NULL;
+static size_t n_verdicts = 0;
+static size_t verdicts_size = 0;
+static bool verdicts_loaded = false;
+
+/* Only held for table updates, never across the checks themselves */
+static atomic_flag verdicts_lock = ATOMIC_FLAG_INIT;
+
+static inline void lsi_abi_lock(void)
+{
+        while (atomic_flag_test_and_set_explicit(&verdicts_lock, memory_order_acquire)) {
+                sched_yield();
+        }
+}
+
+static inline void lsi_abi_unlock(void)
+{
+        atomic_flag_clear_explicit(&verdicts_lock, memory_order_release);
+}
+
+static char *lsi_abi_cache_path(void)
+{
+        autofree(char) *base = NULL;
+        char *c = NULL;
+
+        base = lsi_get_user_cache_dir();
+        if (!base) {
+                return NULL;
+        }
+        if (asprintf(&c, "%s/%s/%s", base, LSI_ABI_CACHE_DIR, LSI_ABI_CACHE_FILE) < 0) {
+                return NULL;
+        }
+        return c;
+}
+
+static bool lsi_abi_file_stat(const char *path, LsiAbiFile *file)
+{
+        struct stat st = { 0 };
+
+        if (stat(path, &st) != 0) {
+                return false;
+        }
+        file->dev = (uint64_t)st.st_dev;
+        file->ino = (uint64_t)st.st_ino;
+        file->mtime = (int64_t)st.st_mtim.tv_sec;
+        file->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+        return true;
+}
+
+static inline bool lsi_abi_file_equal(const LsiAbiFile *a, const LsiAbiFile *b)
+{
+        return a->dev == b->dev && a->ino == b->ino && a->mtime == b->mtime &&
+               a->mtime_nsec == b->mtime_nsec;
+}
+
+static bool lsi_abi_push(const LsiAbiVerdict *verdict)
+{
+        if (n_verdicts == verdicts_size) {
+                size_t new_size = verdicts_size ? verdicts_size * 2 : 32;
+                LsiAbiVerdict *v = realloc(verdicts, new_size * sizeof(LsiAbiVerdict));
+                if (!v) {
+                        return false;
+                }
+                verdicts = v;
+                verdicts_size = new_size;
+        }
+        verdicts[n_verdicts++] = *verdict;
+        return true;
+}
+
+/**
+ * Pull in the verdicts of previous processes, once. Called with the lock held.
+ */
+static void lsi_abi_cache_load(void)
+{
+        autofree(char) *path = NULL;
+        autofree(FILE) *fp = NULL;
+        LsiAbiVerdict verdict;
+
+        verdicts_loaded = true;
+        if (getenv("LSI_NO_CACHE")) {
+                return;
+        }
+        path = lsi_abi_cache_path();
+        if (!path) {
+                return;
+        }
+        fp = fopen(path, "re");
+        if (!fp) {
+                return;
+        }
+        while (fread(&verdict, sizeof(verdict), 1, fp) == 1) {
+                if (n_verdicts >= LSI_ABI_CACHE_MAX) {
+                        lsi_log_debug("abi check: verdict cache full, starting over");
+                        unlink(path);
+                        n_verdicts = 0;
+                        return;
+                }
+                if (verdict.version != LSI_ABI_CHECK_VERSION) {
+                        continue;
+                }
+                if (!lsi_abi_push(&verdict)) {
+                        return;
+                }
+        }
+}
+
+/**
+ * Append @verdict for later processes. Records are small enough for
+ * O_APPEND to keep concurrent writers from interleaving.
+ */
+static void lsi_abi_cache_append(const LsiAbiVerdict *verdict)
+{
+        autofree(char) *path = NULL;
+        autofree(char) *dir = NULL;
+        int fd = -1;
+
+        if (getenv("LSI_NO_CACHE")) {
+                return;
+        }
+        path = lsi_abi_cache_path();
+        if (!path) {
+                return;
+        }
+        dir = strdup(path);
+        if (!dir) {
+                return;
+        }
+        *strrchr(dir, '/') = '\0';
+        if (!lsi_file_exists(dir) && !nc_mkdir_p(dir, 00755)) {
+                return;
+        }
+
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 00644);
+        if (fd < 0) {
+                return;
+        }
+        if (write(fd, verdict, sizeof(*verdict)) != (ssize_t)sizeof(*verdict)) {
+                lsi_log_debug("abi check: failed to record verdict in %s", path);
+        }
+        close(fd);
+}
+
+static void lsi_elf_close(LsiElfImage *image)
+{
+        if (image->map) {
+                munmap(image->map, image->size);
+        }
+        free(image->version_names);
+        memset(image, 0, sizeof(*image));
+}
+
+static inline bool lsi_elf_range(const LsiElfImage *image, size_t offset, size_t size)
+{
+        return offset <= image->size && size <= image->size - offset;
+}
+
+/**
+ * Name every version defined by the library, for the versym table
+ */
+static bool lsi_elf_load_versions(LsiElfImage *image, const ElfW(Shdr) *verdef)
+{
+        size_t offset = verdef->sh_offset;
+        size_t max_index = 0;
+
+        /* Find the highest index first so the table can be sized */
+        for (ElfW(Word) i = 0; i < verdef->sh_info; i++) {
+                const ElfW(Verdef) *def = NULL;
+
+                if (!lsi_elf_range(image, offset, sizeof(ElfW(Verdef)))) {
+                        return false;
+                }
+                def = (const ElfW(Verdef) *)((const char *)image->map + offset);
+                if ((size_t)(def->vd_ndx & 0x7fff) > max_index) {
+                        max_index = def->vd_ndx & 0x7fff;
+                }
+                if (def->vd_next == 0) {
+                        break;
+                }
+                offset += def->vd_next;
+        }
+
+        image->n_versions = max_index + 1;
+        image->version_names = calloc(image->n_versions, sizeof(char *));
+        if (!image->version_names) {
+                return false;
+        }
+
+        offset = verdef->sh_offset;
+        for (ElfW(Word) i = 0; i < verdef->sh_info; i++) {
+                const ElfW(Verdef) *def = (const ElfW(Verdef) *)((const char *)image->map + offset);
+                const ElfW(Verdaux) *aux = NULL;
+                size_t aux_offset = offset + def->vd_aux;
+
+                /* The base definition names the library itself, not a version */
+                if (!(def->vd_flags & VER_FLG_BASE) && def->vd_cnt > 0 &&
+                    lsi_elf_range(image, aux_offset, sizeof(ElfW(Verdaux)))) {
+                        aux = (const ElfW(Verdaux) *)((const char *)image->map + aux_offset);
+                        if (aux->vda_name < image->strtab_size) {
+                                image->version_names[def->vd_ndx & 0x7fff] =
+                                    image->strtab + aux->vda_name;
+                        }
+                }
+                if (def->vd_next == 0) {
+                        break;
+                }
+                offset += def->vd_next;
+        }
+        return true;
+}
+
+/**
+ * Map @path and locate its dynamic symbol table through the section headers
+ */
+static bool lsi_elf_open(const char *path, LsiElfImage *image)
+{
+        const ElfW(Ehdr) *ehdr = NULL;
+        const ElfW(Shdr) *shdrs = NULL;
+        const ElfW(Shdr) *verdef = NULL;
+        size_t n_versym = 0;
+        struct stat st = { 0 };
+        int fd = -1;
+
+        memset(image, 0, sizeof(*image));
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return false;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ElfW(Ehdr))) {
+                close(fd);
+                return false;
+        }
+        image->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (image->map == MAP_FAILED) {
+                image->map = NULL;
+                return false;
+        }
+        image->size = (size_t)st.st_size;
+
+        ehdr = image->map;
+        if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+            ehdr->e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+            ehdr->e_type != ET_DYN || ehdr->e_shentsize != sizeof(ElfW(Shdr)) ||
+            !lsi_elf_range(image, ehdr->e_shoff, (size_t)ehdr->e_shnum * sizeof(ElfW(Shdr)))) {
+                goto bail;
+        }
+        image->machine = ehdr->e_machine;
+        shdrs = (const ElfW(Shdr) *)((const char *)image->map + ehdr->e_shoff);
+
+        for (ElfW(Half) i = 0; i < ehdr->e_shnum; i++) {
+                const ElfW(Shdr) *sh = &shdrs[i];
+
+                if (!lsi_elf_range(image, sh->sh_offset, sh->sh_size)) {
+                        continue;
+                }
+                switch (sh->sh_type) {
+                case SHT_DYNSYM:
+                        if (sh->sh_link >= ehdr->e_shnum ||
+                            !lsi_elf_range(image,
+                                           shdrs[sh->sh_link].sh_offset,
+                                           shdrs[sh->sh_link].sh_size)) {
+                                goto bail;
+                        }
+                        image->syms = (const ElfW(Sym) *)((const char *)image->map + sh->sh_offset);
+                        image->n_syms = sh->sh_size / sizeof(ElfW(Sym));
+                        image->strtab = (const char *)image->map + shdrs[sh->sh_link].sh_offset;
+                        image->strtab_size = shdrs[sh->sh_link].sh_size;
+                        break;
+                case SHT_GNU_versym:
+                        image->versym = (const ElfW(Half) *)((const char *)image->map +
+                                                             sh->sh_offset);
+                        n_versym = sh->sh_size / sizeof(ElfW(Half));
+                        break;
+                case SHT_GNU_verdef:
+                        verdef = sh;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        /* Everything is NUL terminated within the string table */
+        if (!image->syms || image->strtab_size == 0 ||
+            image->strtab[image->strtab_size - 1] != '\0') {
+                goto bail;
+        }
+        if (image->versym && n_versym < image->n_syms) {
+                goto bail;
+        }
+        if (verdef && !lsi_elf_load_versions(image, verdef)) {
+                goto bail;
+        }
+        return true;
+
+bail:
+        lsi_elf_close(image);
+        return false;
+}
+
+/**
+ * Fetch the name of symbol @index, or NULL if it can't be exported. The
+ * st_info and st_other encodings are identical for both classes.
+ */
+static const char *lsi_elf_export(const LsiElfImage *image, size_t index)
+{
+        const ElfW(Sym) *sym = &image->syms[index];
+        unsigned char bind = ELF64_ST_BIND(sym->st_info);
+        unsigned char type = ELF64_ST_TYPE(sym->st_info);
+        unsigned char vis = ELF64_ST_VISIBILITY(sym->st_other);
+
+        if (sym->st_shndx == SHN_UNDEF || sym->st_name == 0 ||
+            sym->st_name >= image->strtab_size) {
+                return NULL;
+        }
+        if (bind != STB_GLOBAL && bind != STB_WEAK && bind != STB_GNU_UNIQUE) {
+                return NULL;
+        }
+        if (type == STT_SECTION || type == STT_FILE) {
+                return NULL;
+        }
+        if (vis != STV_DEFAULT && vis != STV_PROTECTED) {
+                return NULL;
+        }
+        /* Version 0 is local to the library */
+        if (image->versym && (image->versym[index] & 0x7fff) == 0) {
+                return NULL;
+        }
+        return image->strtab + sym->st_name;
+}
+
+/**
+ * Name the version of symbol @index, or NULL if it isn't versioned
+ */
+static inline const char *lsi_elf_version(const LsiElfImage *image, size_t index)
+{
+        size_t version;
+
+        if (!image->versym || !image->version_names) {
+                return NULL;
+        }
+        version = image->versym[index] & 0x7fff;
+        if (version >= image->n_versions) {
+                return NULL;
+        }
+        return image->version_names[version];
+}
+
+static inline uint32_t lsi_elf_hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = s; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+static bool lsi_elf_exports_build(const LsiElfImage *image, LsiElfExports *exports)
+{
+        size_t n_slots = 64;
+
+        while (n_slots < image->n_syms * 2) {
+                n_slots *= 2;
+        }
+        exports->image = image;
+        exports->n_slots = n_slots;
+        exports->slots = calloc(n_slots, sizeof(uint32_t));
+        if (!exports->slots) {
+                return false;
+        }
+
+        for (size_t i = 0; i < image->n_syms; i++) {
+                const char *name = lsi_elf_export(image, i);
+                size_t slot;
+
+                if (!name) {
+                        continue;
+                }
+                slot = lsi_elf_hash(name) & (n_slots - 1);
+                while (exports->slots[slot]) {
+                        slot = (slot + 1) & (n_slots - 1);
+                }
+                exports->slots[slot] = (uint32_t)i + 1;
+        }
+        return true;
+}
+
+/**
+ * Find the host definition satisfying a reference to @name at @version,
+ * where an unversioned reference binds to the default definition
+ */
+static const ElfW(Sym) *lsi_elf_exports_find(const LsiElfExports *exports, const char *name,
+                                            const char *version)
+{
+        const LsiElfImage *image = exports->image;
+        size_t mask = exports->n_slots - 1;
+
+        for (size_t slot = lsi_elf_hash(name) & mask; exports->slots[slot];
+             slot = (slot + 1) & mask) {
+                size_t index = exports->slots[slot] - 1;
+                const char *host_version = NULL;
+
+                if (!streq(image->strtab + image->syms[index].st_name, name)) {
+                        continue;
+                }
+                host_version = lsi_elf_version(image, index);
+                if (!version) {
+                        if (image->versym && (image->versym[index] & 0x8000)) {
+                                continue;
+                        }
+                        return &image->syms[index];
+                }
+                if (host_version && streq(host_version, version)) {
+                        return &image->syms[index];
+                }
+        }
+        return NULL;
+}
+
+/**
+ * Inspect both libraries, the expensive part
+ */
+static bool lsi_abi_compare(const char *vendored, const char *host)
+{
+        LsiElfImage vendored_image = { 0 };
+        LsiElfImage host_image = { 0 };
+        LsiElfExports exports = { 0 };
+        size_t n_checked = 0;
+        bool ret = false;
+
+        if (!lsi_elf_open(vendored, &vendored_image)) {
+                lsi_log_debug("abi check: unable to inspect %s", vendored);
+                return false;
+        }
+        if (!lsi_elf_open(host, &host_image)) {
+                lsi_log_debug("abi check: unable to inspect %s", host);
+                goto end;
+        }
+        if (vendored_image.machine != host_image.machine) {
+                goto end;
+        }
+        if (!lsi_elf_exports_build(&host_image, &exports)) {
+                goto end;
+        }
+
+        for (size_t i = 0; i < vendored_image.n_syms; i++) {
+                const char *name = lsi_elf_export(&vendored_image, i);
+                const char *version = NULL;
+                const ElfW(Sym) *sym = NULL;
+                unsigned char type;
+
+                if (!name) {
+                        continue;
+                }
+                version = lsi_elf_version(&vendored_image, i);
+                sym = lsi_elf_exports_find(&exports, name, version);
+                if (!sym) {
+                        lsi_log_debug("abi check: %s lacks %s%s%s",
+                                      host,
+                                      name,
+                                      version ? "@" : "",
+                                      version ? version : "");
+                        goto end;
+                }
+
+                /* Copy relocations in the game were sized for the vendored objects */
+                type = ELF64_ST_TYPE(vendored_image.syms[i].st_info);
+                if ((type == STT_OBJECT || type == STT_TLS) &&
+                    sym->st_size != vendored_image.syms[i].st_size) {
+                        lsi_log_debug("abi check: %s changes the size of %s", host, name);
+                        goto end;
+                }
+                ++n_checked;
+        }
+
+        lsi_log_debug("abi check: %s provides all %zu exports of %s", host, n_checked, vendored);
+        ret = true;
+
+end:
+        free(exports.slots);
+        lsi_elf_close(&host_image);
+        lsi_elf_close(&vendored_image);
+        return ret;
+}
+
+bool lsi_abi_check(const char *vendored, const char *host)
+{
+        LsiAbiVerdict verdict = { .version = LSI_ABI_CHECK_VERSION };
+
+        if (!lsi_abi_file_stat(vendored, &verdict.vendored) ||
+            !lsi_abi_file_stat(host, &verdict.host)) {
+                return false;
+        }
+
+        lsi_abi_lock();
+        if (!verdicts_loaded) {
+                lsi_abi_cache_load();
+        }
+        for (size_t i = 0; i < n_verdicts; i++) {
+                if (lsi_abi_file_equal(&verdicts[i].vendored, &verdict.vendored) &&
+                    lsi_abi_file_equal(&verdicts[i].host, &verdict.host)) {
+                        bool compatible = verdicts[i].compatible != 0;
+                        lsi_abi_unlock();
+                        return compatible;
+                }
+        }
+        lsi_abi_unlock();
+
+        /* Racing threads may both check the same pair, which is harmless */
+        verdict.compatible = lsi_abi_compare(vendored, host) ? 1 : 0;
+
+        lsi_abi_lock();
+        lsi_abi_push(&verdict);
+        lsi_abi_unlock();
+        lsi_abi_cache_append(&verdict);
+        return verdict.compatible != 0;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
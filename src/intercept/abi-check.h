@@ -0,0 +1,50 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+
+/**
+ * Set to "1" by the shim when vendored libraries within [vendor-upgrade]
+ * may be replaced by their host build
+ */
+#define LSI_ABI_UPGRADE_ENV "LSI_USE_INTERCEPT_UPGRADES"
+
+/**
+ * Determine if the host library at @host can stand in for the vendored
+ * library at @vendored.
+ *
+ * Every symbol the vendored copy exports must also be exported by the host
+ * copy, with the same version where the vendored one is versioned, and
+ * data objects must keep their size. Anything the game could import from
+ * the vendored copy is therefore also satisfied by the host copy.
+ *
+ * Verdicts are remembered per (vendored file, host file) identity, both in
+ * process and across processes within $XDG_CACHE_HOME, so each pair of
+ * files is only ever inspected once.
+ */
+bool lsi_abi_check(const char *vendored, const char *host);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
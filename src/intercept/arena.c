@@ -0,0 +1,141 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+/* The reserved block, mapped by whichever thread needs it first */
+static _Atomic(char *) arena_base = NULL;
+static atomic_size_t arena_used = 0;
+
+/* Interned strings by hash, a slot never changes once set */
+static _Atomic(const char *) arena_slots[LSI_ARENA_SLOTS];
+
+static inline uint32_t lsi_arena_hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = s; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+/**
+ * Reserve the arena, if nobody beat us to it
+ */
+static char *lsi_arena_base(void)
+{
+        char *base = atomic_load_explicit(&arena_base, memory_order_acquire);
+        char *expected = NULL;
+        void *map = NULL;
+
+        if (base) {
+                return base;
+        }
+
+        map = mmap(NULL,
+                   LSI_ARENA_SIZE,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                   -1,
+                   0);
+        if (map == MAP_FAILED) {
+                return NULL;
+        }
+        if (atomic_compare_exchange_strong_explicit(&arena_base,
+                                                    &expected,
+                                                    map,
+                                                    memory_order_acq_rel,
+                                                    memory_order_acquire)) {
+                return map;
+        }
+
+        /* Lost the race, use the winner's block */
+        munmap(map, LSI_ARENA_SIZE);
+        return expected;
+}
+
+/**
+ * Copy @s into the arena
+ */
+static const char *lsi_arena_copy(const char *s, size_t len)
+{
+        char *base = lsi_arena_base();
+        size_t offset;
+
+        if (!base || len >= LSI_ARENA_SIZE) {
+                return NULL;
+        }
+
+        offset = atomic_fetch_add_explicit(&arena_used, len + 1, memory_order_relaxed);
+        if (offset > LSI_ARENA_SIZE - (len + 1)) {
+                return NULL;
+        }
+        memcpy(base + offset, s, len + 1);
+        return base + offset;
+}
+
+const char *lsi_arena_intern(const char *s)
+{
+        const uint32_t mask = LSI_ARENA_SLOTS - 1;
+        const char *copy = NULL;
+        uint32_t hash = lsi_arena_hash(s);
+
+        for (uint32_t i = 0; i < LSI_ARENA_SLOTS; i++) {
+                _Atomic(const char *) *slot = &arena_slots[(hash + i) & mask];
+                const char *current = atomic_load_explicit(slot, memory_order_acquire);
+
+                if (!current) {
+                        if (!copy) {
+                                copy = lsi_arena_copy(s, strlen(s));
+                                if (!copy) {
+                                        return NULL;
+                                }
+                        }
+                        /* The release publishes the copy along with the slot */
+                        if (atomic_compare_exchange_strong_explicit(slot,
+                                                                    &current,
+                                                                    copy,
+                                                                    memory_order_release,
+                                                                    memory_order_acquire)) {
+                                return copy;
+                        }
+                        /* Another thread took this slot, check what it stored */
+                }
+                if (strcmp(current, s) == 0) {
+                        return current;
+                }
+        }
+
+        /* Table is full, the string just won't be shared */
+        return copy ? copy : lsi_arena_copy(s, strlen(s));
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
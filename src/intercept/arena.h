@@ -0,0 +1,50 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+/**
+ * Address space reserved for interned strings. Pages are only committed as
+ * they're first written, so this is an upper bound rather than a cost.
+ */
+#define LSI_ARENA_SIZE (1024 * 1024)
+
+/**
+ * Number of slots in the intern table, must be a power of two
+ */
+#define LSI_ARENA_SLOTS 4096
+
+/**
+ * Return a copy of @s that stays valid for the process lifetime, shared with
+ * any identical string interned before.
+ *
+ * Strings are never freed. Space is carved from a single reserved block with
+ * an atomic bump and the table is updated with compare-and-swap, so this is
+ * safe to call from any number of threads without locking.
+ *
+ * @returns The interned string, or NULL if the arena is exhausted
+ */
+const char *lsi_arena_intern(const char *s);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
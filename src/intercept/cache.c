@@ -0,0 +1,254 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+#include "cache.h"
+
+/**
+ * Initial number of slots in the table, must be a power of two.
+ * Steam client startup settles at a few hundred unique requests.
+ */
+#define LSI_CACHE_INITIAL_SIZE 512
+
+/**
+ * What did we originally decide for this request?
+ */
+typedef enum {
+        LSI_DECISION_EMPTY = 0,
+        LSI_DECISION_PASS,    /**<Hand the name straight back to the linker */
+        LSI_DECISION_BLOCK,   /**<Blacklisted, linker gets NULL */
+        LSI_DECISION_REPLACE, /**<Linker gets the stored replacement */
+} LsiDecisionKind;
+
+/**
+ * A single slot within the open addressing table
+ */
+typedef struct LsiDecision {
+        uint32_t hash;
+        unsigned int flag;
+        unsigned int mode;
+        LsiDecisionKind kind;
+        char *name;
+        char *replacement; /**<Lives for the process lifetime, never ours to free */
+} LsiDecision;
+
+static LsiDecision *decisions = NULL;
+static size_t n_decisions = 0;
+static size_t n_slots = 0;
+
+/* ld.so serialises la_objsearch, but the libredirect dlopen() hook runs in any thread */
+static atomic_flag decisions_lock = ATOMIC_FLAG_INIT;
+
+/* Counters emitted when LSI_DEBUG is set */
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+
+static inline void lsi_decision_cache_lock(void)
+{
+        while (atomic_flag_test_and_set_explicit(&decisions_lock, memory_order_acquire)) {
+                sched_yield();
+        }
+}
+
+static inline void lsi_decision_cache_unlock(void)
+{
+        atomic_flag_clear_explicit(&decisions_lock, memory_order_release);
+}
+
+/**
+ * Find the slot for the given key, which is either the matching entry or
+ * the first empty slot in the probe sequence.
+ */
+static LsiDecision *lsi_decision_cache_slot(LsiDecision *table, size_t size, uint32_t hash,
+                                            const char *name, unsigned int flag,
+                                            unsigned int mode)
+{
+        size_t mask = size - 1;
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                LsiDecision *d = &table[i];
+                if (d->kind == LSI_DECISION_EMPTY) {
+                        return d;
+                }
+                if (d->hash == hash && d->flag == flag && d->mode == mode &&
+                    strcmp(d->name, name) == 0) {
+                        return d;
+                }
+        }
+}
+
+/**
+ * Double the table size (or set it up initially) and rehash existing entries.
+ * Called with the lock held.
+ */
+static bool lsi_decision_cache_grow(void)
+{
+        size_t new_size = n_slots ? n_slots * 2 : LSI_CACHE_INITIAL_SIZE;
+        LsiDecision *table = NULL;
+
+        table = calloc(new_size, sizeof(LsiDecision));
+        if (!table) {
+                return false;
+        }
+
+        for (size_t i = 0; i < n_slots; i++) {
+                LsiDecision *d = &decisions[i];
+                if (d->kind == LSI_DECISION_EMPTY) {
+                        continue;
+                }
+                *lsi_decision_cache_slot(table, new_size, d->hash, d->name, d->flag, d->mode) = *d;
+        }
+
+        free(decisions);
+        decisions = table;
+        n_slots = new_size;
+        return true;
+}
+
+bool lsi_decision_cache_lookup(const char *name, unsigned int flag, unsigned int mode,
+                               char **result)
+{
+        LsiDecision *d = NULL;
+
+        if (!name) {
+                return false;
+        }
+
+        lsi_decision_cache_lock();
+        if (!decisions) {
+                goto miss;
+        }
+
+        d = lsi_decision_cache_slot(decisions,
+                                    n_slots,
+                                    lsi_decision_hash(name, flag, mode),
+                                    name,
+                                    flag,
+                                    mode);
+        switch (d->kind) {
+        case LSI_DECISION_PASS:
+                *result = (char *)name;
+                break;
+        case LSI_DECISION_BLOCK:
+                *result = NULL;
+                break;
+        case LSI_DECISION_REPLACE:
+                *result = d->replacement;
+                break;
+        case LSI_DECISION_EMPTY:
+        default:
+                goto miss;
+        }
+
+        ++cache_hits;
+        lsi_decision_cache_unlock();
+        return true;
+
+miss:
+        ++cache_misses;
+        lsi_decision_cache_unlock();
+        return false;
+}
+
+char *lsi_decision_cache_store(const char *name, unsigned int flag, unsigned int mode,
+                               char *result)
+{
+        LsiDecision *d = NULL;
+        uint32_t hash;
+
+        if (!name) {
+                return result;
+        }
+        hash = lsi_decision_hash(name, flag, mode);
+
+        lsi_decision_cache_lock();
+
+        /* Keep load factor under 3/4 */
+        if ((n_decisions + 1) * 4 > n_slots * 3 && !lsi_decision_cache_grow()) {
+                goto end;
+        }
+
+        d = lsi_decision_cache_slot(decisions, n_slots, hash, name, flag, mode);
+        if (d->kind != LSI_DECISION_EMPTY) {
+                goto end;
+        }
+
+        d->name = strdup(name);
+        if (!d->name) {
+                goto end;
+        }
+
+        if (result == name) {
+                d->kind = LSI_DECISION_PASS;
+        } else if (!result) {
+                d->kind = LSI_DECISION_BLOCK;
+        } else {
+                d->kind = LSI_DECISION_REPLACE;
+                d->replacement = result;
+        }
+
+        d->hash = hash;
+        d->flag = flag;
+        d->mode = mode;
+        ++n_decisions;
+
+end:
+        lsi_decision_cache_unlock();
+        return result;
+}
+
+void lsi_decision_cache_clear(void)
+{
+        lsi_decision_cache_lock();
+        for (size_t i = 0; i < n_slots; i++) {
+                free(decisions[i].name);
+        }
+        free(decisions);
+        decisions = NULL;
+        n_decisions = n_slots = 0;
+        lsi_decision_cache_unlock();
+}
+
+/**
+ * Report how effective the cache was and release the table
+ */
+__attribute__((destructor)) static void lsi_decision_cache_shutdown(void)
+{
+        if (cache_hits || cache_misses) {
+                lsi_log_debug("decision cache: %lu hits, %lu misses, %zu entries",
+                              cache_hits,
+                              cache_misses,
+                              n_decisions);
+        }
+        lsi_decision_cache_clear();
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
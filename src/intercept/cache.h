@@ -0,0 +1,77 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * FNV-1a over the name, folding in the flag and mode so that equivalent
+ * requests in different contexts don't collide. This is also the on-disk
+ * hash so it must remain stable between releases and architectures.
+ */
+static inline uint32_t lsi_decision_hash(const char *name, unsigned int flag, unsigned int mode)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = name; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        h ^= flag;
+        h *= 16777619u;
+        h ^= mode;
+        h *= 16777619u;
+        return h;
+}
+
+/**
+ * Look up a previously stored la_objsearch decision for the given request.
+ *
+ * On a hit, @result is set to the final answer: @name itself when the lookup
+ * was passed through untouched, NULL when the load was blacklisted, or the
+ * replacement path/soname.
+ *
+ * @returns true if the decision was known
+ */
+bool lsi_decision_cache_lookup(const char *name, unsigned int flag, unsigned int mode,
+                               char **result);
+
+/**
+ * Remember the final la_objsearch decision for the given request. Any
+ * replacement must already be valid for the process lifetime, as everything
+ * from the decision code and the mapped disk cache is, so it isn't copied.
+ *
+ * @returns @result, for convenience
+ */
+char *lsi_decision_cache_store(const char *name, unsigned int flag, unsigned int mode,
+                               char *result);
+
+/**
+ * Forget every stored decision and release the table
+ */
+void lsi_decision_cache_clear(void);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
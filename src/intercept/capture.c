@@ -0,0 +1,191 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/files.h"
+#include "../common/log.h"
+#include "capture.h"
+
+/**
+ * Captures are written to $LSI_INTERCEPT_CAPTURE/intercept-$pid.capture when
+ * the process exits. Capturing costs an extra getcwd() and lstat() per search,
+ * so it is only meant for producing replay logs, not for timing.
+ */
+#define LSI_CAPTURE_ENV "LSI_INTERCEPT_CAPTURE"
+
+bool lsi_capture_active = false;
+
+static char *capture_dir = NULL;
+static pid_t capture_pid = 0;
+
+/* Records, serialised as they'll be written */
+static char *capture_data = NULL;
+static size_t capture_size = 0;
+static size_t capture_alloc = 0;
+static uint32_t n_capture_records = 0;
+
+/* Working directory of the last search, so we only record changes */
+static char *capture_cwd = NULL;
+
+/**
+ * Append a record along with its string
+ */
+static void lsi_capture_append(LsiCaptureKind kind, unsigned int mode, bool exists,
+                               unsigned int flag, const char *s)
+{
+        uint32_t length = (uint32_t)strlen(s) + 1;
+        uint32_t size = lsi_capture_record_size(length);
+        LsiCaptureRecord *record = NULL;
+
+        if (capture_size + size > capture_alloc) {
+                size_t alloc = capture_alloc ? capture_alloc * 2 : 64 * 1024;
+                char *data = NULL;
+                while (alloc < capture_size + size) {
+                        alloc *= 2;
+                }
+                data = realloc(capture_data, alloc);
+                if (!data) {
+                        return;
+                }
+                capture_data = data;
+                capture_alloc = alloc;
+        }
+
+        record = (LsiCaptureRecord *)(capture_data + capture_size);
+        memset(record, 0, size);
+        record->kind = (uint8_t)kind;
+        record->mode = (uint8_t)mode;
+        record->exists = exists;
+        record->flag = flag;
+        record->length = length;
+        memcpy(record + 1, s, length);
+
+        capture_size += size;
+        ++n_capture_records;
+}
+
+/**
+ * Start a fresh log for this process, dropping anything inherited across fork()
+ * as the parent writes those records itself.
+ */
+static void lsi_capture_reset(void)
+{
+        capture_pid = getpid();
+        capture_size = 0;
+        n_capture_records = 0;
+        free(capture_cwd);
+        capture_cwd = NULL;
+        lsi_capture_append(LSI_CAPTURE_PROCESS, 0, false, 0, program_invocation_short_name);
+}
+
+void lsi_capture_init(void)
+{
+        const char *dir = getenv(LSI_CAPTURE_ENV);
+
+        if (!dir || !*dir) {
+                return;
+        }
+        capture_dir = strdup(dir);
+        if (!capture_dir) {
+                return;
+        }
+        lsi_capture_active = true;
+        lsi_capture_reset();
+}
+
+void lsi_capture_search(const char *name, unsigned int flag, unsigned int mode)
+{
+        char *cwd = NULL;
+
+        if (getpid() != capture_pid) {
+                lsi_capture_reset();
+        }
+
+        cwd = getcwd(NULL, 0);
+        if (cwd && (!capture_cwd || strcmp(cwd, capture_cwd) != 0)) {
+                lsi_capture_append(LSI_CAPTURE_CWD, 0, false, 0, cwd);
+                free(capture_cwd);
+                capture_cwd = cwd;
+        } else {
+                free(cwd);
+        }
+
+        lsi_capture_append(LSI_CAPTURE_SEARCH, mode, lsi_file_exists(name), flag, name);
+}
+
+/**
+ * Write the log out, the linker won't call us again after this
+ */
+__attribute__((destructor)) static void lsi_capture_shutdown(void)
+{
+        LsiCaptureHeader header = { 0 };
+        char *path = NULL;
+        FILE *fp = NULL;
+
+        if (!lsi_capture_active) {
+                return;
+        }
+        lsi_capture_active = false;
+        if (getpid() != capture_pid) {
+                lsi_capture_reset();
+        }
+        memcpy(header.magic, LSI_CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = LSI_CAPTURE_VERSION;
+        header.n_records = n_capture_records;
+
+        if (asprintf(&path, "%s/intercept-%d.capture", capture_dir, capture_pid) < 0) {
+                path = NULL;
+                goto end;
+        }
+        fp = fopen(path, "we");
+        if (!fp) {
+                lsi_log_warn("Unable to write capture %s: %s", path, strerror(errno));
+                goto end;
+        }
+
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(capture_data, 1, capture_size, fp);
+        if (fclose(fp) != 0) {
+                lsi_log_warn("Unable to write capture %s: %s", path, strerror(errno));
+        } else {
+                lsi_log_debug("capture: wrote %u records to %s", n_capture_records, path);
+        }
+
+end:
+        free(path);
+        free(capture_data);
+        capture_data = NULL;
+        capture_size = capture_alloc = 0;
+        free(capture_cwd);
+        capture_cwd = NULL;
+        free(capture_dir);
+        capture_dir = NULL;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
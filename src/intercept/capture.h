@@ -0,0 +1,86 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Capture log of every la_objsearch request made by one process, replayed by
+ * lsi-intercept-bench to measure decisions without launching Steam.
+ *
+ *      header | record | data[length] | record | data[length] ...
+ *
+ * Each record is followed by its NUL terminated string, padded so the next
+ * record starts 4-byte aligned. Logs are written in host byte order.
+ */
+#define LSI_CAPTURE_MAGIC "LSICAPTR"
+#define LSI_CAPTURE_VERSION 1
+
+typedef struct LsiCaptureHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_records;
+} LsiCaptureHeader;
+
+typedef enum {
+        LSI_CAPTURE_PROCESS = 1, /**<Name of the capturing process */
+        LSI_CAPTURE_CWD,         /**<Working directory for the following searches */
+        LSI_CAPTURE_SEARCH,      /**<A single la_objsearch request */
+} LsiCaptureKind;
+
+typedef struct LsiCaptureRecord {
+        uint8_t kind;
+        uint8_t mode;   /**<InterceptMode of the process */
+        uint8_t exists; /**<Whether the name existed, relative to the working directory */
+        uint8_t padding;
+        uint32_t flag;   /**<LA_SER_* origin of the search */
+        uint32_t length; /**<Size of the string data, including the terminator */
+} LsiCaptureRecord;
+
+/**
+ * Size of a record and its padded data
+ */
+static inline uint32_t lsi_capture_record_size(uint32_t length)
+{
+        return (uint32_t)sizeof(LsiCaptureRecord) + ((length + 3) & ~3u);
+}
+
+/**
+ * Set when LSI_INTERCEPT_CAPTURE names a directory to write captures into
+ */
+extern bool lsi_capture_active;
+
+/**
+ * Enable capturing if requested by the environment. Called once from la_version.
+ */
+void lsi_capture_init(void);
+
+/**
+ * Record a single la_objsearch request
+ */
+void lsi_capture_search(const char *name, unsigned int flag, unsigned int mode);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,766 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "cache.h"
+#include "disk-cache.h"
+#include "host-resolver.h"
+#include "nica/files.h"
+#include "nica/util.h"
+
+/**
+ * The cache lives at $XDG_CACHE_HOME/linux-steam-integration/intercept.cache
+ * and is shared by the 32-bit and 64-bit builds of the module.
+ *
+ * Only processes that made new decisions write. Writers take an flock() on
+ * the lock file, merge in the current contents, write a new file and rename()
+ * it into place, giving up instead if another writer holds the lock. Readers
+ * never lock, they just map whatever snapshot is current when they start.
+ */
+#define LSI_CACHE_DIR "linux-steam-integration"
+#define LSI_CACHE_FILE "intercept.cache"
+#define LSI_CACHE_LOCK "intercept.cache.lock"
+
+/**
+ * Bump whenever the layout or the meaning of a decision changes
+ */
+#define LSI_CACHE_MAGIC "LSIDCACH"
+#define LSI_CACHE_VERSION 5
+
+/**
+ * Don't let the file grow without bound, older entries get dropped first
+ */
+#define LSI_CACHE_MAX_ENTRIES 8192
+
+/**
+ * ELF class of the current process, used to keep 32-bit and 64-bit
+ * decisions apart within the same file.
+ */
+#define LSI_CACHE_CLASS ((uint32_t)(sizeof(void *) * 8))
+
+/**
+ * On-disk layout. Every 64-bit field sits on an 8-byte boundary so the
+ * layout is identical for i386 and x86_64 builds.
+ *
+ *      header | buckets[n_buckets] | entries[n_entries] | strings
+ */
+typedef struct LsiCacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_buckets; /**<Always a power of two, 0 when empty */
+        uint32_t n_entries;
+        uint32_t strings_size;
+        uint64_t host_stamp_32; /**<Host library directories for 32-bit */
+        uint64_t host_stamp_64; /**<Host library directories for 64-bit */
+} LsiCacheHeader;
+
+typedef struct LsiCacheEntry {
+        uint32_t hash;
+        uint32_t flag;
+        uint32_t mode;
+        uint32_t elf_class;
+        uint32_t kind; /**<See LsiCacheKind */
+        uint32_t name;
+        uint32_t replacement;
+        uint32_t profile; /**<App ID of the rules profile, 0 for the global rules */
+        uint64_t source_dev; /**<0 when the source didn't exist */
+        uint64_t source_ino;
+        int64_t source_mtime;
+        int64_t source_mtime_nsec;
+} LsiCacheEntry;
+
+_Static_assert(sizeof(LsiCacheHeader) == 40, "LsiCacheHeader must have a fixed layout");
+_Static_assert(sizeof(LsiCacheEntry) == 64, "LsiCacheEntry must have a fixed layout");
+
+typedef enum {
+        LSI_CACHE_PASS = 1,
+        LSI_CACHE_BLOCK,
+        LSI_CACHE_REPLACE,
+} LsiCacheKind;
+
+/**
+ * A decision waiting to be written out, or being merged from the old file
+ */
+typedef struct LsiCacheRecord {
+        LsiCacheEntry entry;
+        char *name;
+        char *replacement;
+} LsiCacheRecord;
+
+/* Current mapping */
+static void *cache_map = NULL;
+static size_t cache_map_size = 0;
+static const LsiCacheHeader *cache_header = NULL;
+static const uint32_t *cache_buckets = NULL;
+static const LsiCacheEntry *cache_entries = NULL;
+static const char *cache_strings = NULL;
+
+/* Stamp of the rules and host library directories for this process */
+static uint64_t host_stamp = 0;
+
+/* Rules profile in use by this process */
+static uint32_t cache_profile = 0;
+
+/* Cache directory, NULL if we can't use a cache at all */
+static char *cache_dir = NULL;
+
+/* Decisions made by this process that aren't yet on disk */
+static LsiCacheRecord *pending = NULL;
+static size_t n_pending = 0;
+static size_t pending_size = 0;
+
+static inline uint64_t lsi_stamp_mix(uint64_t h, uint64_t v)
+{
+        for (int i = 0; i < 8; i++) {
+                h ^= (v >> (i * 8)) & 0xff;
+                h *= 1099511628211ull;
+        }
+        return h;
+}
+
+/**
+ * Record the identity of the file at @path, or zeroes if it doesn't exist
+ */
+static void lsi_disk_cache_stat_source(const char *path, LsiCacheEntry *entry)
+{
+        struct stat st = { 0 };
+
+        if (lstat(path, &st) != 0) {
+                entry->source_dev = 0;
+                entry->source_ino = 0;
+                entry->source_mtime = 0;
+                entry->source_mtime_nsec = 0;
+                return;
+        }
+        entry->source_dev = (uint64_t)st.st_dev;
+        entry->source_ino = (uint64_t)st.st_ino;
+        entry->source_mtime = (int64_t)st.st_mtim.tv_sec;
+        entry->source_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+}
+
+/**
+ * Ensure the mapped file is sane before we trust any offsets within it
+ */
+static bool lsi_disk_cache_validate(const void *map, size_t size)
+{
+        const LsiCacheHeader *header = map;
+        size_t need = sizeof(LsiCacheHeader);
+
+        if (size < need) {
+                return false;
+        }
+        if (memcmp(header->magic, LSI_CACHE_MAGIC, sizeof(header->magic)) != 0) {
+                return false;
+        }
+        if (header->version != LSI_CACHE_VERSION) {
+                return false;
+        }
+        if (header->n_buckets & (header->n_buckets - 1)) {
+                return false;
+        }
+        /* A full table would leave nothing to end a probe for a missing name */
+        if (header->n_entries > LSI_CACHE_MAX_ENTRIES ||
+            (header->n_entries > 0 && header->n_buckets <= header->n_entries)) {
+                return false;
+        }
+
+        need += (size_t)header->n_buckets * sizeof(uint32_t);
+        need += (size_t)header->n_entries * sizeof(LsiCacheEntry);
+        need += header->strings_size;
+        if (size != need) {
+                return false;
+        }
+
+        /* Strings must be terminated so an entry can never read past the end */
+        if (header->strings_size > 0 && ((const char *)map)[size - 1] != '\0') {
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Map the cache file, returning the mapping or NULL
+ */
+static void *lsi_disk_cache_map(const char *path, size_t *size)
+{
+        struct stat st = { 0 };
+        void *map = NULL;
+        int fd = -1;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return NULL;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LsiCacheHeader)) {
+                goto end;
+        }
+
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+                map = NULL;
+                goto end;
+        }
+
+        if (!lsi_disk_cache_validate(map, (size_t)st.st_size)) {
+                munmap(map, (size_t)st.st_size);
+                map = NULL;
+                goto end;
+        }
+        *size = (size_t)st.st_size;
+
+end:
+        close(fd);
+        return map;
+}
+
+static inline uint64_t lsi_disk_cache_header_stamp(const LsiCacheHeader *header,
+                                                   uint32_t elf_class)
+{
+        return elf_class == 64 ? header->host_stamp_64 : header->host_stamp_32;
+}
+
+void lsi_disk_cache_open(const char **host_dirs, size_t n_host_dirs, uint64_t rules_stamp,
+                         uint32_t profile)
+{
+        autofree(char) *base = NULL;
+        autofree(char) *path = NULL;
+
+        if (getenv("LSI_NO_CACHE")) {
+                return;
+        }
+
+        cache_profile = profile;
+
+        /* Any change in the rules, host library directories or CPU invalidates our class */
+        host_stamp = lsi_stamp_mix(14695981039346656037ull, rules_stamp);
+        host_stamp = lsi_stamp_mix(host_stamp, lsi_host_resolver_hwcaps_level());
+        for (size_t i = 0; i < n_host_dirs; i++) {
+                struct stat st = { 0 };
+                if (stat(host_dirs[i], &st) != 0) {
+                        host_stamp = lsi_stamp_mix(host_stamp, 0);
+                        continue;
+                }
+                host_stamp = lsi_stamp_mix(host_stamp, (uint64_t)st.st_dev);
+                host_stamp = lsi_stamp_mix(host_stamp, (uint64_t)st.st_ino);
+                host_stamp = lsi_stamp_mix(host_stamp, (uint64_t)st.st_mtim.tv_sec);
+                host_stamp = lsi_stamp_mix(host_stamp, (uint64_t)st.st_mtim.tv_nsec);
+        }
+
+        base = lsi_get_user_cache_dir();
+        if (!base) {
+                return;
+        }
+        if (asprintf(&cache_dir, "%s/%s", base, LSI_CACHE_DIR) < 0) {
+                cache_dir = NULL;
+                return;
+        }
+        if (asprintf(&path, "%s/%s", cache_dir, LSI_CACHE_FILE) < 0) {
+                return;
+        }
+
+        cache_map = lsi_disk_cache_map(path, &cache_map_size);
+        if (!cache_map) {
+                return;
+        }
+
+        cache_header = cache_map;
+        if (lsi_disk_cache_header_stamp(cache_header, LSI_CACHE_CLASS) != host_stamp) {
+                lsi_log_debug("disk cache: rules or host libraries changed, ignoring entries");
+                cache_header = NULL;
+                return;
+        }
+        cache_buckets = (const uint32_t *)(cache_header + 1);
+        cache_entries = (const LsiCacheEntry *)(cache_buckets + cache_header->n_buckets);
+        cache_strings = (const char *)(cache_entries + cache_header->n_entries);
+        lsi_log_debug("disk cache: mapped %u decisions", cache_header->n_entries);
+}
+
+/**
+ * Find the mapped entry for a decision, if there is one
+ */
+static const LsiCacheEntry *lsi_disk_cache_find(const char *name, unsigned int flag,
+                                                unsigned int mode)
+{
+        uint32_t hash;
+        uint32_t mask;
+
+        if (!cache_header || cache_header->n_buckets == 0 || !name) {
+                return NULL;
+        }
+
+        hash = lsi_decision_hash(name, flag, mode);
+        mask = cache_header->n_buckets - 1;
+
+        /* Bounded regardless, the file may have been written by anyone */
+        for (uint32_t n = 0, i = hash & mask; n < cache_header->n_buckets;
+             n++, i = (i + 1) & mask) {
+                uint32_t index = cache_buckets[i];
+                const LsiCacheEntry *entry = NULL;
+
+                if (index == 0 || index > cache_header->n_entries) {
+                        return NULL;
+                }
+                entry = &cache_entries[index - 1];
+                if (entry->hash == hash && entry->flag == flag && entry->mode == mode &&
+                    entry->elf_class == LSI_CACHE_CLASS && entry->profile == cache_profile &&
+                    entry->name < cache_header->strings_size &&
+                    strcmp(cache_strings + entry->name, name) == 0) {
+                        return entry;
+                }
+        }
+        return NULL;
+}
+
+bool lsi_disk_cache_lookup(const char *name, unsigned int flag, unsigned int mode,
+                           char **result)
+{
+        LsiCacheEntry source = { 0 };
+        const LsiCacheEntry *entry = NULL;
+
+        entry = lsi_disk_cache_find(name, flag, mode);
+        if (!entry) {
+                return false;
+        }
+
+        /* Make sure we're still looking at the same file */
+        lsi_disk_cache_stat_source(name, &source);
+        if (source.source_dev != entry->source_dev || source.source_ino != entry->source_ino ||
+            source.source_mtime != entry->source_mtime ||
+            source.source_mtime_nsec != entry->source_mtime_nsec) {
+                return false;
+        }
+
+        switch (entry->kind) {
+        case LSI_CACHE_PASS:
+                *result = (char *)name;
+                return true;
+        case LSI_CACHE_BLOCK:
+                *result = NULL;
+                return true;
+        case LSI_CACHE_REPLACE:
+                if (entry->replacement >= cache_header->strings_size) {
+                        return false;
+                }
+                *result = (char *)(cache_strings + entry->replacement);
+
+                /* Probes map onto game files that an update may have moved */
+                if (**result == '/' && !lsi_file_exists(*result)) {
+                        return false;
+                }
+                return true;
+        default:
+                return false;
+        }
+}
+
+/**
+ * Append a record to the pending set, taking ownership of the strings
+ */
+static bool lsi_disk_cache_push(LsiCacheRecord **records, size_t *n_records, size_t *size,
+                                LsiCacheRecord *record)
+{
+        if (*n_records == *size) {
+                size_t new_size = *size ? *size * 2 : 64;
+                LsiCacheRecord *r = realloc(*records, new_size * sizeof(LsiCacheRecord));
+                if (!r) {
+                        return false;
+                }
+                *records = r;
+                *size = new_size;
+        }
+        (*records)[(*n_records)++] = *record;
+        return true;
+}
+
+/**
+ * Determine if the mapped file already holds exactly this decision, as it
+ * does when a replacement was turned down for a missing target and then
+ * decided the same way again
+ */
+static bool lsi_disk_cache_is_known(const char *name, const LsiCacheEntry *entry,
+                                    const char *result)
+{
+        const LsiCacheEntry *known = lsi_disk_cache_find(name, entry->flag, entry->mode);
+
+        if (!known || known->kind != entry->kind || known->source_dev != entry->source_dev ||
+            known->source_ino != entry->source_ino ||
+            known->source_mtime != entry->source_mtime ||
+            known->source_mtime_nsec != entry->source_mtime_nsec) {
+                return false;
+        }
+        if (entry->kind != LSI_CACHE_REPLACE) {
+                return true;
+        }
+        return known->replacement < cache_header->strings_size &&
+               strcmp(cache_strings + known->replacement, result) == 0;
+}
+
+void lsi_disk_cache_record(const char *name, unsigned int flag, unsigned int mode,
+                           const char *result)
+{
+        LsiCacheRecord record = { 0 };
+
+        if (!cache_dir || !name) {
+                return;
+        }
+
+        record.entry.hash = lsi_decision_hash(name, flag, mode);
+        record.entry.flag = flag;
+        record.entry.mode = mode;
+        record.entry.elf_class = LSI_CACHE_CLASS;
+        record.entry.profile = cache_profile;
+        lsi_disk_cache_stat_source(name, &record.entry);
+
+        if (result == name) {
+                record.entry.kind = LSI_CACHE_PASS;
+        } else if (!result) {
+                record.entry.kind = LSI_CACHE_BLOCK;
+        } else {
+                record.entry.kind = LSI_CACHE_REPLACE;
+        }
+
+        /* Only new decisions are worth rewriting the file for */
+        if (lsi_disk_cache_is_known(name, &record.entry, result)) {
+                return;
+        }
+
+        record.name = strdup(name);
+        if (!record.name) {
+                return;
+        }
+        if (record.entry.kind == LSI_CACHE_REPLACE) {
+                record.replacement = strdup(result);
+                if (!record.replacement) {
+                        free(record.name);
+                        return;
+                }
+        }
+
+        if (!lsi_disk_cache_push(&pending, &n_pending, &pending_size, &record)) {
+                free(record.name);
+                free(record.replacement);
+        }
+}
+
+static inline bool lsi_disk_cache_record_equal(const LsiCacheRecord *a, const LsiCacheRecord *b)
+{
+        return a->entry.hash == b->entry.hash && a->entry.flag == b->entry.flag &&
+               a->entry.mode == b->entry.mode && a->entry.elf_class == b->entry.elf_class &&
+               a->entry.profile == b->entry.profile && strcmp(a->name, b->name) == 0;
+}
+
+/**
+ * Drop duplicate records in place, keeping the first occurrence, and cap
+ * the set to LSI_CACHE_MAX_ENTRIES.
+ *
+ * @returns The new number of records
+ */
+static size_t lsi_disk_cache_unique(LsiCacheRecord *records, size_t n_records)
+{
+        uint32_t *seen = NULL;
+        size_t n_seen = 16;
+        size_t mask;
+        size_t n_unique = 0;
+
+        while (n_seen < n_records * 2) {
+                n_seen *= 2;
+        }
+        mask = n_seen - 1;
+
+        seen = calloc(n_seen, sizeof(uint32_t));
+        if (!seen) {
+                return 0;
+        }
+
+        for (size_t i = 0; i < n_records && n_unique < LSI_CACHE_MAX_ENTRIES; i++) {
+                bool dupe = false;
+                size_t b;
+
+                for (b = records[i].entry.hash & mask; seen[b] != 0; b = (b + 1) & mask) {
+                        if (lsi_disk_cache_record_equal(&records[seen[b] - 1], &records[i])) {
+                                dupe = true;
+                                break;
+                        }
+                }
+                if (dupe) {
+                        continue;
+                }
+                records[n_unique] = records[i];
+                seen[b] = (uint32_t)(++n_unique);
+        }
+
+        free(seen);
+        return n_unique;
+}
+
+/**
+ * Serialise the records into a new cache file at @fd
+ */
+static bool lsi_disk_cache_write(int fd, LsiCacheRecord *records, size_t n_records,
+                                 const LsiCacheHeader *old_header)
+{
+        LsiCacheHeader header = { 0 };
+        autofree(char) *blob = NULL;
+        uint32_t *buckets = NULL;
+        LsiCacheEntry *entries = NULL;
+        char *strings = NULL;
+        size_t strings_size = 0;
+        size_t n_buckets = 0;
+        size_t blob_size = 0;
+        size_t n_entries = 0;
+
+        for (size_t i = 0; i < n_records; i++) {
+                strings_size += strlen(records[i].name) + 1;
+                if (records[i].replacement) {
+                        strings_size += strlen(records[i].replacement) + 1;
+                }
+        }
+
+        /* Keep the load factor at or below 1/2 */
+        if (n_records > 0) {
+                n_buckets = 16;
+                while (n_buckets < n_records * 2) {
+                        n_buckets *= 2;
+                }
+        }
+
+        blob_size = sizeof(LsiCacheHeader) + n_buckets * sizeof(uint32_t) +
+                    n_records * sizeof(LsiCacheEntry) + strings_size;
+        blob = calloc(1, blob_size);
+        if (!blob) {
+                return false;
+        }
+        buckets = (uint32_t *)(blob + sizeof(LsiCacheHeader));
+        entries = (LsiCacheEntry *)(buckets + n_buckets);
+        strings = (char *)(entries + n_records);
+        strings_size = 0;
+
+        for (size_t i = 0; i < n_records; i++) {
+                LsiCacheEntry *entry = &entries[n_entries];
+                size_t mask = n_buckets - 1;
+                size_t len;
+
+                *entry = records[i].entry;
+                entry->name = (uint32_t)strings_size;
+                len = strlen(records[i].name) + 1;
+                memcpy(strings + strings_size, records[i].name, len);
+                strings_size += len;
+
+                if (records[i].replacement) {
+                        entry->replacement = (uint32_t)strings_size;
+                        len = strlen(records[i].replacement) + 1;
+                        memcpy(strings + strings_size, records[i].replacement, len);
+                        strings_size += len;
+                }
+
+                for (size_t b = entry->hash & mask;; b = (b + 1) & mask) {
+                        if (buckets[b] == 0) {
+                                buckets[b] = (uint32_t)(++n_entries);
+                                break;
+                        }
+                }
+        }
+
+        memcpy(header.magic, LSI_CACHE_MAGIC, sizeof(header.magic));
+        header.version = LSI_CACHE_VERSION;
+        header.n_buckets = (uint32_t)n_buckets;
+        header.n_entries = (uint32_t)n_entries;
+        header.strings_size = (uint32_t)strings_size;
+
+        /* Preserve the other architecture's view of the host */
+        if (old_header) {
+                header.host_stamp_32 = old_header->host_stamp_32;
+                header.host_stamp_64 = old_header->host_stamp_64;
+        }
+        if (LSI_CACHE_CLASS == 64) {
+                header.host_stamp_64 = host_stamp;
+        } else {
+                header.host_stamp_32 = host_stamp;
+        }
+        memcpy(blob, &header, sizeof(header));
+
+        for (size_t written = 0; written < blob_size;) {
+                ssize_t r = write(fd, blob + written, blob_size - written);
+                if (r < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return false;
+                }
+                written += (size_t)r;
+        }
+        return true;
+}
+
+/**
+ * Merge our pending decisions with whatever is currently on disk and
+ * atomically replace the cache file.
+ */
+static void lsi_disk_cache_sync(void)
+{
+        autofree(char) *path = NULL;
+        autofree(char) *lock_path = NULL;
+        autofree(char) *tmp_path = NULL;
+        LsiCacheRecord *records = NULL;
+        size_t n_records = 0;
+        size_t records_size = 0;
+        const LsiCacheHeader *old = NULL;
+        void *old_map = NULL;
+        size_t old_size = 0;
+        int lock_fd = -1;
+        int fd = -1;
+
+        if (asprintf(&path, "%s/%s", cache_dir, LSI_CACHE_FILE) < 0) {
+                return;
+        }
+        if (asprintf(&lock_path, "%s/%s", cache_dir, LSI_CACHE_LOCK) < 0) {
+                return;
+        }
+        if (asprintf(&tmp_path, "%s/%s.XXXXXX", cache_dir, LSI_CACHE_FILE) < 0) {
+                return;
+        }
+
+        if (!lsi_file_exists(cache_dir) && !nc_mkdir_p(cache_dir, 00755)) {
+                return;
+        }
+
+        /* Serialise writers, both our own architecture and the other one. Never hold up
+         * an exiting process for it though, the decisions will simply be made again. */
+        lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 00644);
+        if (lock_fd < 0) {
+                return;
+        }
+        if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+                if (errno == EWOULDBLOCK) {
+                        lsi_log_debug("disk cache: busy, dropping %zu decisions", n_pending);
+                }
+                goto end;
+        }
+
+        /* Newest first, so our own decisions win over stale ones */
+        for (size_t i = n_pending; i > 0; i--) {
+                if (!lsi_disk_cache_push(&records, &n_records, &records_size, &pending[i - 1])) {
+                        goto end;
+                }
+        }
+
+        /* Pull in whatever other processes wrote while we were running */
+        old_map = lsi_disk_cache_map(path, &old_size);
+        if (old_map) {
+                const uint32_t *buckets = NULL;
+                const LsiCacheEntry *entries = NULL;
+                const char *strings = NULL;
+
+                old = old_map;
+                buckets = (const uint32_t *)(old + 1);
+                entries = (const LsiCacheEntry *)(buckets + old->n_buckets);
+                strings = (const char *)(entries + old->n_entries);
+
+                for (uint32_t i = 0; i < old->n_entries; i++) {
+                        LsiCacheRecord r = { .entry = entries[i] };
+
+                        /* Drop our own entries made against a different host */
+                        if (r.entry.elf_class == LSI_CACHE_CLASS &&
+                            lsi_disk_cache_header_stamp(old, LSI_CACHE_CLASS) != host_stamp) {
+                                continue;
+                        }
+                        if (r.entry.name >= old->strings_size ||
+                            (r.entry.kind == LSI_CACHE_REPLACE &&
+                             r.entry.replacement >= old->strings_size)) {
+                                continue;
+                        }
+                        r.name = (char *)(strings + r.entry.name);
+                        if (r.entry.kind == LSI_CACHE_REPLACE) {
+                                r.replacement = (char *)(strings + r.entry.replacement);
+                        }
+                        if (!lsi_disk_cache_push(&records, &n_records, &records_size, &r)) {
+                                goto end;
+                        }
+                }
+        }
+
+        n_records = lsi_disk_cache_unique(records, n_records);
+
+        fd = mkostemp(tmp_path, O_CLOEXEC);
+        if (fd < 0) {
+                goto end;
+        }
+        if (!lsi_disk_cache_write(fd, records, n_records, old) || fchmod(fd, 00644) != 0) {
+                unlink(tmp_path);
+                goto end;
+        }
+        if (rename(tmp_path, path) != 0) {
+                unlink(tmp_path);
+                goto end;
+        }
+        lsi_log_debug("disk cache: wrote %zu decisions (%zu new)", n_records, n_pending);
+
+end:
+        /* Strings are owned by pending or the old mapping */
+        free(records);
+        if (old_map) {
+                munmap(old_map, old_size);
+        }
+        if (fd >= 0) {
+                close(fd);
+        }
+        close(lock_fd);
+}
+
+/**
+ * Write back anything we learned. The mapping itself is left alone, as the
+ * linker may still hold names that point into it.
+ */
+__attribute__((destructor)) static void lsi_disk_cache_shutdown(void)
+{
+        if (cache_dir && n_pending > 0) {
+                lsi_disk_cache_sync();
+        }
+
+        for (size_t i = 0; i < n_pending; i++) {
+                free(pending[i].name);
+                free(pending[i].replacement);
+        }
+        free(pending);
+        pending = NULL;
+        n_pending = pending_size = 0;
+
+        free(cache_dir);
+        cache_dir = NULL;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,60 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Map the persistent decision cache from $XDG_CACHE_HOME, if it exists.
+ *
+ * The host library directories are stamped (inode + mtime) along with
+ * @rules_stamp so that any change to them, or to the rules in use,
+ * invalidates every entry recorded by this architecture. Decisions are
+ * kept apart per rules @profile.
+ */
+void lsi_disk_cache_open(const char **host_dirs, size_t n_host_dirs, uint64_t rules_stamp,
+                         uint32_t profile);
+
+/**
+ * Look up a decision recorded by a previous process.
+ *
+ * This costs one hash probe plus a single lstat() of @name to ensure the
+ * source file is still the one that was seen when the decision was made.
+ * Replacement names point straight into the mapping and must not be freed.
+ *
+ * @returns true if a valid decision was found
+ */
+bool lsi_disk_cache_lookup(const char *name, unsigned int flag, unsigned int mode,
+                           char **result);
+
+/**
+ * Queue a freshly computed decision to be written back when we exit.
+ */
+void lsi_disk_cache_record(const char *name, unsigned int flag, unsigned int mode,
+                           const char *result);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,789 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "config.h"
+#include "host-resolver.h"
+#include "nica/util.h"
+
+#define LDSO_CACHE_PATH "/etc/ld.so.cache"
+
+/**
+ * glibc's ld.so.cache formats, see sysdeps/generic/dl-cache.h
+ *
+ * Older files carry the "ld.so-1.7.0" table first, followed by the new
+ * format at the next aligned offset. Modern files only have the new format.
+ * All string offsets are relative to the start of the new format header.
+ */
+#define LDSO_CACHE_MAGIC_OLD "ld.so-1.7.0"
+#define LDSO_CACHE_MAGIC_NEW "glibc-ld.so.cache"
+#define LDSO_CACHE_VERSION_NEW "1.1"
+
+typedef struct LdsoCacheOldHeader {
+        char magic[sizeof(LDSO_CACHE_MAGIC_OLD) - 1];
+        uint32_t nlibs;
+} LdsoCacheOldHeader;
+
+typedef struct LdsoCacheOldEntry {
+        int32_t flags;
+        uint32_t key;
+        uint32_t value;
+} LdsoCacheOldEntry;
+
+typedef struct LdsoCacheHeader {
+        char magic[sizeof(LDSO_CACHE_MAGIC_NEW) - 1];
+        char version[sizeof(LDSO_CACHE_VERSION_NEW) - 1];
+        uint32_t nlibs;
+        uint32_t len_strings;
+        uint8_t flags;
+        uint8_t padding[3];
+        uint32_t extension_offset;
+        uint32_t unused[3];
+} LdsoCacheHeader;
+
+typedef struct LdsoCacheEntry {
+        int32_t flags;
+        uint32_t key;   /**<Soname */
+        uint32_t value; /**<Absolute path */
+        uint32_t osversion;
+        uint64_t hwcap;
+} LdsoCacheEntry;
+
+/**
+ * Extension sections, found at extension_offset from the start of the file.
+ * Entries for libraries within a glibc-hwcaps subdirectory set
+ * LDSO_CACHE_HWCAP_EXTENSION in hwcap, and the low 32 bits index the table
+ * of subdirectory names within the glibc-hwcaps section.
+ */
+#define LDSO_CACHE_EXTENSION_MAGIC 0xeaa42174u
+#define LDSO_CACHE_EXTENSION_TAG_GLIBC_HWCAPS 1
+#define LDSO_CACHE_HWCAP_EXTENSION (1ull << 62)
+
+typedef struct LdsoCacheExtension {
+        uint32_t magic;
+        uint32_t count;
+} LdsoCacheExtension;
+
+typedef struct LdsoCacheExtensionSection {
+        uint32_t tag;
+        uint32_t flags;
+        uint32_t offset;
+        uint32_t size;
+} LdsoCacheExtensionSection;
+
+_Static_assert(sizeof(LdsoCacheHeader) == 48, "LdsoCacheHeader must match glibc");
+_Static_assert(sizeof(LdsoCacheEntry) == 24, "LdsoCacheEntry must match glibc");
+
+/**
+ * Entry flags glibc would accept for this process
+ */
+#define LDSO_FLAG_ELF_LIBC6 0x0003
+#define LDSO_FLAG_X8664_LIB64 0x0300
+
+#if UINTPTR_MAX == 0xffffffffffffffff
+#define LDSO_FLAGS_WANTED(f) ((f) == (LDSO_FLAG_X8664_LIB64 | LDSO_FLAG_ELF_LIBC6))
+#else
+#define LDSO_FLAGS_WANTED(f) ((f) == LDSO_FLAG_ELF_LIBC6 || (f) == 0x0001)
+#endif
+
+/**
+ * glibc-hwcaps subdirectories, in the priority order ld.so searches them,
+ * along with the x86-64 micro-architecture level each one needs. Other
+ * architectures report level 0 and never use them.
+ */
+typedef struct LsiHwcapsSubdir {
+        const char *name;
+        unsigned int level;
+} LsiHwcapsSubdir;
+
+static const LsiHwcapsSubdir hwcaps_subdirs[] = {
+        { "x86-64-v4", 4 },
+        { "x86-64-v3", 3 },
+        { "x86-64-v2", 2 },
+};
+
+/**
+ * Host library directories for this process architecture, scanned when
+ * ld.so.cache is unavailable and probed for names it doesn't list. Order
+ * matters, first hit wins.
+ */
+static const char *library_paths[] = {
+#if UINTPTR_MAX == 0xffffffffffffffff
+        "/usr/lib64",
+        "/usr/lib/x86_64-linux-gnu",
+        "/usr/lib",
+#else
+        "/usr/lib32",
+        "/usr/lib/i386-linux-gnu",
+        "/usr/lib",
+#endif
+};
+
+/**
+ * Directories that always take priority over ld.so.cache, i.e. host driver
+ * libraries exposed into the snap which the core snap's cache knows nothing of.
+ */
+#ifdef HAVE_SNAPD_SUPPORT
+static const char *priority_paths[] = {
+#if UINTPTR_MAX == 0xffffffffffffffff
+        "/var/lib/snapd/lib/gl",
+#else
+        "/var/lib/snapd/lib/gl32",
+#endif
+};
+#endif
+
+/**
+ * Everything that can change our answers, for stamping persistent caches
+ */
+static const char *stamp_paths[] = {
+#ifdef HAVE_SNAPD_SUPPORT
+#if UINTPTR_MAX == 0xffffffffffffffff
+        "/var/lib/snapd/lib/gl",
+#else
+        "/var/lib/snapd/lib/gl32",
+#endif
+#endif
+        LDSO_CACHE_PATH,
+#if UINTPTR_MAX == 0xffffffffffffffff
+        "/usr/lib64",
+        "/usr/lib/x86_64-linux-gnu",
+        "/usr/lib",
+#else
+        "/usr/lib32",
+        "/usr/lib/i386-linux-gnu",
+        "/usr/lib",
+#endif
+};
+
+typedef struct LsiHostLibrary {
+        uint32_t hash;
+        unsigned int level; /**<Micro-architecture level of path, 0 for baseline */
+        const char *name;
+        const char *path;
+} LsiHostLibrary;
+
+static LsiHostLibrary *libraries = NULL;
+static size_t n_libraries = 0;
+static size_t n_slots = 0;
+
+/**
+ * The index is built by whichever thread gets there first, and is read-only
+ * once ready so lookups never need to synchronise.
+ */
+typedef enum {
+        LSI_RESOLVER_UNINIT = 0,
+        LSI_RESOLVER_LOADING,
+        LSI_RESOLVER_READY,
+} LsiResolverState;
+
+static atomic_int resolver_state = LSI_RESOLVER_UNINIT;
+
+/* ld.so.cache stays mapped, the index points into it */
+static void *ldso_map = NULL;
+static size_t ldso_map_size = 0;
+
+/**
+ * A library found by probing the host directories, never freed. Probes are
+ * only ever pushed onto the front of the list, so it can be walked without
+ * taking a lock.
+ */
+typedef struct LsiHostProbe {
+        struct LsiHostProbe *next;
+        const char *name;
+        char path[]; /**<Followed by the name */
+} LsiHostProbe;
+
+static _Atomic(LsiHostProbe *) probed = NULL;
+
+/* Detected once, -1 until then */
+static int hwcaps_level = -1;
+
+static inline uint32_t lsi_host_hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = s; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+static LsiHostLibrary *lsi_host_resolver_slot(LsiHostLibrary *table, size_t size, uint32_t hash,
+                                              const char *name)
+{
+        size_t mask = size - 1;
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                if (!table[i].name) {
+                        return &table[i];
+                }
+                if (table[i].hash == hash && strcmp(table[i].name, name) == 0) {
+                        return &table[i];
+                }
+        }
+}
+
+#if defined(__x86_64__)
+/**
+ * Determine the highest x86-64 micro-architecture level this CPU and kernel
+ * support, per the psABI definitions glibc uses to pick hwcaps subdirectories
+ */
+static unsigned int lsi_host_cpu_level(void)
+{
+        unsigned int eax, ebx, ecx, edx;
+        unsigned int ecx1, ebx7 = 0, ecx_ext = 0;
+        uint64_t xcr0 = 0;
+
+        if (!__get_cpuid(1, &eax, &ebx, &ecx1, &edx)) {
+                return 1;
+        }
+        if (__get_cpuid_max(0, NULL) >= 7) {
+                __cpuid_count(7, 0, eax, ebx7, ecx, edx);
+        }
+        if (__get_cpuid(0x80000001, &eax, &ebx, &ecx_ext, &edx) == 0) {
+                ecx_ext = 0;
+        }
+        if (ecx1 & bit_OSXSAVE) {
+                uint32_t lo, hi;
+                __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+                xcr0 = ((uint64_t)hi << 32) | lo;
+        }
+
+        /* CMPXCHG16B, LAHF/SAHF, POPCNT, SSE3, SSE4.1, SSE4.2, SSSE3 */
+        if (!(ecx1 & bit_CMPXCHG16B) || !(ecx_ext & bit_LAHF_LM) || !(ecx1 & bit_POPCNT) ||
+            !(ecx1 & bit_SSE3) || !(ecx1 & bit_SSE4_1) || !(ecx1 & bit_SSE4_2) ||
+            !(ecx1 & bit_SSSE3)) {
+                return 1;
+        }
+
+        /* AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE, with YMM state enabled */
+        if (!(ecx1 & bit_AVX) || !(ebx7 & bit_AVX2) || !(ebx7 & bit_BMI) || !(ebx7 & bit_BMI2) ||
+            !(ecx1 & bit_F16C) || !(ecx1 & bit_FMA) || !(ecx_ext & bit_LZCNT) ||
+            !(ecx1 & bit_MOVBE) || (xcr0 & 0x6) != 0x6) {
+                return 2;
+        }
+
+        /* AVX512F, AVX512BW, AVX512CD, AVX512DQ, AVX512VL, with ZMM state enabled */
+        if (!(ebx7 & bit_AVX512F) || !(ebx7 & bit_AVX512BW) || !(ebx7 & bit_AVX512CD) ||
+            !(ebx7 & bit_AVX512DQ) || !(ebx7 & bit_AVX512VL) || (xcr0 & 0xe6) != 0xe6) {
+                return 3;
+        }
+        return 4;
+}
+#else
+static unsigned int lsi_host_cpu_level(void)
+{
+        return 0;
+}
+#endif
+
+unsigned int lsi_host_resolver_hwcaps_level(void)
+{
+        if (hwcaps_level < 0) {
+                hwcaps_level = (int)lsi_host_cpu_level();
+        }
+        return (unsigned int)hwcaps_level;
+}
+
+/**
+ * Return the level of the hwcaps subdirectory @subdir if this CPU would
+ * search it, or 0 if ld.so would ignore it
+ */
+static unsigned int lsi_host_resolver_subdir_level(const char *subdir)
+{
+        for (size_t i = 0; i < ARRAY_SIZE(hwcaps_subdirs); i++) {
+                if (!streq(hwcaps_subdirs[i].name, subdir)) {
+                        continue;
+                }
+                if (hwcaps_subdirs[i].level <= lsi_host_resolver_hwcaps_level()) {
+                        return hwcaps_subdirs[i].level;
+                }
+                return 0;
+        }
+        return 0;
+}
+
+/**
+ * Insert @name -> @path unless @name is already known at the same or a
+ * better @level. Neither string is copied, they must remain valid for the
+ * process lifetime.
+ */
+static bool lsi_host_resolver_insert_level(const char *name, const char *path,
+                                           unsigned int level)
+{
+        LsiHostLibrary *slot = NULL;
+        uint32_t hash = lsi_host_hash(name);
+
+        if ((n_libraries + 1) * 4 > n_slots * 3) {
+                size_t new_size = n_slots ? n_slots * 2 : 1024;
+                LsiHostLibrary *table = calloc(new_size, sizeof(LsiHostLibrary));
+                if (!table) {
+                        return false;
+                }
+                for (size_t i = 0; i < n_slots; i++) {
+                        if (!libraries[i].name) {
+                                continue;
+                        }
+                        *lsi_host_resolver_slot(table, new_size, libraries[i].hash,
+                                                libraries[i].name) = libraries[i];
+                }
+                free(libraries);
+                libraries = table;
+                n_slots = new_size;
+        }
+
+        slot = lsi_host_resolver_slot(libraries, n_slots, hash, name);
+        if (slot->name) {
+                if (slot->level >= level) {
+                        return false;
+                }
+                slot->level = level;
+                slot->path = path;
+                return true;
+        }
+        slot->hash = hash;
+        slot->level = level;
+        slot->name = name;
+        slot->path = path;
+        ++n_libraries;
+        return true;
+}
+
+static inline bool lsi_host_resolver_insert(const char *name, const char *path)
+{
+        return lsi_host_resolver_insert_level(name, path, 0);
+}
+
+/**
+ * Fetch a NUL terminated string at @offset, or NULL if it runs off the end
+ */
+static inline const char *lsi_ldso_string(const char *base, size_t size, uint32_t offset)
+{
+        if (offset >= size || !memchr(base + offset, '\0', size - offset)) {
+                return NULL;
+        }
+        return base + offset;
+}
+
+/**
+ * Locate the new format header within the mapping
+ */
+static const LdsoCacheHeader *lsi_ldso_cache_header(const char *map, size_t size)
+{
+        const LdsoCacheOldHeader *old = (const LdsoCacheOldHeader *)map;
+        size_t offset = 0;
+
+        if (size >= sizeof(LdsoCacheOldHeader) &&
+            memcmp(old->magic, LDSO_CACHE_MAGIC_OLD, sizeof(old->magic)) == 0) {
+                offset = sizeof(LdsoCacheOldHeader) + (size_t)old->nlibs * sizeof(LdsoCacheOldEntry);
+
+                /* The new table is aligned to that of the writer's ABI */
+                for (size_t align = 8; align >= 4; align /= 2) {
+                        size_t aligned = (offset + align - 1) & ~(align - 1);
+                        if (aligned + sizeof(LdsoCacheHeader) <= size &&
+                            memcmp(map + aligned, LDSO_CACHE_MAGIC_NEW,
+                                   sizeof(LDSO_CACHE_MAGIC_NEW) - 1) == 0) {
+                                offset = aligned;
+                                break;
+                        }
+                }
+        }
+
+        if (offset + sizeof(LdsoCacheHeader) > size) {
+                return NULL;
+        }
+        if (memcmp(map + offset, LDSO_CACHE_MAGIC_NEW, sizeof(LDSO_CACHE_MAGIC_NEW) - 1) != 0 ||
+            memcmp(map + offset + sizeof(LDSO_CACHE_MAGIC_NEW) - 1,
+                   LDSO_CACHE_VERSION_NEW,
+                   sizeof(LDSO_CACHE_VERSION_NEW) - 1) != 0) {
+                return NULL;
+        }
+        return (const LdsoCacheHeader *)(map + offset);
+}
+
+/**
+ * Find the table of glibc-hwcaps subdirectory name offsets, if the cache
+ * has one
+ */
+static const uint32_t *lsi_ldso_cache_hwcaps(const LdsoCacheHeader *header, uint32_t *n_subdirs)
+{
+        const char *map = ldso_map;
+        const LdsoCacheExtension *ext = NULL;
+        const LdsoCacheExtensionSection *sections = NULL;
+        size_t offset = header->extension_offset;
+
+        if (offset == 0 || offset % 4 != 0 || offset + sizeof(LdsoCacheExtension) > ldso_map_size) {
+                return NULL;
+        }
+        ext = (const LdsoCacheExtension *)(map + offset);
+        if (ext->magic != LDSO_CACHE_EXTENSION_MAGIC) {
+                return NULL;
+        }
+        if ((ldso_map_size - offset - sizeof(LdsoCacheExtension)) /
+                sizeof(LdsoCacheExtensionSection) <
+            ext->count) {
+                return NULL;
+        }
+
+        sections = (const LdsoCacheExtensionSection *)(ext + 1);
+        for (uint32_t i = 0; i < ext->count; i++) {
+                if (sections[i].tag != LDSO_CACHE_EXTENSION_TAG_GLIBC_HWCAPS) {
+                        continue;
+                }
+                if (sections[i].offset % 4 != 0 || sections[i].offset > ldso_map_size ||
+                    sections[i].size > ldso_map_size - sections[i].offset) {
+                        return NULL;
+                }
+                *n_subdirs = sections[i].size / sizeof(uint32_t);
+                return (const uint32_t *)(map + sections[i].offset);
+        }
+        return NULL;
+}
+
+/**
+ * Map and index /etc/ld.so.cache for our ELF class, preferring the
+ * glibc-hwcaps variant of each library that ld.so would pick on this CPU
+ */
+static bool lsi_host_resolver_load_ldso_cache(void)
+{
+        const LdsoCacheHeader *header = NULL;
+        const LdsoCacheEntry *entries = NULL;
+        const char *base = NULL;
+        struct stat st = { 0 };
+        const uint32_t *hwcaps = NULL;
+        uint32_t n_hwcaps = 0;
+        size_t avail = 0;
+        size_t n_indexed = 0;
+        size_t n_variants = 0;
+        int fd = -1;
+
+        fd = open(LDSO_CACHE_PATH, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return false;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LdsoCacheHeader)) {
+                close(fd);
+                return false;
+        }
+        ldso_map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (ldso_map == MAP_FAILED) {
+                ldso_map = NULL;
+                return false;
+        }
+        ldso_map_size = (size_t)st.st_size;
+
+        header = lsi_ldso_cache_header(ldso_map, ldso_map_size);
+        if (!header) {
+                goto bail;
+        }
+        base = (const char *)header;
+        avail = ldso_map_size - (size_t)(base - (const char *)ldso_map);
+        if (sizeof(LdsoCacheHeader) + (size_t)header->nlibs * sizeof(LdsoCacheEntry) > avail) {
+                goto bail;
+        }
+
+        if (lsi_host_resolver_hwcaps_level() > 1) {
+                hwcaps = lsi_ldso_cache_hwcaps(header, &n_hwcaps);
+        }
+
+        entries = (const LdsoCacheEntry *)(header + 1);
+        for (uint32_t i = 0; i < header->nlibs; i++) {
+                const char *name = NULL;
+                const char *path = NULL;
+                unsigned int level = 0;
+
+                if (!LDSO_FLAGS_WANTED(entries[i].flags)) {
+                        continue;
+                }
+                if (entries[i].hwcap != 0) {
+                        const char *subdir = NULL;
+                        uint32_t index = (uint32_t)entries[i].hwcap;
+
+                        /* Legacy hwcap directories are long gone from ld.so */
+                        if ((entries[i].hwcap >> 32) != (LDSO_CACHE_HWCAP_EXTENSION >> 32)) {
+                                continue;
+                        }
+                        if (!hwcaps || index >= n_hwcaps) {
+                                continue;
+                        }
+                        subdir = lsi_ldso_string(base, avail, hwcaps[index]);
+                        if (!subdir) {
+                                continue;
+                        }
+                        level = lsi_host_resolver_subdir_level(subdir);
+                        if (level == 0) {
+                                continue;
+                        }
+                }
+                name = lsi_ldso_string(base, avail, entries[i].key);
+                path = lsi_ldso_string(base, avail, entries[i].value);
+                if (!name || !path) {
+                        continue;
+                }
+                if (lsi_host_resolver_insert_level(name, path, level) && level == 0) {
+                        ++n_indexed;
+                }
+        }
+        for (size_t i = 0; i < n_slots; i++) {
+                if (libraries[i].name && libraries[i].level > 0) {
+                        ++n_variants;
+                }
+        }
+
+        lsi_log_debug("host resolver: indexed %zu libraries from " LDSO_CACHE_PATH
+                      ", %zu using glibc-hwcaps variants",
+                      n_indexed,
+                      n_variants);
+        return true;
+
+bail:
+        munmap(ldso_map, ldso_map_size);
+        ldso_map = NULL;
+        ldso_map_size = 0;
+        return false;
+}
+
+/**
+ * One-time scan of a directory for shared libraries
+ */
+static void lsi_host_resolver_scan_dir(const char *dir, unsigned int level)
+{
+        DIR *d = opendir(dir);
+        struct dirent *ent = NULL;
+        size_t dir_len = strlen(dir);
+
+        if (!d) {
+                return;
+        }
+
+        while ((ent = readdir(d))) {
+                size_t name_len;
+                char *blob = NULL;
+
+                if (ent->d_type != DT_REG && ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN) {
+                        continue;
+                }
+                if (!strstr(ent->d_name, ".so")) {
+                        continue;
+                }
+
+                /* name\0dir/name\0 in a single allocation */
+                name_len = strlen(ent->d_name);
+                blob = malloc(name_len + 1 + dir_len + 1 + name_len + 1);
+                if (!blob) {
+                        break;
+                }
+                memcpy(blob, ent->d_name, name_len + 1);
+                sprintf(blob + name_len + 1, "%s/%s", dir, ent->d_name);
+
+                if (!lsi_host_resolver_insert_level(blob, blob + name_len + 1, level)) {
+                        free(blob);
+                }
+        }
+
+        closedir(d);
+}
+
+/**
+ * Scan @dir and then each glibc-hwcaps subdirectory of it this CPU supports
+ */
+static void lsi_host_resolver_scan_tree(const char *dir)
+{
+        lsi_host_resolver_scan_dir(dir, 0);
+
+        for (size_t i = 0; i < ARRAY_SIZE(hwcaps_subdirs); i++) {
+                const char *subdir = hwcaps_subdirs[i].name;
+                unsigned int level = lsi_host_resolver_subdir_level(subdir);
+                char path[PATH_MAX];
+
+                if (level == 0) {
+                        continue;
+                }
+                if (snprintf(path, sizeof(path), "%s/glibc-hwcaps/%s", dir, subdir) >=
+                    (int)sizeof(path)) {
+                        continue;
+                }
+                lsi_host_resolver_scan_dir(path, level);
+        }
+}
+
+static void lsi_host_resolver_load(void)
+{
+        unsigned int level = lsi_host_resolver_hwcaps_level();
+
+        if (level > 1) {
+                lsi_log_debug("host resolver: CPU supports x86-64-v%u glibc-hwcaps", level);
+        }
+
+#ifdef HAVE_SNAPD_SUPPORT
+        for (size_t i = 0; i < ARRAY_SIZE(priority_paths); i++) {
+                lsi_host_resolver_scan_dir(priority_paths[i], 0);
+        }
+#endif
+
+        if (lsi_host_resolver_load_ldso_cache()) {
+                return;
+        }
+
+        lsi_log_debug("host resolver: " LDSO_CACHE_PATH " unavailable, scanning directories");
+        for (size_t i = 0; i < ARRAY_SIZE(library_paths); i++) {
+                lsi_host_resolver_scan_tree(library_paths[i]);
+        }
+}
+
+/**
+ * Build the index exactly once, making any racing threads wait for it
+ */
+static void lsi_host_resolver_init(void)
+{
+        int expected = LSI_RESOLVER_UNINIT;
+
+        if (atomic_compare_exchange_strong(&resolver_state, &expected, LSI_RESOLVER_LOADING)) {
+                lsi_host_resolver_load();
+                atomic_store_explicit(&resolver_state, LSI_RESOLVER_READY, memory_order_release);
+                return;
+        }
+        while (atomic_load_explicit(&resolver_state, memory_order_acquire) != LSI_RESOLVER_READY) {
+                sched_yield();
+        }
+}
+
+/**
+ * ld.so.cache only lists the sonames ldconfig last saw, so development
+ * symlinks and libraries installed since are looked for in the host library
+ * directories directly, as they were before the cache was used.
+ */
+static const char *lsi_host_resolver_probe(const char *name)
+{
+        LsiHostProbe *head = atomic_load_explicit(&probed, memory_order_acquire);
+        LsiHostProbe *probe = NULL;
+        char path[PATH_MAX];
+        bool found = false;
+        size_t path_len;
+        size_t name_len;
+        int ret = 0;
+
+        for (LsiHostProbe *p = head; p; p = p->next) {
+                if (strcmp(p->name, name) == 0) {
+                        return p->path;
+                }
+        }
+        if (strchr(name, '/')) {
+                return NULL;
+        }
+
+        for (size_t i = 0; i < ARRAY_SIZE(library_paths) && !found; i++) {
+                ret = snprintf(path, sizeof(path), "%s/%s", library_paths[i], name);
+                found = ret >= 0 && (size_t)ret < sizeof(path) && lsi_file_exists(path);
+        }
+        if (!found) {
+                return NULL;
+        }
+
+        path_len = (size_t)ret;
+        name_len = strlen(name);
+        probe = malloc(sizeof(LsiHostProbe) + path_len + 1 + name_len + 1);
+        if (!probe) {
+                return NULL;
+        }
+        memcpy(probe->path, path, path_len + 1);
+        memcpy(probe->path + path_len + 1, name, name_len + 1);
+        probe->name = probe->path + path_len + 1;
+
+        /* Racing threads may both add the same name, which is harmless */
+        probe->next = head;
+        while (!atomic_compare_exchange_weak_explicit(&probed,
+                                                      &probe->next,
+                                                      probe,
+                                                      memory_order_release,
+                                                      memory_order_relaxed)) {
+        }
+        return probe->path;
+}
+
+const char *lsi_host_resolver_find(const char *name)
+{
+        LsiHostLibrary *slot = NULL;
+
+        if (atomic_load_explicit(&resolver_state, memory_order_acquire) != LSI_RESOLVER_READY) {
+                lsi_host_resolver_init();
+        }
+        if (!name) {
+                return NULL;
+        }
+
+        if (libraries) {
+                slot = lsi_host_resolver_slot(libraries, n_slots, lsi_host_hash(name), name);
+                if (slot->path) {
+                        return slot->path;
+                }
+        }
+
+        /* The directories were scanned outright if the cache wasn't usable */
+        return ldso_map ? lsi_host_resolver_probe(name) : NULL;
+}
+
+void lsi_host_resolver_foreach(LsiHostResolverFunc func, void *userdata)
+{
+        if (atomic_load_explicit(&resolver_state, memory_order_acquire) != LSI_RESOLVER_READY) {
+                lsi_host_resolver_init();
+        }
+
+        for (size_t i = 0; i < n_slots; i++) {
+                if (libraries[i].name) {
+                        func(libraries[i].name, libraries[i].path, userdata);
+                }
+        }
+}
+
+const char **lsi_host_resolver_stamp_paths(size_t *n_paths)
+{
+        *n_paths = ARRAY_SIZE(stamp_paths);
+        return stamp_paths;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
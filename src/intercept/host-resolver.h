@@ -0,0 +1,64 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+
+/**
+ * Find the host library providing @name (a basename such as "libz.so.1")
+ * for the architecture of this process.
+ *
+ * The first call builds an index from /etc/ld.so.cache, falling back to a
+ * single scan of the known host library directories if the cache is missing.
+ * Every later call is a single hash probe, except for names the cache
+ * doesn't list, which are looked for in the known host library directories.
+ *
+ * @returns The absolute path, valid for the process lifetime, or NULL
+ */
+const char *lsi_host_resolver_find(const char *name);
+
+/**
+ * Return the paths whose inode/mtime decide what the resolver would answer,
+ * suitable for stamping persistent caches.
+ */
+const char **lsi_host_resolver_stamp_paths(size_t *n_paths);
+
+/**
+ * Return the x86-64 micro-architecture level (1-4) of this CPU, which
+ * decides the glibc-hwcaps variants preferred by the resolver, or 0 where
+ * there are no such variants. Persistent caches should stamp it too, as the
+ * same cache directory may be shared by different machines.
+ */
+unsigned int lsi_host_resolver_hwcaps_level(void);
+
+typedef void (*LsiHostResolverFunc)(const char *name, const char *path, void *userdata);
+
+/**
+ * Call @func for every library the resolver knows of, in no particular order.
+ * Both strings remain valid for the process lifetime.
+ */
+void lsi_host_resolver_foreach(LsiHostResolverFunc func, void *userdata);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -11,639 +11,341 @@
 
 #define _GNU_SOURCE
 
-#include <libgen.h>
 #include <link.h>
-#include <linux/limits.h>
-#include <stdio.h>
 #include <stdlib.h>
-#include <sys/stat.h>
 
 #include "../common/common.h"
 #include "../common/files.h"
 #include "../common/log.h"
+#include "../common/process.h"
+#include "../common/stats.h"
+#include "cache.h"
+#include "capture.h"
 #include "config.h"
+#include "disk-cache.h"
+#include "host-resolver.h"
+#include "matcher.h"
+#include "plan.h"
+#include "rules-db.h"
+#include "search.h"
+#include "trace.h"
 #include "nica/util.h"
 
 /**
- * What's the known process name?
+ * First rtld-audit interface version we'll decline in order to be unloaded
  */
-static const char *matched_process = NULL;
+#define LSI_AUDIT_DETACH_VERSION 2
 
-static bool lsi_override_replace_with_host(const char *orig_name, const char **soname,
-                                           const char *msg);
-static bool lsi_override_soname(unsigned int flag, const char *orig_name, const char **soname);
+/**
+ * Set to keep the module loaded, as a passthrough, in processes it has no
+ * interest in
+ */
+#define LSI_NO_DETACH_ENV "LSI_INTERCEPT_NO_DETACH"
 
 /**
- * We support a number of modes, but we mostly exist to make Steam behave
+ * What's the known process name?
  */
-typedef enum {
-        INTERCEPT_MODE_NONE = 0,
-        INTERCEPT_MODE_STEAM,
-        INTERCEPT_MODE_VENDOR_OFFENDER,
-} InterceptMode;
+static const char *matched_process = NULL;
 
 /**
  * by default, we're not "on"
  */
 static InterceptMode work_mode = INTERCEPT_MODE_NONE;
 
-/* Patterns we'll permit Steam to privately load */
-static const char *steam_allowed[] = {
-        /* general */
-        "libicui18n.so",
-        "libicuuc.so",
-        "libavcodec.so.",
-        "libavformat.so.",
-        "libavresample.so.",
-        "libavutil.so.",
-        "libswscale.so.",
-        "libx264.so.",
-
-        /* core plugins */
-        "chromehtml.so",
-        "crashhandler.so",
-        "filesystem_stdio.so",
-        "friendsui.so",
-        "gameoverlayrenderer.so",
-        "gameoverlayui.so",
-        "libaudio.so",
-        "libmiles.so",
-        "libopenvr_api.so",
-        "liboverride.so",
-        "libsteam.so",
-        "libtier0_s.so",
-        "libv8.so",
-        "libvideo.so",
-        "libvstdlib_s.so",
-        "serverbrowser.so",
-        "steamclient.so",
-        "steamoverlayvulkanlayer.so",
-        "steamservice.so",
-        "steamui.so",
-        "vgui2_s.so",
-
-        /* big picture mode */
-        "panorama",
-        "libpangoft2-1.0.so",
-        "libpango-1.0.so",
-
-        /* steamwebhelper */
-        "libcef.so",
-
-        /* Swift shader */
-        "libGLESv2.so",
-        "libEGL.so",
-
-        /* widevine */
-        "libwidevinecdmadapter.so",
-        "libwidevinecdm.so",
-};
-
-static const char *wanted_steam_processes[] = {
-        "html5app_steam",
-        "opengl-program",
-        "steam",
-        "steamwebhelper",
-};
+/**
+ * Nothing to decide, so every search is handed straight back to ld.so
+ */
+static bool passthrough = true;
 
 /**
- * Vendor offendors should not be allowed to load replacements for libraries
- * that are KNOWN to cause issues, i.e. SDL + libstdc++
+ * All intercept rules as a single automaton, mapped from the rules database
+ * in la_version, or the tables compiled in at build time. Steam apps with a
+ * profile get their own precomputed automaton.
  */
-static const char *vendor_blacklist[] = {
-        /* base libraries being replaced will cause a C++ ABI issue when
-         * loading the mesalib drivers. */
-        "libgcc_",
-        "libstdc++",
-
-        /* Ensure we don't match weird made up cruft like "libSDL2_locale" */
-        "libSDL-1.2",
-        "libSDL2-2",
-        "libSDL2_ttf",
-        "libSDL_ttf",
-        "libSDL2_image",
-        "libSDL_image",
-        "libSDL2_mixer",
-        "libSDL_mixer",
-        "libSDL2_net",
-        "libSDL_net",
-        "libSDL2_gfx",
-        "libSDL_gfx",
-
-        /* vendor-owned */
-        "libz.so.1",
-        "libfreetype.so.6",
-        "libmpg123.so.0",
-
-        /* general problem causer. */
-        "libopenal.so.",
-
-        /* glews (provide glew + glew110 in your distro for full compat) */
-        "libGLEW.so.1.10",
-        "libGLEW.so.1.12",
-
-        /* libglu has stable soname */
-        "libGLU.so.",
-
-        /* Security sensitive libraries should not be replaced */
-        "libcurl.so.",
-
-#ifdef LSI_OVERRIDE_LIBRESSL
-        /* Sometimes libressl but this is handled separately. */
-        "libcrypto.so.",
-        "libssl.so.",
-#else
-        "libcrypto.so.1.0.0",
-        "libssl.so.1.0.0",
-#endif
-        /* TODO/FUTURE:
-        "libaudiofile.so.1", */
-};
+static const LsiAutomaton *patterns = &lsi_builtin_patterns;
 
 /**
- * Determine if we're in a given process set, i.e. the process name matches
- * the given table
+ * Games are either launched by Steam, which tags them with their app ID, or
+ * live within the Steam installation or one of its library folders. The
+ * shells and helpers the client spawns (xdg-open, zenity, crash reporters)
+ * are neither.
  */
-static bool is_in_process_set(char *process_name, const char **processes, size_t n_processes)
+static bool is_game_process(uint32_t app_id)
 {
-        /* Are we some portion of the process set? */
-        for (size_t i = 0; i < n_processes; i++) {
-                if (streq(processes[i], process_name)) {
-                        work_mode = INTERCEPT_MODE_STEAM;
-                        matched_process = processes[i];
-                        lsi_log_debug("loading libintercept for '%s'", matched_process);
-                        return true;
-                }
+        const char *exe = NULL;
+        LsiPatternMatch match;
+
+        if (app_id != 0) {
+                return true;
         }
-        return false;
+
+        /* Can't tell, so err on the side of intercepting */
+        exe = lsi_process_path();
+        if (!exe) {
+                return true;
+        }
+
+        lsi_automaton_scan(patterns, exe, &match);
+        return lsi_pattern_match_any(patterns, &match, LSI_PATTERN_STEAM_PATH) ||
+               lsi_pattern_match_any(patterns, &match, LSI_PATTERN_LIBRARY_PATH);
 }
 
 /**
  * Find out if we're being executed by a process we actually need to override,
  * otherwise we'd not be loaded by rtld-audit
  */
-static void check_is_intercept_candidate(void)
+static void check_is_intercept_candidate(uint32_t app_id)
 {
-        autofree(char) *nom = NULL;
+        const char *nom = NULL;
+        int process;
+
+        work_mode = INTERCEPT_MODE_NONE;
+        matched_process = NULL;
 
-        nom = lsi_get_process_base_name();
+        nom = lsi_process_name();
         if (!nom) {
                 return;
         }
 
-        if (is_in_process_set(nom, wanted_steam_processes, ARRAY_SIZE(wanted_steam_processes))) {
+        process = lsi_automaton_exact(patterns, LSI_PATTERN_STEAM_PROCESS, nom);
+        if (process >= 0) {
                 work_mode = INTERCEPT_MODE_STEAM;
-        } else {
+                matched_process =
+                    lsi_automaton_pattern(patterns, LSI_PATTERN_STEAM_PROCESS, process);
+                lsi_log_debug("loading libintercept for '%s'", matched_process);
+        } else if (lsi_search_is_compat_process(patterns)) {
+                work_mode = INTERCEPT_MODE_COMPAT;
+                matched_process = "compat";
+        } else if (is_game_process(app_id)) {
                 work_mode = INTERCEPT_MODE_VENDOR_OFFENDER;
                 matched_process = "vendor_offender";
+        } else {
+                return;
         }
-        lsi_log_set_id(matched_process);
-}
 
-/**
- * la_version is our main entry point and will only continue if our
- * process is explicitly Steam
- */
-_nica_public_ unsigned int la_version(unsigned int supported_version)
-{
-        /* Unfortunately glibc will die if we tell it to skip us .. */
-        check_is_intercept_candidate();
-        return supported_version;
+        /* Under the Steam runtime, Steam and the games only get the host's [hybrid-host] */
+        if (work_mode != INTERCEPT_MODE_COMPAT && getenv(LSI_HYBRID_ENV)) {
+                work_mode = work_mode == INTERCEPT_MODE_STEAM ? INTERCEPT_MODE_HYBRID_STEAM
+                                                              : INTERCEPT_MODE_HYBRID;
+        }
+        lsi_log_set_id(matched_process);
 }
 
 /**
- * lsi_search_steam handles whitelisting for the main Steam processes
+ * Whether ld.so will unload us if la_version declines every interface
+ * version. That's only relied upon from the second revision of the
+ * interface (glibc 2.35), as older releases were known to die on it, and
+ * never when somebody is watching every process via a trace or capture.
  */
-char *lsi_search_steam(unsigned int flag, const char *name)
+static bool can_detach(unsigned int supported_version)
 {
-        const char *soname = NULL;
-
-        /* Preemptively catch transmutations */
-        if (lsi_override_soname(flag, name, &soname)) {
-                return (char *)soname;
-        }
-
-        if (!lsi_file_exists(name)) {
-                return (char *)name;
+        if (supported_version < LSI_AUDIT_DETACH_VERSION) {
+                return false;
         }
-
-        /* Find out if its a Steam private lib.. These are relative "./" files too! */
-        if (name && (strstr(name, "/Steam/") || strncmp(name, "./", 2) == 0)) {
-                for (size_t i = 0; i < ARRAY_SIZE(steam_allowed); i++) {
-                        if (strstr(name, steam_allowed[i])) {
-                                return (char *)name;
-                        }
-                }
-                lsi_log_debug("blacklisted loading of vendor library: \033[34;1m%s\033[0m", name);
-                return NULL;
+        if (lsi_trace_active || lsi_capture_active) {
+                return false;
         }
-
-        return (char *)name;
+        return getenv(LSI_NO_DETACH_ENV) == NULL;
 }
 
-/**
- * Source identifier patterns that indicate a soname replacement is happening.
- * Note that this is a basic pattern match for the soname and just allows us
- * to lookup the transmute target
- */
-static const char *vendor_transmute_source[] = {
-        /* Common */
-        "libSDL2-2.0.",
-        "libSDL2_image-2.0.",
-
-        /* ".so" renames */
-        "libSDL2_ttf.so",
-        "libSDL2_image.so",
-        "libSDL2_mixer.so",
-        "libSDL2_net.so",
-        "libSDL2_gfx.so",
-
-/* libressl (security updates) */
-#ifdef LSI_OVERRIDE_LIBRESSL
-        "libcrypto.so.36",
-        "libssl.so.37",
-        "libcrypto.so.42",
-        "libssl.so.44",
-#endif
-
-        /* old name for openal */
-        "libopenal-soft.so.1",
-
-        /* invalid curls */
-        "libcurl-gnutls.so.3",
-        "libcurl.so.3",
-
-        "libbz2.so.1.0",
-
-        "libudev.so.0",
-};
+static char *lsi_objsearch_decide(const char *name, unsigned int flag, LsiTraceSource *source);
 
 /**
- * The transmute target is the intended replacement for any source name, assuming
- * that the soname doesn't identically match the currently requested soname.
- * This allows us to do on the fly replacements for re-soname'd libraries.
+ * Decisions made ahead of ld.so go through the same caches as la_objsearch
  */
-static const char *vendor_transmute_target[] = {
-        /* Common */
-        "libSDL2-2.0.so.0",
-        "libSDL2_image-2.0.so.0",
-
-        /* ".so" renames */
-        "libSDL2_ttf-2.0.so.0",
-        "libSDL2_image-2.0.so.0",
-        "libSDL2_mixer-2.0.so.0",
-        "libSDL2_net-2.0.so.0",
-        "libSDL2_gfx-1.0.so.0",
-
-/* libressl (security updates) */
-#if defined(LSI_LIBRESSL_MODE_SHIM)
-        "libcrypto" LSI_LIBRESSL_SUFFIX ".so",
-        "libssl" LSI_LIBRESSL_SUFFIX ".so",
-        "libcrypto" LSI_LIBRESSL_SUFFIX ".so",
-        "libssl" LSI_LIBRESSL_SUFFIX ".so",
-#elif defined(LSI_LIBRESSL_MODE_NATIVE)
-        "libcrypto.so.1.0.0",
-        "libssl.so.1.0.0",
-        "libcrypto.so.1.0.0",
-        "libssl.so.1.0.0",
-#endif
-
-        /* new name for openal */
-        "libopenal.so.1",
-
-        /* invalid curls */
-        "libcurl-gnutls.so.4",
-        "libcurl.so.4",
-
-        "libbz2.so.1.0.6",
-
-        "libudev.so.1",
-};
+static char *lsi_objsearch_plan(const char *name, unsigned int flag)
+{
+        LsiTraceSource source = LSI_TRACE_SOURCE_NONE;
+
+        return lsi_objsearch_decide(name, flag, &source);
+}
 
 /**
- * Every so often a game comes along that does the following:
- *
- * open("path") ? dlopen("path").
- * Except: path = "*.dll", dlopen() is transformed to ".dll.so"
- *
- * This is unrelated to the ".la" errors
+ * la_version is our main entry point and will only continue if our
+ * process is explicitly Steam
  */
-static bool lsi_override_dll_fail(const char *orig_name, const char **soname)
+_nica_public_ unsigned int la_version(unsigned int supported_version)
 {
-        size_t len = strlen(orig_name);
-        static char path_lookup[PATH_MAX];
+        uint32_t app_id = lsi_get_steam_app_id();
+        LsiRules rules = { 0 };
+
+        lsi_trace_init();
+        lsi_capture_init();
+
+        /* Most processes are settled by the builtin tables without mapping anything */
+        check_is_intercept_candidate(app_id);
+        if (work_mode == INTERCEPT_MODE_NONE && can_detach(supported_version) &&
+            !lsi_rules_db_has_local()) {
+                lsi_log_debug("detaching from %s", lsi_process_name());
+                return 0;
+        }
 
-        if (len < 7) {
-                return false;
+        lsi_rules_db_load(app_id, &rules);
+        if (rules.patterns != patterns) {
+                patterns = rules.patterns;
+                check_is_intercept_candidate(app_id);
         }
 
-        if (strncmp(orig_name + (len - 7), ".dll.so", 7) != 0) {
-                return false;
+        /* Leave uninteresting processes alone entirely where glibc lets us */
+        if (work_mode == INTERCEPT_MODE_NONE && can_detach(supported_version)) {
+                lsi_log_debug("detaching from %s", lsi_process_name());
+                patterns = &lsi_builtin_patterns;
+                lsi_rules_db_unload(&rules);
+                return 0;
         }
 
-        if (!strncpy(path_lookup, orig_name, len - 3)) {
-                return false;
+        /* Only count the lookups of processes we make decisions for */
+        passthrough = work_mode == INTERCEPT_MODE_NONE && !lsi_trace_active && !lsi_capture_active;
+        if (passthrough) {
+                return supported_version;
+        }
+        if (work_mode != INTERCEPT_MODE_NONE) {
+                lsi_stats_attach();
         }
 
-        if (!lsi_file_exists(path_lookup)) {
-                return false;
+        /* Only Steam and the games live long enough to be worth watching for */
+        lsi_file_cache_init(work_mode != INTERCEPT_MODE_NONE ? LSI_FILE_CACHE_WATCH
+                                                             : LSI_FILE_CACHE_DISABLE);
+        lsi_search_init(patterns);
+        if (work_mode != INTERCEPT_MODE_NONE) {
+                size_t n_host_paths = 0;
+                const char **host_paths = lsi_host_resolver_stamp_paths(&n_host_paths);
+                /* Upgrades change the answers just as the rules do */
+                uint64_t stamp = lsi_search_upgrades() ? ~rules.stamp : rules.stamp;
+                lsi_disk_cache_open(host_paths, n_host_paths, stamp, rules.profile);
         }
 
-        *soname = path_lookup;
-        lsi_log_debug("fixed invalid suffix dlopen() \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
-                      orig_name,
-                      path_lookup);
-        return true;
+        /* Games get their whole library closure decided before ld.so starts asking */
+        if (work_mode == INTERCEPT_MODE_VENDOR_OFFENDER) {
+                lsi_plan_prepare(lsi_objsearch_plan);
+        }
+        return supported_version;
 }
 
 /**
- * Mono games might try looking for /x86/ plugin directory for a 64-bit process,
- * as seen with testing with Project Highrise.
- *
- * This function simply redirects the dlopen to the file in the x86_64 directory,
- * if it actually exists.
- *
- * Typically this is for libCSteamWorks, libsteam_api, and Unity ScreenSelector.so
+ * Decide what to do with a single search, noting where the answer came from
  */
-#if UINTPTR_MAX == 0xffffffffffffffff
-static bool lsi_override_x86_derp(const char *orig_name, const char **soname)
+static char *lsi_objsearch_decide(const char *name, unsigned int flag, LsiTraceSource *source)
 {
-        static char path_copy[PATH_MAX];
-        static char path_lookup[PATH_MAX];
-        char *small_name = NULL;
-        char *dir = NULL;
+        char *ret = NULL;
 
-        if (!(strstr(orig_name, "/Plugins/x86/") && strstr(orig_name, ".so"))) {
-                return false;
+        if (work_mode == INTERCEPT_MODE_NONE) {
+                *source = LSI_TRACE_SOURCE_NONE;
+                return (char *)name;
         }
 
-        if (!strcpy(path_copy, orig_name)) {
-                return false;
+        /* Repeated and equivalent lookups are answered without touching disk */
+        *source = LSI_TRACE_SOURCE_MEMORY;
+        if (lsi_decision_cache_lookup(name, flag, work_mode, &ret)) {
+                return ret;
         }
 
-        small_name = basename(path_copy);
-        dir = dirname(path_copy);
-
-        if (snprintf(path_lookup, sizeof(path_lookup), "%s/../x86_64/%s", dir, small_name) < 0) {
-                return false;
+        /* Then try what previous processes learned */
+        *source = LSI_TRACE_SOURCE_DISK;
+        if (lsi_disk_cache_lookup(name, flag, work_mode, &ret)) {
+                lsi_decision_cache_store(name, flag, work_mode, ret);
+                return ret;
         }
 
-        if (!lsi_file_exists(path_lookup)) {
-                return false;
+        *source = LSI_TRACE_SOURCE_RULES;
+        ret = lsi_search_decide(work_mode, flag, name);
+        if (!lsi_search_is_cacheable(work_mode, flag, name, ret)) {
+                return ret;
         }
-
-        *soname = path_lookup;
-        lsi_log_debug(
-            "fixed invalid architecture dlopen() \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
-            orig_name,
-            path_lookup);
-        return true;
-#else
-static bool lsi_override_x86_derp(__lsi_unused__ const char *orig_name,
-                                  __lsi_unused__ const char **soname)
-{
-        /* Don't perform x86 translation on 32-bit machines */
-        return false;
-#endif
+        lsi_disk_cache_record(name, flag, work_mode, ret);
+        return lsi_decision_cache_store(name, flag, work_mode, ret);
 }
 
 /**
- * Internal helper for path replacement to host lib
+ * Account for a completed search in the session statistics
  */
-static bool lsi_override_replace_with_host(const char *orig_name, const char **soname,
-                                           const char *msg)
+static void lsi_objsearch_count(const char *name, const char *ret, LsiTraceSource source,
+                                uint64_t start)
 {
-        static char path_lookup[PATH_MAX];
-        static char path_copy[PATH_MAX];
-        char *small_name = NULL;
-        static const char *library_paths[] = {
-#if UINTPTR_MAX == 0xffffffffffffffff
-#ifdef HAVE_SNAPD_SUPPORT
-                "/var/lib/snapd/lib/gl",
-#endif
-                "/usr/lib64",
-                "/usr/lib/x86_64-linux-gnu",
-                "/usr/lib",
-#else
-#ifdef HAVE_SNAPD_SUPPORT
-                "/var/lib/snapd/lib/gl32",
-#endif
-                "/usr/lib32",
-                "/usr/lib/i386-linux-gnu",
-                "/usr/lib",
-#endif
-        };
-
-        if (!strcpy(path_copy, orig_name)) {
-                return false;
+        lsi_stats_add(LSI_STAT_HOOK_NS, lsi_stats_now() - start);
+        lsi_stats_add(LSI_STAT_LOOKUPS, 1);
+        if (source == LSI_TRACE_SOURCE_MEMORY || source == LSI_TRACE_SOURCE_DISK) {
+                lsi_stats_add(LSI_STAT_CACHE_HITS, 1);
         }
-
-        small_name = basename(path_copy);
-
-        /* Iterate all of the library paths for this process architecture and try
-         * to find a system variant of the library instead of allowing the process
-         * to dlopen() the vendored version.
-         */
-        for (size_t i = 0; i < ARRAY_SIZE(library_paths); i++) {
-                if (snprintf(path_lookup,
-                             sizeof(path_lookup),
-                             "%s/%s",
-                             library_paths[i],
-                             small_name) < 0) {
-                        return false;
-                }
-                if (!lsi_file_exists(path_lookup)) {
-                        continue;
-                }
-
-                /* We hit a match but it was identical to our expectation */
-                if (strcmp(path_lookup, orig_name) == 0) {
-                        return false;
-                }
-
-                *soname = path_lookup;
-                if (!msg) {
-                        return true;
-                }
-                lsi_log_debug("%s \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
-                              msg,
-                              orig_name,
-                              path_lookup);
-                return true;
+        if (!ret) {
+                lsi_stats_add(LSI_STAT_BLACKLISTED, 1);
+        } else if (ret != name && !streq(ret, name)) {
+                lsi_stats_add(strchr(ret, '/') ? LSI_STAT_HOST_REPLACED : LSI_STAT_TRANSMUTED, 1);
         }
-
-        return false;
 }
 
 /**
- * lsi_override_dlopen is used to override simple dlopen() requests typically
- * used by Mono games, i.e.:
- *
- * <dllmap dll="SDL2.dll" os="linux" cpu="x86-64" target="./lib64/libSDL2-2.0.so.0"/>
- *
- * We'll attempt to do a trivial lookup for "/usr/./lib64/libSDL2-2.0.so.0 in this
- * case.
+ * la_objsearch will allow us to blacklist certain LD_LIBRARY_PATH duplicate
+ * libraries being loaded by the Steam client, such as the broken libSDL shipped
+ * as a private vendored lib
  */
-static bool lsi_override_dlopen(const char *orig_name, const char **soname)
+_nica_public_ char *la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
 {
-        if (lsi_override_dll_fail(orig_name, soname)) {
-                return true;
-        }
+        LsiTraceSource source = LSI_TRACE_SOURCE_NONE;
+        uint64_t start = 0;
+        char *ret = NULL;
 
-        if (!lsi_file_exists(orig_name)) {
-                return false;
+        /* Where we couldn't detach, this is all an uninteresting process pays */
+        if (passthrough) {
+                return (char *)name;
         }
 
-        if (lsi_override_x86_derp(orig_name, soname)) {
-                return true;
+        if (lsi_capture_active) {
+                lsi_capture_search(name, flag, work_mode);
         }
-
-        return lsi_override_replace_with_host(orig_name, soname, "intercepting vendor dlopen()");
-}
-
-/**
- * lsi_override_soname will deal with LA_SER_ORIG entries, i.e. the original
- * soname request when the linker tries to load a library.
- *
- * Certain Steam games (notably Feral Interactive ports) use their own vendored
- * SDL libraries with changed sonames, which are implicitly blacklisted by the
- * lsi_blacklist_vendor function.
- *
- * As such, we intercept those renamed libraries, and convert their names back
- * to the ABI stable system libraries on the fly.
- */
-static bool lsi_override_soname(unsigned int flag, const char *orig_name, const char **soname)
-{
-        *soname = NULL;
-
-        /* We only need to deal with LA_SER_ORIG */
-        if ((flag & LA_SER_ORIG) != LA_SER_ORIG) {
-                return false;
+        if (!lsi_trace_active && !lsi_stats) {
+                return lsi_objsearch_decide(name, flag, &source);
         }
 
-        /* Don't transform dlopen */
-        if (strstr(orig_name, "/")) {
-                return lsi_override_dlopen(orig_name, soname);
+        start = lsi_trace_now();
+        ret = lsi_objsearch_decide(name, flag, &source);
+        if (lsi_trace_active) {
+                lsi_trace_search(name, ret, flag, cookie, source, start);
         }
-
-        for (size_t i = 0; i < ARRAY_SIZE(vendor_transmute_source); i++) {
-                if (!strstr(orig_name, vendor_transmute_source[i])) {
-                        continue;
-                }
-                /* Ensure we're not just replacing the same thing here as the
-                 * string would be identical, no real replacement would happen,
-                 * and ld will be confused about memory and die.
-                 */
-                if (streq(orig_name, vendor_transmute_target[i])) {
-                        continue;
-                }
-                *soname = vendor_transmute_target[i];
-                lsi_log_debug(
-                    "transforming vendor soname: \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
-                    orig_name,
-                    *soname);
-
-                return true;
+        if (lsi_stats) {
+                lsi_objsearch_count(name, ret, source, start);
         }
-
-        return false;
+        return ret;
 }
 
 /**
- * If the library exists locally, and we're attempting to load this from a
- * relative location, strongly attempt to actually use the system-version instead.
- *
- * Thus, if our CWD is our LD_LIBRARY_PATH and contains "libfreetype.so.6", we'll
- * try to use the host version of the library if that exists, instead of relying
- * on the locally vendored, potentially insecure/buggy version.
+ * The remaining rtld-audit hooks build the load timeline when tracing is
+ * enabled, and tell us when to write out the log. We never ask for symbol
+ * binding notifications.
  */
-static bool lsi_override_local(unsigned int flag, const char *orig_name, const char **soname)
+_nica_public_ unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
 {
-        *soname = NULL;
-
-        /* We only need to deal with LA_SER_ORIG */
-        if ((flag & LA_SER_ORIG) != LA_SER_ORIG) {
-                return false;
+        if (lsi_trace_active) {
+                lsi_trace_objopen(map, lmid, cookie);
         }
-
-        /* We only care about relative paths */
-        if (strstr(orig_name, "/")) {
-                return false;
-        }
-
-        /* We also only care about relative paths */
-        if (!lsi_file_exists(orig_name)) {
-                return false;
-        }
-
-        /* Resolve all paths back to the real library path version if they exist */
-        for (size_t i = 0; i < ARRAY_SIZE(vendor_blacklist); i++) {
-                if (!strstr(orig_name, vendor_blacklist[i])) {
-                        continue;
-                }
-                return lsi_override_replace_with_host(orig_name,
-                                                      soname,
-                                                      "forcing use of host library");
-        }
-
-        return false;
+        return 0;
 }
 
-char *lsi_blacklist_vendor(unsigned int flag, const char *name)
+_nica_public_ unsigned int la_objclose(uintptr_t *cookie)
 {
-        /* Find out if it exists */
-        bool file_exists = lsi_file_exists(name);
-        const char *override_soname = NULL;
-
-        /* Find out if we have to rename some libraries on the fly */
-        if (lsi_override_soname(flag, name, &override_soname)) {
-                return (char *)override_soname;
+        if (lsi_trace_active) {
+                lsi_trace_objclose(cookie);
         }
+        return 0;
+}
 
-        /* Locally exists due to directory foobar */
-        if (lsi_override_local(flag, name, &override_soname)) {
-                return (char *)override_soname;
+_nica_public_ void la_activity(uintptr_t *cookie, unsigned int flag)
+{
+        if (lsi_trace_active) {
+                lsi_trace_activity(cookie, flag);
         }
-
-        /* Find out if its a Steam private lib.. These are relative "./" files too! */
-        if (name && (strstr(name, "/Steam/") || strstr(name, "/steamapps/") ||
-                     strncmp(name, "./", 2) == 0)) {
-                for (size_t i = 0; i < ARRAY_SIZE(vendor_blacklist); i++) {
-                        if (!strstr(name, vendor_blacklist[i])) {
-                                continue;
-                        }
-
-                        if (file_exists) {
-                                lsi_log_debug(
-                                    "blacklisted loading of vendor library: \033[34;1m%s\033[0m",
-                                    name);
-                        }
-                        return NULL;
-                }
-                /* Allowed to exist */
-                return (char *)name;
+        /* Loading settled, write out what we said about it in case we exec() next */
+        if (flag == LA_ACT_CONSISTENT) {
+                lsi_log_flush();
         }
-
-        return (char *)name;
 }
 
-/**
- * la_objsearch will allow us to blacklist certain LD_LIBRARY_PATH duplicate
- * libraries being loaded by the Steam client, such as the broken libSDL shipped
- * as a private vendored lib
- */
-_nica_public_ char *la_objsearch(const char *name, __lsi_unused__ uintptr_t *cookie,
-                                 unsigned int flag)
+_nica_public_ void la_preinit(uintptr_t *cookie)
 {
-        switch (work_mode) {
-        case INTERCEPT_MODE_STEAM:
-                return lsi_search_steam(flag, name);
-        case INTERCEPT_MODE_VENDOR_OFFENDER:
-                return lsi_blacklist_vendor(flag, name);
-        case INTERCEPT_MODE_NONE:
-        default:
-                return (char *)name;
+        if (lsi_trace_active) {
+                lsi_trace_preinit(cookie);
         }
+        lsi_log_flush();
 }
 
 /*
@@ -0,0 +1,140 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "matcher.h"
+
+void lsi_automaton_scan(const LsiAutomaton *self, const char *s, LsiPatternMatch *match)
+{
+        uint32_t state = 0;
+
+        memset(match, 0, sizeof(*match));
+
+        for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+                state = self->next[state * self->n_classes + self->classes[*c]];
+                if (self->output[state] == 0) {
+                        continue;
+                }
+                const uint64_t *mask = &self->masks[self->output[state] * LSI_PATTERN_WORDS];
+                for (int i = 0; i < LSI_PATTERN_WORDS; i++) {
+                        match->bits[i] |= mask[i];
+                }
+        }
+}
+
+int lsi_pattern_match_next(const LsiAutomaton *self, const LsiPatternMatch *match,
+                           LsiPatternGroup group, int prev)
+{
+        uint32_t start = self->group_start[group];
+        uint32_t end = self->group_start[group + 1];
+
+        for (uint32_t i = start + (uint32_t)(prev + 1); i < end; i++) {
+                uint64_t word = match->bits[i / 64] >> (i % 64);
+
+                /* Skip the rest of an empty word quickly */
+                if (word == 0) {
+                        i |= 63;
+                        continue;
+                }
+                if (word & 1) {
+                        return (int)(i - start);
+                }
+        }
+        return -1;
+}
+
+int lsi_automaton_exact(const LsiAutomaton *self, LsiPatternGroup group, const char *s)
+{
+        uint32_t hash, mask;
+
+        if (self->n_exact_buckets == 0) {
+                return -1;
+        }
+
+        hash = lsi_pattern_hash(s);
+        mask = self->n_exact_buckets - 1;
+        for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+                uint32_t index = self->exact_buckets[i];
+                if (index == 0) {
+                        return -1;
+                }
+                --index;
+                if (index < self->group_start[group] || index >= self->group_start[group + 1]) {
+                        continue;
+                }
+                if (strcmp(self->strings + self->patterns[index], s) == 0) {
+                        return (int)(index - self->group_start[group]);
+                }
+        }
+}
+
+/**
+ * Return the transmute target for the pattern at absolute @index, or NULL
+ */
+static inline const char *lsi_automaton_target_at(const LsiAutomaton *self, uint32_t index)
+{
+        if (self->targets[index] == LSI_PATTERN_NO_TARGET) {
+                return NULL;
+        }
+        return self->strings + self->targets[index];
+}
+
+uint64_t lsi_automaton_stamp(const LsiAutomaton *self)
+{
+        uint64_t h = 14695981039346656037ull;
+
+        for (uint32_t i = 0; i < self->n_patterns; i++) {
+                const char *target = lsi_automaton_target_at(self, i);
+                const char *strs[] = {
+                        self->strings + self->patterns[i],
+                        target ? target : "",
+                };
+                for (size_t s = 0; s < 2; s++) {
+                        for (const char *c = strs[s]; *c; c++) {
+                                h ^= (uint8_t)*c;
+                                h *= 1099511628211ull;
+                        }
+                        h ^= 0xff;
+                        h *= 1099511628211ull;
+                }
+        }
+        for (int g = 0; g <= LSI_N_PATTERN_GROUPS; g++) {
+                h ^= self->group_start[g];
+                h *= 1099511628211ull;
+        }
+        return h;
+}
+
+const char *lsi_automaton_pattern(const LsiAutomaton *self, LsiPatternGroup group, int index)
+{
+        return self->strings + self->patterns[self->group_start[group] + (uint32_t)index];
+}
+
+const char *lsi_automaton_target(const LsiAutomaton *self, LsiPatternGroup group, int index)
+{
+        return lsi_automaton_target_at(self, self->group_start[group] + (uint32_t)index);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
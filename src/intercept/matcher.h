@@ -0,0 +1,175 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Upper bound on the number of patterns across all groups
+ */
+#define LSI_PATTERN_MAX 512
+#define LSI_PATTERN_WORDS (LSI_PATTERN_MAX / 64)
+
+/**
+ * Marks a pattern without a transmute target
+ */
+#define LSI_PATTERN_NO_TARGET 0xffffffffu
+
+/**
+ * Each group corresponds to a [section] within the rules source.
+ * Patterns are numbered contiguously per group, in source order, with an app
+ * profile's own patterns ahead of the global ones.
+ */
+typedef enum {
+        LSI_PATTERN_STEAM_ALLOWED = 0, /**<Private libraries Steam may load */
+        LSI_PATTERN_VENDOR_BLACKLIST,  /**<Vendored libraries games may not load */
+        LSI_PATTERN_VENDOR_TRANSMUTE,  /**<Vendored sonames to rename to host sonames */
+        LSI_PATTERN_STEAM_PATH,        /**<Markers for the Steam client tree */
+        LSI_PATTERN_LIBRARY_PATH,      /**<Markers for a Steam library folder */
+        LSI_PATTERN_VENDOR_ALLOWED,    /**<Vendored libraries exempt from the blacklist */
+        LSI_PATTERN_STEAM_PROCESS,     /**<Exact names of the Steam client processes */
+        LSI_PATTERN_VENDOR_UPGRADE,    /**<Vendored libraries with a faster host build */
+        LSI_PATTERN_COMPAT_PROCESS,    /**<Exact names of Wine and container tool processes */
+        LSI_PATTERN_COMPAT_PATH,       /**<Markers for Proton and runtime installs */
+        LSI_PATTERN_HYBRID_HOST,       /**<Libraries always taken from the host in hybrid mode */
+        LSI_N_PATTERN_GROUPS,
+} LsiPatternGroup;
+
+/**
+ * Exact match groups aren't part of the automaton, they're looked up
+ * through the exact_buckets hash index instead.
+ */
+static inline bool lsi_pattern_group_is_exact(LsiPatternGroup group)
+{
+        return group == LSI_PATTERN_STEAM_PROCESS || group == LSI_PATTERN_COMPAT_PROCESS;
+}
+
+/**
+ * A compiled Aho-Corasick automaton over every pattern group.
+ *
+ * Everything is expressed as flat arrays and string offsets so the same
+ * structure can describe static const tables emitted at build time, or
+ * a read-only mapping of a compiled rules file.
+ */
+typedef struct LsiAutomaton {
+        uint32_t n_states;
+        uint32_t n_classes;
+        uint32_t n_outputs;
+        uint32_t n_patterns;
+        uint32_t n_exact_buckets;
+        const uint8_t *classes;       /**<[256] byte to input class */
+        const uint16_t *next;         /**<[n_states * n_classes] full DFA transitions */
+        const uint16_t *output;       /**<[n_states] index into masks, 0 when nothing matches */
+        const uint64_t *masks;        /**<[n_outputs * LSI_PATTERN_WORDS] matched pattern sets */
+        const uint32_t *group_start;  /**<[LSI_N_PATTERN_GROUPS + 1] first pattern per group */
+        const uint32_t *patterns;     /**<[n_patterns] offset into strings */
+        const uint32_t *targets;      /**<[n_patterns] offset into strings or NO_TARGET */
+        const uint32_t *exact_buckets; /**<[n_exact_buckets] pattern index + 1, 0 when empty */
+        const char *strings;
+} LsiAutomaton;
+
+/**
+ * Every pattern that occurred somewhere within the scanned string
+ */
+typedef struct LsiPatternMatch {
+        uint64_t bits[LSI_PATTERN_WORDS];
+} LsiPatternMatch;
+
+/**
+ * Rules specific to a single Steam application
+ */
+typedef struct LsiAppProfile {
+        uint32_t app_id;
+        const LsiAutomaton *patterns;
+} LsiAppProfile;
+
+/**
+ * Tables compiled from patterns.rules at build time
+ */
+extern const LsiAutomaton lsi_builtin_patterns;
+
+/**
+ * Per-app tables compiled from patterns.rules, sorted by app ID and
+ * terminated by an entry with a NULL automaton
+ */
+extern const LsiAppProfile lsi_builtin_profiles[];
+
+/**
+ * Classify @s against all pattern groups in a single pass
+ */
+void lsi_automaton_scan(const LsiAutomaton *self, const char *s, LsiPatternMatch *match);
+
+/**
+ * Find the next matching pattern within @group after index @prev (use -1 to
+ * start from the beginning), returning its index within the group or -1.
+ */
+int lsi_pattern_match_next(const LsiAutomaton *self, const LsiPatternMatch *match,
+                           LsiPatternGroup group, int prev);
+
+/**
+ * Determine if any pattern within @group matched
+ */
+static inline bool lsi_pattern_match_any(const LsiAutomaton *self, const LsiPatternMatch *match,
+                                         LsiPatternGroup group)
+{
+        return lsi_pattern_match_next(self, match, group, -1) >= 0;
+}
+
+/**
+ * Look up @s within an exact match @group, returning its index or -1
+ */
+int lsi_automaton_exact(const LsiAutomaton *self, LsiPatternGroup group, const char *s);
+
+/**
+ * Hash used for the exact_buckets index
+ */
+static inline uint32_t lsi_pattern_hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = s; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+/**
+ * Fingerprint the pattern set so persistent caches notice rule changes
+ */
+uint64_t lsi_automaton_stamp(const LsiAutomaton *self);
+
+/**
+ * Return the source text for pattern @index within @group
+ */
+const char *lsi_automaton_pattern(const LsiAutomaton *self, LsiPatternGroup group, int index);
+
+/**
+ * Return the transmute target for pattern @index within @group, or NULL
+ */
+const char *lsi_automaton_target(const LsiAutomaton *self, LsiPatternGroup group, int index);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
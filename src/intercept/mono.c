@@ -0,0 +1,609 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <linux/limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "../common/process.h"
+#include "arena.h"
+#include "mono.h"
+#include "nica/util.h"
+
+/**
+ * Number of slots in the index, must be a power of two. Even plugin heavy
+ * Unity titles only ship a few dozen native libraries.
+ */
+#define LSI_MONO_SLOTS 1024
+
+/**
+ * Mono's names for this process, as matched against dllmap attributes
+ */
+#if UINTPTR_MAX == 0xffffffffffffffff
+#define LSI_MONO_CPU "x86-64"
+#define LSI_MONO_WORDSIZE "64"
+static const char *plugin_dirs[] = { "x86_64", "lib64" };
+#else
+#define LSI_MONO_CPU "x86"
+#define LSI_MONO_WORDSIZE "32"
+static const char *plugin_dirs[] = { "x86", "lib" };
+#endif
+
+typedef struct LsiMonoLibrary {
+        uint32_t hash;
+        const char *stem; /**<Name with the "lib" prefix and library suffixes removed */
+        const char *path; /**<What the probe should load instead */
+} LsiMonoLibrary;
+
+static LsiMonoLibrary libraries[LSI_MONO_SLOTS];
+static size_t n_libraries = 0;
+static size_t n_dllmaps = 0;
+
+typedef enum {
+        LSI_MONO_UNINIT = 0,
+        LSI_MONO_LOADING,
+        LSI_MONO_READY,
+} LsiMonoState;
+
+static atomic_int mono_state = LSI_MONO_UNINIT;
+
+static inline uint32_t lsi_mono_hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+
+        for (const char *c = s; *c; c++) {
+                h ^= (uint8_t)*c;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+static inline bool lsi_mono_has_suffix(const char *s, size_t len, const char *suffix)
+{
+        size_t suffix_len = strlen(suffix);
+
+        return len >= suffix_len && strncmp(s + len - suffix_len, suffix, suffix_len) == 0;
+}
+
+/**
+ * Reduce any of the names Mono would try for a DllImport down to the name
+ * given to DllImport, i.e. "/x/libfoo.dll.so" -> "foo"
+ *
+ * @returns False if @name can't be a probe
+ */
+static bool lsi_mono_stem(const char *name, char *stem, size_t size)
+{
+        const char *base = strrchr(name, '/');
+        size_t len;
+
+        base = base ? base + 1 : name;
+
+        /* Versioned sonames are specific requests, not guesses */
+        if (strstr(base, ".so.")) {
+                return false;
+        }
+
+        len = strlen(base);
+        if (lsi_mono_has_suffix(base, len, ".so")) {
+                len -= 3;
+        }
+        if (lsi_mono_has_suffix(base, len, ".dll")) {
+                len -= 4;
+        }
+        if (len > 3 && strncmp(base, "lib", 3) == 0) {
+                base += 3;
+                len -= 3;
+        }
+        if (len == 0 || len >= size) {
+                return false;
+        }
+
+        memcpy(stem, base, len);
+        stem[len] = '\0';
+        return true;
+}
+
+static LsiMonoLibrary *lsi_mono_slot(uint32_t hash, const char *stem)
+{
+        size_t mask = LSI_MONO_SLOTS - 1;
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                if (!libraries[i].stem) {
+                        return &libraries[i];
+                }
+                if (libraries[i].hash == hash && strcmp(libraries[i].stem, stem) == 0) {
+                        return &libraries[i];
+                }
+        }
+}
+
+/**
+ * Record @path as the answer for every probe of @name. The first insertion
+ * of a name wins, so callers go from most to least specific.
+ */
+static bool lsi_mono_insert(const char *name, const char *path)
+{
+        char stem[NAME_MAX + 1];
+        LsiMonoLibrary *slot = NULL;
+        uint32_t hash;
+
+        if (!lsi_mono_stem(name, stem, sizeof(stem))) {
+                return false;
+        }
+
+        /* Keep the table sparse enough that probing stays short */
+        if ((n_libraries + 1) * 4 > LSI_MONO_SLOTS * 3) {
+                return false;
+        }
+
+        hash = lsi_mono_hash(stem);
+        slot = lsi_mono_slot(hash, stem);
+        if (slot->stem) {
+                return false;
+        }
+
+        slot->path = lsi_arena_intern(path);
+        slot->stem = lsi_arena_intern(stem);
+        if (!slot->path || !slot->stem) {
+                slot->stem = NULL;
+                return false;
+        }
+        slot->hash = hash;
+        n_libraries++;
+        return true;
+}
+
+/**
+ * Index the unversioned shared objects within @dir, which is where Mono
+ * and Unity look for native plugins
+ */
+static void lsi_mono_scan_libraries(const char *dir)
+{
+        char path[PATH_MAX];
+        DIR *d = NULL;
+        struct dirent *ent = NULL;
+
+        d = opendir(dir);
+        if (!d) {
+                return;
+        }
+
+        while ((ent = readdir(d)) != NULL) {
+                size_t len = strlen(ent->d_name);
+                int ret;
+
+                if (ent->d_name[0] == '.' || !lsi_mono_has_suffix(ent->d_name, len, ".so")) {
+                        continue;
+                }
+                ret = snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+                if (ret < 0 || (size_t)ret >= sizeof(path)) {
+                        continue;
+                }
+                lsi_mono_insert(ent->d_name, path);
+        }
+
+        closedir(d);
+}
+
+/**
+ * Determine if a comma separated dllmap os/cpu attribute admits @want.
+ * A leading '!' inverts the whole list, as it does within Mono.
+ */
+static bool lsi_mono_attr_matches(const char *value, const char *want)
+{
+        bool invert = false;
+        size_t want_len = strlen(want);
+        bool found = false;
+
+        if (!value) {
+                return true;
+        }
+        if (*value == '!') {
+                invert = true;
+                value++;
+        }
+
+        for (const char *c = value; *c;) {
+                size_t len = strcspn(c, ",");
+                if (len == want_len && strncasecmp(c, want, len) == 0) {
+                        found = true;
+                        break;
+                }
+                c += len;
+                if (*c == ',') {
+                        c++;
+                }
+        }
+
+        return found != invert;
+}
+
+typedef struct LsiMonoDllmap {
+        char *dll;
+        char *target;
+        char *os;
+        char *cpu;
+        char *wordsize;
+} LsiMonoDllmap;
+
+/**
+ * Split the attributes of a single <dllmap .../> tag, in place, stopping at
+ * the end of the tag. Unknown attributes are ignored.
+ *
+ * @returns Pointer just beyond the tag
+ */
+static char *lsi_mono_parse_dllmap(char *s, LsiMonoDllmap *map)
+{
+        memset(map, 0, sizeof(*map));
+
+        for (;;) {
+                char *name = NULL;
+                char *value = NULL;
+                size_t name_len;
+                char quote;
+
+                s += strspn(s, " \t\r\n");
+                if (!*s || *s == '>' || *s == '/') {
+                        break;
+                }
+
+                name = s;
+                name_len = strcspn(s, " \t\r\n=/>");
+                s += name_len;
+                s += strspn(s, " \t\r\n");
+                if (*s != '=') {
+                        continue;
+                }
+                s++;
+                s += strspn(s, " \t\r\n");
+                quote = *s;
+                if (quote != '"' && quote != '\'') {
+                        break;
+                }
+                value = ++s;
+                s = strchr(s, quote);
+                if (!s) {
+                        s = value + strlen(value);
+                        break;
+                }
+                *s++ = '\0';
+
+                if (name_len == 3 && strncmp(name, "dll", 3) == 0) {
+                        map->dll = value;
+                } else if (name_len == 6 && strncmp(name, "target", 6) == 0) {
+                        map->target = value;
+                } else if (name_len == 2 && strncmp(name, "os", 2) == 0) {
+                        map->os = value;
+                } else if (name_len == 3 && strncmp(name, "cpu", 3) == 0) {
+                        map->cpu = value;
+                } else if (name_len == 8 && strncmp(name, "wordsize", 8) == 0) {
+                        map->wordsize = value;
+                }
+        }
+
+        s = strchr(s, '>');
+        return s ? s + 1 : NULL;
+}
+
+/**
+ * Index a dllmap that applies to this process, with relative targets made
+ * absolute against @dir as Mono does for the owning assembly
+ */
+static void lsi_mono_add_dllmap(const char *dir, const LsiMonoDllmap *map)
+{
+        char path[PATH_MAX];
+        autofree(char) *real_path = NULL;
+        const char *dll = map->dll;
+        int ret;
+
+        if (!dll || !map->target || !*map->target) {
+                return;
+        }
+        if (!lsi_mono_attr_matches(map->os, "linux") ||
+            !lsi_mono_attr_matches(map->cpu, LSI_MONO_CPU) ||
+            (map->wordsize && !streq(map->wordsize, LSI_MONO_WORDSIZE))) {
+                return;
+        }
+
+        /* "i:" only asks for case insensitive matching */
+        if (strncmp(dll, "i:", 2) == 0) {
+                dll += 2;
+        }
+
+        /* Bare targets are left for ld.so to find */
+        if (map->target[0] == '/' || !strchr(map->target, '/')) {
+                if (lsi_mono_insert(dll, map->target)) {
+                        n_dllmaps++;
+                }
+                return;
+        }
+
+        /* i.e. "./lib64/libSDL2-2.0.so.0" */
+        ret = snprintf(path, sizeof(path), "%s/%s", dir, map->target);
+        if (ret < 0 || (size_t)ret >= sizeof(path)) {
+                return;
+        }
+        real_path = lsi_file_realpath(path);
+        if (!real_path) {
+                return;
+        }
+        if (lsi_mono_insert(dll, real_path)) {
+                n_dllmaps++;
+        }
+}
+
+/**
+ * Index every applicable <dllmap> within the config file at @path
+ */
+static void lsi_mono_parse_config(const char *dir, const char *path)
+{
+        FILE *fp = NULL;
+        char *buf = NULL;
+        size_t len;
+        char *c = NULL;
+
+        fp = fopen(path, "re");
+        if (!fp) {
+                return;
+        }
+
+        buf = malloc(LSI_MONO_CONFIG_MAX + 1);
+        if (!buf) {
+                goto end;
+        }
+        len = fread(buf, 1, LSI_MONO_CONFIG_MAX, fp);
+        buf[len] = '\0';
+
+        for (c = buf; c && *c;) {
+                char *tag = strstr(c, "<dllmap");
+                char *comment = strstr(c, "<!--");
+                LsiMonoDllmap map;
+
+                if (!tag) {
+                        break;
+                }
+
+                /* Commented out mappings don't count */
+                if (comment && comment < tag) {
+                        c = strstr(comment + 4, "-->");
+                        c = c ? c + 3 : NULL;
+                        continue;
+                }
+
+                c = lsi_mono_parse_dllmap(tag + 7, &map);
+                lsi_mono_add_dllmap(dir, &map);
+        }
+
+end:
+        free(buf);
+        if (fp) {
+                fclose(fp);
+        }
+}
+
+/**
+ * Parse the assembly and executable configs within @dir
+ */
+static void lsi_mono_scan_configs(const char *dir)
+{
+        char path[PATH_MAX];
+        DIR *d = NULL;
+        struct dirent *ent = NULL;
+
+        d = opendir(dir);
+        if (!d) {
+                return;
+        }
+
+        while ((ent = readdir(d)) != NULL) {
+                size_t len = strlen(ent->d_name);
+                int ret;
+
+                if (!lsi_mono_has_suffix(ent->d_name, len, ".dll.config") &&
+                    !lsi_mono_has_suffix(ent->d_name, len, ".exe.config")) {
+                        continue;
+                }
+                ret = snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+                if (ret < 0 || (size_t)ret >= sizeof(path)) {
+                        continue;
+                }
+                lsi_mono_parse_config(dir, path);
+        }
+
+        closedir(d);
+}
+
+/**
+ * Index the plugins and configs of the Unity data directory @data
+ */
+static void lsi_mono_scan_unity(const char *data)
+{
+        char path[PATH_MAX];
+        int ret;
+
+        for (size_t i = 0; i < ARRAY_SIZE(plugin_dirs); i++) {
+                ret = snprintf(path, sizeof(path), "%s/Plugins/%s", data, plugin_dirs[i]);
+                if (ret > 0 && (size_t)ret < sizeof(path)) {
+                        lsi_mono_scan_libraries(path);
+                }
+        }
+        ret = snprintf(path, sizeof(path), "%s/Plugins", data);
+        if (ret > 0 && (size_t)ret < sizeof(path)) {
+                lsi_mono_scan_libraries(path);
+        }
+        ret = snprintf(path, sizeof(path), "%s/Managed", data);
+        if (ret > 0 && (size_t)ret < sizeof(path)) {
+                lsi_mono_scan_configs(path);
+        }
+
+        /* Unity's own copy of Mono's global dllmaps */
+        ret = snprintf(path, sizeof(path), "%s/Mono/etc/mono", data);
+        if (ret > 0 && (size_t)ret < sizeof(path)) {
+                char config[PATH_MAX];
+                ret = snprintf(config, sizeof(config), "%s/config", path);
+                if (ret > 0 && (size_t)ret < sizeof(config)) {
+                        lsi_mono_parse_config(path, config);
+                }
+        }
+}
+
+/**
+ * Index a game directory, be it a Unity player (Game_Data/) or a Mono/FNA
+ * style layout with lib64/ and *.dll.config next to the assemblies
+ */
+static void lsi_mono_scan_root(const char *root)
+{
+        char path[PATH_MAX];
+        DIR *d = NULL;
+        struct dirent *ent = NULL;
+        int ret;
+
+        d = opendir(root);
+        if (!d) {
+                return;
+        }
+        while ((ent = readdir(d)) != NULL) {
+                size_t len = strlen(ent->d_name);
+
+                if (ent->d_name[0] == '.' || !lsi_mono_has_suffix(ent->d_name, len, "_Data")) {
+                        continue;
+                }
+                ret = snprintf(path, sizeof(path), "%s/%s", root, ent->d_name);
+                if (ret > 0 && (size_t)ret < sizeof(path)) {
+                        lsi_mono_scan_unity(path);
+                }
+        }
+        closedir(d);
+
+        for (size_t i = 0; i < ARRAY_SIZE(plugin_dirs); i++) {
+                ret = snprintf(path, sizeof(path), "%s/%s", root, plugin_dirs[i]);
+                if (ret > 0 && (size_t)ret < sizeof(path)) {
+                        lsi_mono_scan_libraries(path);
+                }
+        }
+        lsi_mono_scan_libraries(root);
+        lsi_mono_scan_configs(root);
+}
+
+/**
+ * Only ever index directories inside a Steam library
+ */
+static bool lsi_mono_is_game_dir(const LsiAutomaton *patterns, const char *dir)
+{
+        char path[PATH_MAX];
+        LsiPatternMatch match;
+        int ret;
+
+        ret = snprintf(path, sizeof(path), "%s/", dir);
+        if (ret < 0 || (size_t)ret >= sizeof(path)) {
+                return false;
+        }
+        lsi_automaton_scan(patterns, path, &match);
+        return lsi_pattern_match_any(patterns, &match, LSI_PATTERN_LIBRARY_PATH);
+}
+
+/**
+ * Games are either the executable itself, or run through a system mono
+ * from within the game directory
+ */
+static void lsi_mono_load(const LsiAutomaton *patterns)
+{
+        const char *exe = lsi_process_path();
+        char exe_dir[PATH_MAX] = { 0 };
+        char cwd[PATH_MAX];
+
+        if (exe && strlen(exe) < sizeof(exe_dir)) {
+                char *slash = NULL;
+                strcpy(exe_dir, exe);
+                slash = strrchr(exe_dir, '/');
+                if (slash) {
+                        *slash = '\0';
+                }
+                if (lsi_mono_is_game_dir(patterns, exe_dir)) {
+                        lsi_mono_scan_root(exe_dir);
+                }
+        }
+
+        if (getcwd(cwd, sizeof(cwd)) && !streq(cwd, exe_dir) &&
+            lsi_mono_is_game_dir(patterns, cwd)) {
+                lsi_mono_scan_root(cwd);
+        }
+
+        lsi_log_debug("mono: indexed %zu native libraries, %zu from dllmaps",
+                      n_libraries,
+                      n_dllmaps);
+}
+
+/**
+ * Build the index exactly once, making any racing threads wait for it
+ */
+static void lsi_mono_init(const LsiAutomaton *patterns)
+{
+        int expected = LSI_MONO_UNINIT;
+
+        if (atomic_compare_exchange_strong(&mono_state, &expected, LSI_MONO_LOADING)) {
+                lsi_mono_load(patterns);
+                atomic_store_explicit(&mono_state, LSI_MONO_READY, memory_order_release);
+                return;
+        }
+        while (atomic_load_explicit(&mono_state, memory_order_acquire) != LSI_MONO_READY) {
+                sched_yield();
+        }
+}
+
+const char *lsi_mono_resolve(const LsiAutomaton *patterns, const char *name)
+{
+        char stem[NAME_MAX + 1];
+        const LsiMonoLibrary *slot = NULL;
+
+        if (!name || !lsi_mono_stem(name, stem, sizeof(stem))) {
+                return NULL;
+        }
+
+        if (atomic_load_explicit(&mono_state, memory_order_acquire) != LSI_MONO_READY) {
+                lsi_mono_init(patterns);
+        }
+        if (n_libraries == 0) {
+                return NULL;
+        }
+
+        slot = lsi_mono_slot(lsi_mono_hash(stem), stem);
+        if (!slot->path || streq(slot->path, name)) {
+                return NULL;
+        }
+        return slot->path;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,53 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include "matcher.h"
+
+/**
+ * Upper bound on the size of a single .config file we'll parse for dllmaps
+ */
+#define LSI_MONO_CONFIG_MAX (1024 * 1024)
+
+/**
+ * Map a Mono or Unity P/Invoke probe to the library it will eventually load.
+ *
+ * For every DllImport("foo") Mono tries "foo", "libfoo", "foo.so",
+ * "libfoo.so", "foo.dll" and friends, in each of several directories, until
+ * one of them loads. The game's native plugin directories and the dllmap
+ * entries of its *.config files are indexed once, on the first probe shaped
+ * request, so every variant of "foo" can be answered with the final path
+ * immediately.
+ *
+ * Only games installed within a Steam library (per [library-path] in
+ * @patterns) are indexed. Versioned sonames are never probes and are
+ * rejected without touching the index.
+ *
+ * @returns The resolved library, valid for the process lifetime, or NULL if
+ * @name isn't a probe we know the answer to
+ */
+const char *lsi_mono_resolve(const LsiAutomaton *patterns, const char *name);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,495 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "host-resolver.h"
+#include "matcher.h"
+#include "overlay.h"
+#include "nica/files.h"
+#include "nica/util.h"
+
+/**
+ * ELF class of this process, and so of the overlay we're able to build
+ */
+#define LSI_OVERLAY_CLASS ((unsigned int)(sizeof(void *) * 8))
+
+/**
+ * Symlink within each class directory whose target is the stamp it was
+ * built from. The current stamp still takes a stat() of every host library
+ * directory to compute, comparing the two then costs a single readlink().
+ */
+#define LSI_OVERLAY_STAMP ".stamp"
+
+/**
+ * Serialises builders for both classes, within the root
+ */
+#define LSI_OVERLAY_LOCK ".lock"
+
+/**
+ * Bumped whenever the same rules would produce a different overlay
+ */
+#define LSI_OVERLAY_VERSION 2
+
+/**
+ * A link the overlay should contain
+ */
+typedef struct LsiOverlayLink {
+        char *name;
+        char *target;
+        size_t order;  /**<Earlier rules win for the same name */
+        bool present;  /**<Already in place with the right target */
+} LsiOverlayLink;
+
+/**
+ * State for bringing a single class directory up to date
+ */
+typedef struct LsiOverlayBuild {
+        const LsiAutomaton *patterns;
+        const LsiRules *rules;
+        LsiOverlayLink *links;
+        size_t n_links;
+        size_t n_alloc;
+} LsiOverlayBuild;
+
+static inline uint64_t lsi_overlay_mix(uint64_t h, uint64_t v)
+{
+        for (int i = 0; i < 8; i++) {
+                h ^= (v >> (i * 8)) & 0xff;
+                h *= 1099511628211ull;
+        }
+        return h;
+}
+
+/**
+ * Identify the rules, host library directories and CPU level, exactly as
+ * the persistent decision cache does
+ */
+static uint64_t lsi_overlay_stamp(uint64_t rules_stamp)
+{
+        size_t n_paths = 0;
+        const char **paths = lsi_host_resolver_stamp_paths(&n_paths);
+        uint64_t stamp = lsi_overlay_mix(14695981039346656037ull, rules_stamp);
+
+        stamp = lsi_overlay_mix(stamp, LSI_OVERLAY_VERSION);
+        stamp = lsi_overlay_mix(stamp, lsi_host_resolver_hwcaps_level());
+
+        for (size_t i = 0; i < n_paths; i++) {
+                struct stat st = { 0 };
+                if (stat(paths[i], &st) != 0) {
+                        stamp = lsi_overlay_mix(stamp, 0);
+                        continue;
+                }
+                stamp = lsi_overlay_mix(stamp, (uint64_t)st.st_dev);
+                stamp = lsi_overlay_mix(stamp, (uint64_t)st.st_ino);
+                stamp = lsi_overlay_mix(stamp, (uint64_t)st.st_mtim.tv_sec);
+                stamp = lsi_overlay_mix(stamp, (uint64_t)st.st_mtim.tv_nsec);
+        }
+        return stamp;
+}
+
+/**
+ * Determine if @dir was built from the same state as @stamp
+ */
+static bool lsi_overlay_is_current(const char *dir, uint64_t stamp)
+{
+        char path[PATH_MAX];
+        char want[17];
+        char have[17];
+        ssize_t len;
+
+        if (snprintf(path, sizeof(path), "%s/%s", dir, LSI_OVERLAY_STAMP) >= (int)sizeof(path)) {
+                return false;
+        }
+        len = readlink(path, have, sizeof(have));
+        if (len != 16) {
+                return false;
+        }
+        snprintf(want, sizeof(want), "%016" PRIx64, stamp);
+        return strncmp(have, want, 16) == 0;
+}
+
+/**
+ * Atomically point @name within @dir_fd at @target, replacing whatever was
+ * there, so a running game never finds the name missing
+ */
+static bool lsi_overlay_replace(int dir_fd, const char *name, const char *target)
+{
+        autofree(char) *tmp = NULL;
+
+        if (asprintf(&tmp, ".%s.new", name) < 0) {
+                return false;
+        }
+        unlinkat(dir_fd, tmp, 0);
+        if (symlinkat(target, dir_fd, tmp) != 0) {
+                return false;
+        }
+        if (renameat(dir_fd, tmp, dir_fd, name) != 0) {
+                unlinkat(dir_fd, tmp, 0);
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Want @name linked to @target, unless an earlier rule already claimed
+ * @name, as it would have won within la_objsearch too
+ */
+static void lsi_overlay_want(LsiOverlayBuild *build, const char *name, const char *target)
+{
+        LsiOverlayLink *link = NULL;
+
+        if (strchr(name, '/') || name[0] == '.') {
+                return;
+        }
+        if (build->n_links == build->n_alloc) {
+                size_t n_alloc = build->n_alloc ? build->n_alloc * 2 : 64;
+                LsiOverlayLink *links = realloc(build->links, n_alloc * sizeof(LsiOverlayLink));
+                if (!links) {
+                        return;
+                }
+                build->links = links;
+                build->n_alloc = n_alloc;
+        }
+        link = &build->links[build->n_links];
+        link->name = strdup(name);
+        link->target = strdup(target);
+        if (!link->name || !link->target) {
+                free(link->name);
+                free(link->target);
+                return;
+        }
+        link->order = build->n_links++;
+        link->present = false;
+}
+
+static int lsi_overlay_link_compare_name(const void *a, const void *b)
+{
+        const LsiOverlayLink *la = a;
+        const LsiOverlayLink *lb = b;
+
+        return strcmp(la->name, lb->name);
+}
+
+static int lsi_overlay_link_compare(const void *a, const void *b)
+{
+        const LsiOverlayLink *la = a;
+        const LsiOverlayLink *lb = b;
+        int ret = lsi_overlay_link_compare_name(a, b);
+
+        if (ret != 0) {
+                return ret;
+        }
+        return la->order < lb->order ? -1 : la->order > lb->order;
+}
+
+/**
+ * Sort the wanted links by name, keeping only the first claim on each
+ */
+static void lsi_overlay_settle(LsiOverlayBuild *build)
+{
+        size_t n = 0;
+
+        if (build->n_links == 0) {
+                return;
+        }
+        qsort(build->links, build->n_links, sizeof(LsiOverlayLink), lsi_overlay_link_compare);
+        for (size_t i = 0; i < build->n_links; i++) {
+                if (n > 0 && streq(build->links[n - 1].name, build->links[i].name)) {
+                        free(build->links[i].name);
+                        free(build->links[i].target);
+                        continue;
+                }
+                build->links[n++] = build->links[i];
+        }
+        build->n_links = n;
+}
+
+static LsiOverlayLink *lsi_overlay_find(LsiOverlayBuild *build, const char *name)
+{
+        LsiOverlayLink key = { .name = (char *)name };
+
+        if (build->n_links == 0) {
+                return NULL;
+        }
+        return bsearch(&key,
+                       build->links,
+                       build->n_links,
+                       sizeof(LsiOverlayLink),
+                       lsi_overlay_link_compare_name);
+}
+
+static void lsi_overlay_build_free(LsiOverlayBuild *build)
+{
+        for (size_t i = 0; i < build->n_links; i++) {
+                free(build->links[i].name);
+                free(build->links[i].target);
+        }
+        free(build->links);
+}
+
+/**
+ * Complete sonames being transmuted are linked to the host library they
+ * would be renamed to. Substring patterns like "libSDL2-2.0." can't be
+ * named within a directory and are left to the dlopen() hook.
+ */
+static void lsi_overlay_want_transmutes(LsiOverlayBuild *build)
+{
+        const LsiPatternGroup group = LSI_PATTERN_VENDOR_TRANSMUTE;
+        const LsiAutomaton *patterns = build->patterns;
+        int n_patterns = (int)(patterns->group_start[group + 1] - patterns->group_start[group]);
+
+        for (int i = 0; i < n_patterns; i++) {
+                const char *source = lsi_automaton_pattern(patterns, group, i);
+                const char *target = lsi_automaton_target(patterns, group, i);
+                const char *host_path = NULL;
+                size_t len = strlen(source);
+
+                if (!target || len == 0 || source[len - 1] == '.' || !strstr(source, ".so")) {
+                        continue;
+                }
+                if (streq(source, target)) {
+                        continue;
+                }
+                host_path = lsi_host_resolver_find(target);
+                if (host_path) {
+                        lsi_overlay_want(build, source, host_path);
+                }
+        }
+}
+
+/**
+ * A host library considered for the overlay, and whether some app profile
+ * exempts it from the blacklist
+ */
+typedef struct LsiOverlayCandidate {
+        const char *name;
+        bool allowed;
+} LsiOverlayCandidate;
+
+static void lsi_overlay_check_profile(__lsi_unused__ uint32_t app_id, const LsiAutomaton *patterns,
+                                      void *userdata)
+{
+        LsiOverlayCandidate *candidate = userdata;
+        LsiPatternMatch match;
+
+        if (candidate->allowed) {
+                return;
+        }
+        lsi_automaton_scan(patterns, candidate->name, &match);
+        candidate->allowed = lsi_pattern_match_any(patterns, &match, LSI_PATTERN_VENDOR_ALLOWED);
+}
+
+/**
+ * Host libraries matching the vendor blacklist are linked under their own
+ * name, so they're found ahead of any vendored copy. The overlay is shared
+ * by every game, so a library any app profile allows it to vendor is left
+ * out, and its copy is found as usual.
+ */
+static void lsi_overlay_want_host(const char *name, const char *path, void *userdata)
+{
+        LsiOverlayBuild *build = userdata;
+        LsiOverlayCandidate candidate = { .name = name };
+        LsiPatternMatch match;
+
+        lsi_automaton_scan(build->patterns, name, &match);
+        if (!lsi_pattern_match_any(build->patterns, &match, LSI_PATTERN_VENDOR_BLACKLIST) ||
+            lsi_pattern_match_any(build->patterns, &match, LSI_PATTERN_VENDOR_ALLOWED)) {
+                return;
+        }
+        lsi_rules_db_foreach_profile(build->rules, lsi_overlay_check_profile, &candidate);
+        if (candidate.allowed) {
+                return;
+        }
+        lsi_overlay_want(build, name, path);
+}
+
+/**
+ * Bring @dir in line with the wanted links, touching only the entries that
+ * changed, then stamp it
+ */
+static bool lsi_overlay_sync(const char *dir, const LsiRules *rules, uint64_t stamp)
+{
+        LsiOverlayBuild build = { .patterns = rules->patterns, .rules = rules };
+        size_t n_kept = 0, n_removed = 0, n_added = 0;
+        struct dirent *ent = NULL;
+        char stamp_str[17];
+        DIR *d = NULL;
+        bool ret = false;
+
+        /* Transmutes go first as they take priority over the blacklist */
+        lsi_overlay_want_transmutes(&build);
+        lsi_host_resolver_foreach(lsi_overlay_want_host, &build);
+        lsi_overlay_settle(&build);
+
+        if (mkdir(dir, 00755) != 0 && errno != EEXIST) {
+                goto end;
+        }
+        d = opendir(dir);
+        if (!d) {
+                goto end;
+        }
+
+        /* Drop what's no longer wanted, and note what's already right */
+        while ((ent = readdir(d))) {
+                LsiOverlayLink *link = NULL;
+                char target[PATH_MAX];
+                ssize_t len;
+
+                if (ent->d_name[0] == '.') {
+                        continue;
+                }
+                link = lsi_overlay_find(&build, ent->d_name);
+                if (!link) {
+                        if (unlinkat(dirfd(d), ent->d_name, 0) == 0) {
+                                ++n_removed;
+                        }
+                        continue;
+                }
+                len = readlinkat(dirfd(d), ent->d_name, target, sizeof(target) - 1);
+                if (len < 0) {
+                        continue;
+                }
+                target[len] = '\0';
+                if (streq(target, link->target)) {
+                        link->present = true;
+                        ++n_kept;
+                }
+        }
+
+        for (size_t i = 0; i < build.n_links; i++) {
+                LsiOverlayLink *link = &build.links[i];
+                if (link->present) {
+                        continue;
+                }
+                if (lsi_overlay_replace(dirfd(d), link->name, link->target)) {
+                        ++n_added;
+                }
+        }
+
+        snprintf(stamp_str, sizeof(stamp_str), "%016" PRIx64, stamp);
+        ret = lsi_overlay_replace(dirfd(d), LSI_OVERLAY_STAMP, stamp_str);
+
+        lsi_log_debug("overlay: %s: %zu kept, %zu linked, %zu removed",
+                      dir,
+                      n_kept,
+                      n_added,
+                      n_removed);
+end:
+        if (d) {
+                closedir(d);
+        }
+        lsi_overlay_build_free(&build);
+        return ret;
+}
+
+char *lsi_overlay_root(void)
+{
+        autofree(char) *base = NULL;
+        char *c = NULL;
+
+        base = lsi_get_user_cache_dir();
+        if (!base) {
+                return NULL;
+        }
+        if (asprintf(&c, "%s/%s", base, LSI_OVERLAY_DIR) < 0) {
+                return NULL;
+        }
+        return c;
+}
+
+char *lsi_overlay_class_dir(const char *root, unsigned int elf_class)
+{
+        char *c = NULL;
+
+        if (asprintf(&c, "%s/%u", root, elf_class) < 0) {
+                return NULL;
+        }
+        return c;
+}
+
+bool lsi_overlay_prepare(const char *root, const LsiRules *rules)
+{
+        autofree(char) *dir = NULL;
+        autofree(char) *lock_path = NULL;
+        uint64_t stamp = lsi_overlay_stamp(rules->stamp);
+        int lock_fd = -1;
+        bool ret = false;
+
+        dir = lsi_overlay_class_dir(root, LSI_OVERLAY_CLASS);
+        if (!dir) {
+                return false;
+        }
+        if (lsi_overlay_is_current(dir, stamp)) {
+                return true;
+        }
+
+        if (asprintf(&lock_path, "%s/%s", root, LSI_OVERLAY_LOCK) < 0) {
+                return false;
+        }
+        if (!lsi_file_exists(root) && !nc_mkdir_p(root, 00755)) {
+                return false;
+        }
+
+        /* Serialise builders, both our own architecture and the other one */
+        lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 00644);
+        if (lock_fd < 0) {
+                return false;
+        }
+        if (flock(lock_fd, LOCK_EX) != 0) {
+                goto end;
+        }
+
+        /* Somebody else may have updated it while we waited */
+        if (lsi_overlay_is_current(dir, stamp)) {
+                ret = true;
+                goto end;
+        }
+
+        /* Updated in place one link at a time, so running games keep working */
+        ret = lsi_overlay_sync(dir, rules, stamp);
+        if (!ret) {
+                lsi_log_warn("overlay: failed to update %s", dir);
+        }
+
+end:
+        close(lock_fd);
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
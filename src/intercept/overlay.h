@@ -0,0 +1,76 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+
+#include "rules-db.h"
+
+/**
+ * Set by the shim to the overlay root when games are run without the
+ * rtld-audit module. libredirect makes the libintercept decisions for
+ * dlopen() itself whenever this is present.
+ */
+#define LSI_OVERLAY_ENV "LSI_OVERLAY"
+
+/**
+ * The overlay lives at $XDG_CACHE_HOME/linux-steam-integration/overlay,
+ * with one directory of symlinks per ELF class, i.e. overlay/32
+ */
+#define LSI_OVERLAY_DIR "linux-steam-integration/overlay"
+
+/**
+ * Return the overlay root for this user, or NULL if there's no usable
+ * cache directory.
+ */
+char *lsi_overlay_root(void);
+
+/**
+ * Return the directory within @root holding the overlay for @elf_class,
+ * which is what gets placed on LD_LIBRARY_PATH.
+ */
+char *lsi_overlay_class_dir(const char *root, unsigned int elf_class);
+
+/**
+ * Ensure the overlay for the ELF class of this process matches @rules and
+ * the host libraries, rebuilding it if either has changed. The overlay is
+ * shared by every game, so @rules should be the global rules, and a library
+ * exempted by the [vendor-allowed] section of any app profile is left out.
+ *
+ * Every host library the rules would force in place of a vendored copy is
+ * linked under its own name, and every complete soname with a transmute is
+ * linked to the host library it would become. With the overlay ahead of
+ * the game's DT_RUNPATH, ld.so picks the host library for DT_NEEDED entries
+ * without any auditing.
+ *
+ * Checking an up to date overlay costs a stat() of each host library
+ * directory and one readlink(). Otherwise only the links that changed are
+ * replaced, each atomically, so games already running are unaffected.
+ *
+ * @returns true if the overlay is usable
+ */
+bool lsi_overlay_prepare(const char *root, const LsiRules *rules);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,552 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "../common/process.h"
+#include "plan.h"
+#include "nica/util.h"
+
+#define LSI_PLAN_ENV "LSI_INTERCEPT_PLAN"
+
+#if UINTPTR_MAX == 0xffffffffffffffff
+#define LSI_PLAN_ELFCLASS ELFCLASS64
+#else
+#define LSI_PLAN_ELFCLASS ELFCLASS32
+#endif
+
+/**
+ * An object the walk found, along with what its own searches need
+ */
+typedef struct LsiPlanObject {
+        char *path;
+        char *origin;  /**<Directory holding path, for $ORIGIN */
+        char *rpath;   /**<DT_RPATH, ignored by ld.so when runpath is set */
+        char *runpath; /**<DT_RUNPATH */
+        int loader;    /**<Object that needed this one, -1 for the executable */
+} LsiPlanObject;
+
+/**
+ * A DT_NEEDED entry waiting to be resolved, in the order ld.so will get to it
+ */
+typedef struct LsiPlanNeeded {
+        char *name;
+        int loader;
+} LsiPlanNeeded;
+
+typedef struct LsiPlan {
+        LsiPlanDecideFunc decide;
+        const char *library_path;
+        FILE *dump;
+        uint16_t machine;
+        size_t n_decisions;
+        LsiPlanObject objects[LSI_PLAN_MAX_OBJECTS];
+        size_t n_objects;
+        LsiPlanNeeded needed[LSI_PLAN_MAX_NEEDED];
+        size_t n_needed;
+} LsiPlan;
+
+static const char *lsi_plan_origin_name(unsigned int flag)
+{
+        switch (flag) {
+        case LA_SER_ORIG:
+                return "orig";
+        case LA_SER_LIBPATH:
+                return "libpath";
+        case LA_SER_RUNPATH:
+                return "runpath";
+        default:
+                return "unknown";
+        }
+}
+
+/**
+ * Make a single decision, noting it in the dump
+ */
+static const char *lsi_plan_decide(LsiPlan *plan, const char *name, unsigned int flag)
+{
+        const char *ret = plan->decide(name, flag);
+
+        ++plan->n_decisions;
+        if (plan->dump) {
+                fprintf(plan->dump,
+                        "  %-8s %s -> %s\n",
+                        lsi_plan_origin_name(flag),
+                        name,
+                        ret ? ret : "(blocked)");
+        }
+        return ret;
+}
+
+/**
+ * Queue a DT_NEEDED entry, unless the same name was already asked for as
+ * ld.so will reuse whatever it loaded the first time.
+ */
+static void lsi_plan_queue(LsiPlan *plan, const char *name, int loader)
+{
+        LsiPlanNeeded *needed = NULL;
+
+        for (size_t i = 0; i < plan->n_needed; i++) {
+                if (streq(plan->needed[i].name, name)) {
+                        return;
+                }
+        }
+        if (plan->n_needed == LSI_PLAN_MAX_NEEDED) {
+                return;
+        }
+
+        needed = &plan->needed[plan->n_needed];
+        needed->name = strdup(name);
+        if (!needed->name) {
+                return;
+        }
+        needed->loader = loader;
+        ++plan->n_needed;
+}
+
+/**
+ * Translate a virtual address to a file offset through the PT_LOAD segments
+ */
+static bool lsi_plan_vaddr_offset(const ElfW(Phdr) * phdr, size_t n_phdr, ElfW(Addr) vaddr,
+                                  size_t *offset)
+{
+        for (size_t i = 0; i < n_phdr; i++) {
+                if (phdr[i].p_type != PT_LOAD) {
+                        continue;
+                }
+                if (vaddr >= phdr[i].p_vaddr && vaddr - phdr[i].p_vaddr < phdr[i].p_filesz) {
+                        *offset = phdr[i].p_offset + (vaddr - phdr[i].p_vaddr);
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Record @path as a loaded object and queue up everything it needs
+ */
+static LsiPlanObject *lsi_plan_add_object(LsiPlan *plan, const char *path, int loader)
+{
+        LsiPlanObject *object = &plan->objects[plan->n_objects];
+        const char *slash = strrchr(path, '/');
+
+        object->path = strdup(path);
+        if (!slash) {
+                object->origin = strdup(".");
+        } else {
+                object->origin = strndup(path, slash == path ? 1 : (size_t)(slash - path));
+        }
+        if (!object->path || !object->origin) {
+                free(object->path);
+                free(object->origin);
+                memset(object, 0, sizeof(*object));
+                return NULL;
+        }
+        object->loader = loader;
+        ++plan->n_objects;
+        return object;
+}
+
+/**
+ * Map @path and read its dynamic section, as ld.so is about to.
+ *
+ * @returns false if ld.so would also reject it and carry on searching, i.e.
+ * it isn't an ELF object for this process
+ */
+static bool lsi_plan_load(LsiPlan *plan, const char *path, int loader)
+{
+        struct stat st = { 0 };
+        const ElfW(Ehdr) *ehdr = NULL;
+        const ElfW(Phdr) *phdr = NULL;
+        const ElfW(Dyn) *dyn = NULL;
+        LsiPlanObject *object = NULL;
+        const char *strings = NULL;
+        char *data = NULL;
+        size_t size = 0;
+        size_t n_dyn = 0;
+        size_t str_offset = 0;
+        ElfW(Addr) str_vaddr = 0;
+        size_t str_size = 0;
+        bool have_strtab = false;
+        bool ret = false;
+        int fd = -1;
+        int index;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return false;
+        }
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ElfW(Ehdr))) {
+                goto end;
+        }
+        size = (size_t)st.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+                data = NULL;
+                goto end;
+        }
+
+        ehdr = (const ElfW(Ehdr) *)data;
+        if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+            ehdr->e_ident[EI_CLASS] != LSI_PLAN_ELFCLASS) {
+                goto end;
+        }
+        if (plan->n_objects > 0 && ehdr->e_machine != plan->machine) {
+                goto end;
+        }
+        if (ehdr->e_phentsize != sizeof(ElfW(Phdr)) || ehdr->e_phoff > size ||
+            ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(ElfW(Phdr))) {
+                goto end;
+        }
+        phdr = (const ElfW(Phdr) *)(data + ehdr->e_phoff);
+
+        for (size_t i = 0; i < ehdr->e_phnum; i++) {
+                if (phdr[i].p_type != PT_DYNAMIC) {
+                        continue;
+                }
+                if (phdr[i].p_offset > size || phdr[i].p_filesz > size - phdr[i].p_offset) {
+                        goto end;
+                }
+                dyn = (const ElfW(Dyn) *)(data + phdr[i].p_offset);
+                n_dyn = phdr[i].p_filesz / sizeof(ElfW(Dyn));
+        }
+
+        if (plan->n_objects == 0) {
+                plan->machine = ehdr->e_machine;
+        }
+        index = (int)plan->n_objects;
+        object = lsi_plan_add_object(plan, path, loader);
+        if (!object) {
+                goto end;
+        }
+        ret = true;
+
+        for (size_t i = 0; i < n_dyn && dyn[i].d_tag != DT_NULL; i++) {
+                if (dyn[i].d_tag == DT_STRTAB) {
+                        str_vaddr = dyn[i].d_un.d_ptr;
+                        have_strtab = true;
+                } else if (dyn[i].d_tag == DT_STRSZ) {
+                        str_size = dyn[i].d_un.d_val;
+                }
+        }
+        /* Statically linked, or nothing we can read */
+        if (!have_strtab || !lsi_plan_vaddr_offset(phdr, ehdr->e_phnum, str_vaddr, &str_offset) ||
+            str_offset > size || str_size > size - str_offset) {
+                goto end;
+        }
+        strings = data + str_offset;
+
+        for (size_t i = 0; i < n_dyn && dyn[i].d_tag != DT_NULL; i++) {
+                const char *s = NULL;
+
+                if (dyn[i].d_tag != DT_NEEDED && dyn[i].d_tag != DT_RPATH &&
+                    dyn[i].d_tag != DT_RUNPATH) {
+                        continue;
+                }
+                if (dyn[i].d_un.d_val >= str_size ||
+                    !memchr(strings + dyn[i].d_un.d_val, '\0', str_size - dyn[i].d_un.d_val)) {
+                        continue;
+                }
+                s = strings + dyn[i].d_un.d_val;
+
+                if (dyn[i].d_tag == DT_NEEDED) {
+                        lsi_plan_queue(plan, s, index);
+                } else if (dyn[i].d_tag == DT_RPATH && !object->rpath) {
+                        object->rpath = strdup(s);
+                } else if (dyn[i].d_tag == DT_RUNPATH && !object->runpath) {
+                        object->runpath = strdup(s);
+                }
+        }
+
+end:
+        if (data) {
+                munmap(data, size);
+        }
+        close(fd);
+        return ret;
+}
+
+/**
+ * Form the path ld.so will try for @name in a single search path entry,
+ * expanding $ORIGIN against @origin.
+ *
+ * @returns false for entries we can't expand the same way, i.e. $LIB and
+ * $PLATFORM, which depend on ld.so internals
+ */
+static bool lsi_plan_candidate(const char *entry, size_t len, const char *origin,
+                               const char *name, char *buf, size_t buf_size)
+{
+        size_t name_len = strlen(name);
+        size_t n = 0;
+
+        /* An empty entry means the working directory */
+        if (len == 0) {
+                entry = ".";
+                len = 1;
+        }
+
+        for (size_t i = 0; i < len;) {
+                const char *piece = entry + i;
+                size_t piece_len = 1;
+
+                if (entry[i] == '$') {
+                        if (len - i >= 7 && strncmp(entry + i, "$ORIGIN", 7) == 0) {
+                                i += 7;
+                        } else if (len - i >= 9 && strncmp(entry + i, "${ORIGIN}", 9) == 0) {
+                                i += 9;
+                        } else {
+                                return false;
+                        }
+                        piece = origin;
+                        piece_len = strlen(origin);
+                } else {
+                        ++i;
+                }
+                if (n + piece_len >= buf_size) {
+                        return false;
+                }
+                memcpy(buf + n, piece, piece_len);
+                n += piece_len;
+        }
+
+        if (buf[n - 1] != '/') {
+                if (n + 1 >= buf_size) {
+                        return false;
+                }
+                buf[n++] = '/';
+        }
+        if (n + name_len >= buf_size) {
+                return false;
+        }
+        memcpy(buf + n, name, name_len + 1);
+        return true;
+}
+
+/**
+ * Try each entry of @path in turn as ld.so would, loading the first usable one
+ *
+ * @returns true if the library was found
+ */
+static bool lsi_plan_search(LsiPlan *plan, const char *path, const char *separators,
+                            const char *origin, unsigned int flag, const char *name,
+                            int loader)
+{
+        char candidate[PATH_MAX];
+        const char *entry = path;
+
+        while (entry) {
+                const char *start = entry;
+                const char *end = strpbrk(entry, separators);
+                size_t len = end ? (size_t)(end - entry) : strlen(entry);
+                const char *result = NULL;
+
+                entry = end ? end + 1 : NULL;
+                if (!lsi_plan_candidate(start,
+                                        len,
+                                        origin,
+                                        name,
+                                        candidate,
+                                        sizeof(candidate))) {
+                        continue;
+                }
+
+                /* Blacklisted here, so ld.so moves on to the next directory */
+                result = lsi_plan_decide(plan, candidate, flag);
+                if (!result || !lsi_file_exists(result)) {
+                        continue;
+                }
+                if (lsi_plan_load(plan, result, loader)) {
+                        if (plan->dump) {
+                                fprintf(plan->dump, "  loaded   %s\n", result);
+                        }
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Resolve one DT_NEEDED entry, following the ld.so search order
+ */
+static void lsi_plan_resolve(LsiPlan *plan, const LsiPlanNeeded *needed)
+{
+        const LsiPlanObject *loader = &plan->objects[needed->loader];
+        const char *name = NULL;
+
+        if (plan->dump) {
+                fprintf(plan->dump, "needed %s (by %s)\n", needed->name, loader->path);
+        }
+
+        if (plan->n_objects == LSI_PLAN_MAX_OBJECTS) {
+                if (plan->dump) {
+                        fputs("  skipped, too many objects\n", plan->dump);
+                }
+                return;
+        }
+
+        name = lsi_plan_decide(plan, needed->name, LA_SER_ORIG);
+        if (!name) {
+                return;
+        }
+
+        /* Paths are opened as they are without any searching */
+        if (strchr(name, '/')) {
+                if (lsi_file_exists(name) && lsi_plan_load(plan, name, needed->loader) &&
+                    plan->dump) {
+                        fprintf(plan->dump, "  loaded   %s\n", name);
+                }
+                return;
+        }
+
+        /* DT_RPATH of the loader and everything that led to it, unless overridden */
+        if (!loader->runpath) {
+                for (int i = needed->loader; i >= 0; i = plan->objects[i].loader) {
+                        const LsiPlanObject *object = &plan->objects[i];
+
+                        if (object->rpath &&
+                            lsi_plan_search(plan,
+                                            object->rpath,
+                                            ":",
+                                            object->origin,
+                                            LA_SER_RUNPATH,
+                                            name,
+                                            needed->loader)) {
+                                return;
+                        }
+                }
+        }
+
+        if (plan->library_path && lsi_plan_search(plan,
+                                                  plan->library_path,
+                                                  ":;",
+                                                  plan->objects[0].origin,
+                                                  LA_SER_LIBPATH,
+                                                  name,
+                                                  needed->loader)) {
+                return;
+        }
+
+        if (loader->runpath && lsi_plan_search(plan,
+                                               loader->runpath,
+                                               ":",
+                                               loader->origin,
+                                               LA_SER_RUNPATH,
+                                               name,
+                                               needed->loader)) {
+                return;
+        }
+
+        if (plan->dump) {
+                fputs("  host     left to ld.so.cache\n", plan->dump);
+        }
+}
+
+/**
+ * Open $LSI_INTERCEPT_PLAN/intercept-$pid.plan, if asked for
+ */
+static FILE *lsi_plan_open_dump(void)
+{
+        const char *dir = getenv(LSI_PLAN_ENV);
+        char *path = NULL;
+        FILE *fp = NULL;
+
+        if (!dir || !*dir) {
+                return NULL;
+        }
+        if (asprintf(&path, "%s/intercept-%d.plan", dir, (int)getpid()) < 0) {
+                return NULL;
+        }
+        fp = fopen(path, "we");
+        if (!fp) {
+                lsi_log_warn("Unable to write plan %s: %s", path, strerror(errno));
+        }
+        free(path);
+        return fp;
+}
+
+void lsi_plan_prepare(LsiPlanDecideFunc decide)
+{
+        const char *exe = lsi_process_path();
+        LsiPlan *plan = NULL;
+
+        if (!exe) {
+                return;
+        }
+
+        /* Far too big for the stack we might be running on */
+        plan = calloc(1, sizeof(LsiPlan));
+        if (!plan) {
+                return;
+        }
+        plan->decide = decide;
+        plan->library_path = getenv("LD_LIBRARY_PATH");
+        plan->dump = lsi_plan_open_dump();
+        if (plan->dump) {
+                fprintf(plan->dump, "# liblsi-intercept plan for %s\n", exe);
+        }
+
+        if (!lsi_plan_load(plan, exe, -1)) {
+                goto end;
+        }
+
+        /* New entries are appended as objects load, giving ld.so's breadth-first order */
+        for (size_t i = 0; i < plan->n_needed; i++) {
+                lsi_plan_resolve(plan, &plan->needed[i]);
+        }
+
+        lsi_log_debug("pre-resolved %zu libraries with %zu decisions",
+                      plan->n_objects - 1,
+                      plan->n_decisions);
+
+end:
+        if (plan->dump) {
+                fclose(plan->dump);
+        }
+        for (size_t i = 0; i < plan->n_objects; i++) {
+                free(plan->objects[i].path);
+                free(plan->objects[i].origin);
+                free(plan->objects[i].rpath);
+                free(plan->objects[i].runpath);
+        }
+        for (size_t i = 0; i < plan->n_needed; i++) {
+                free(plan->needed[i].name);
+        }
+        free(plan);
+}
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,51 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+/**
+ * Upper bounds for a single walk, anything beyond is left to be decided lazily
+ */
+#define LSI_PLAN_MAX_OBJECTS 256
+#define LSI_PLAN_MAX_NEEDED 1024
+
+/**
+ * Make (and remember) the decision for a single la_objsearch request
+ */
+typedef char *(*LsiPlanDecideFunc)(const char *name, unsigned int flag);
+
+/**
+ * Walk the DT_NEEDED closure of the executable ahead of ld.so, following
+ * DT_RPATH, LD_LIBRARY_PATH and DT_RUNPATH in the same order it will, and
+ * pass every search it's going to make through @decide. Libraries that would
+ * come from ld.so.cache or the default directories end the walk for that
+ * branch, as those are host libraries we leave alone.
+ *
+ * When LSI_INTERCEPT_PLAN names a directory, the plan is written there as
+ * intercept-$pid.plan for diagnostics.
+ */
+void lsi_plan_prepare(LsiPlanDecideFunc decide);
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
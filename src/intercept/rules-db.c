@@ -0,0 +1,365 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "config.h"
+#include "nica/util.h"
+#include "rules-db.h"
+
+_Static_assert(sizeof(LsiRulesDbHeader) == 16, "LsiRulesDbHeader must have a fixed layout");
+_Static_assert(sizeof(LsiRulesDbProfile) == 16, "LsiRulesDbProfile must have a fixed layout");
+_Static_assert(sizeof(LsiRulesDbAutomaton) % 8 == 0, "LsiRulesDbAutomaton must align masks");
+
+/**
+ * System rules database, i.e. /etc/linux-steam-integration-intercept.db
+ */
+#define LSI_RULES_DB_SYSTEM_FILE SYSTEMCONFDIR "/" LSI_RULES_DB_FILE
+
+/**
+ * Vendor rules database, lowest priority, installed alongside the module
+ */
+#define LSI_RULES_DB_VENDOR_FILE VENDORDIR "/" LSI_RULES_DB_FILE
+
+/* The automaton pointing into our mapping, which lives as long as we do */
+static LsiAutomaton mapped_rules;
+static void *mapped_db = NULL;
+static size_t mapped_db_size = 0;
+
+/**
+ * Build the user rules database path
+ */
+static char *lsi_rules_db_user_file(void)
+{
+        autofree(char) *dir = lsi_get_user_config_dir();
+        char *c = NULL;
+
+        if (!dir) {
+                return NULL;
+        }
+        if (asprintf(&c, "%s/%s", dir, LSI_RULES_DB_FILE) < 0) {
+                return NULL;
+        }
+        return c;
+}
+
+static inline uint64_t lsi_rules_db_mix(uint64_t h, uint64_t v)
+{
+        for (int i = 0; i < 8; i++) {
+                h ^= (v >> (i * 8)) & 0xff;
+                h *= 1099511628211ull;
+        }
+        return h;
+}
+
+/**
+ * Find the profile for @app_id, falling back to the global rules in the
+ * first slot. Profiles after the first are sorted by app ID.
+ */
+static const LsiRulesDbProfile *lsi_rules_db_find_profile(const LsiRulesDbProfile *profiles,
+                                                          uint32_t n_profiles, uint32_t app_id)
+{
+        uint32_t low = 1;
+        uint32_t high = n_profiles;
+
+        while (app_id != 0 && low < high) {
+                uint32_t mid = low + (high - low) / 2;
+                if (profiles[mid].app_id == app_id) {
+                        return &profiles[mid];
+                }
+                if (profiles[mid].app_id < app_id) {
+                        low = mid + 1;
+                } else {
+                        high = mid;
+                }
+        }
+        return &profiles[0];
+}
+
+/**
+ * Check every index of the automaton block at @offset so the matcher can
+ * trust it blindly. Only the selected profile is ever validated.
+ */
+static bool lsi_rules_db_validate(const char *map, size_t size, uint64_t offset,
+                                  LsiAutomaton *out)
+{
+        const LsiRulesDbAutomaton *header = NULL;
+        LsiRulesDbLayout layout = { 0 };
+        LsiAutomaton a = { 0 };
+        const char *block = NULL;
+        bool have_empty = false;
+
+        if (offset % 8 != 0 || offset > size || size - offset < sizeof(LsiRulesDbAutomaton)) {
+                return false;
+        }
+        block = map + offset;
+        header = (const LsiRulesDbAutomaton *)block;
+
+        if (!lsi_rules_db_layout(header, &layout) || layout.size > size - offset) {
+                return false;
+        }
+        if (header->n_exact_buckets & (header->n_exact_buckets - 1)) {
+                return false;
+        }
+
+        a = (LsiAutomaton){
+                .n_states = header->n_states,
+                .n_classes = header->n_classes,
+                .n_outputs = header->n_outputs,
+                .n_patterns = header->n_patterns,
+                .n_exact_buckets = header->n_exact_buckets,
+                .classes = (const uint8_t *)(block + layout.classes),
+                .next = (const uint16_t *)(block + layout.next),
+                .output = (const uint16_t *)(block + layout.output),
+                .masks = (const uint64_t *)(block + layout.masks),
+                .group_start = header->group_start,
+                .patterns = (const uint32_t *)(block + layout.patterns),
+                .targets = (const uint32_t *)(block + layout.targets),
+                .exact_buckets = (const uint32_t *)(block + layout.exact_buckets),
+                .strings = block + layout.strings,
+        };
+
+        if (a.group_start[0] != 0 || a.group_start[LSI_N_PATTERN_GROUPS] != a.n_patterns) {
+                return false;
+        }
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                if (a.group_start[g] > a.group_start[g + 1]) {
+                        return false;
+                }
+        }
+        for (size_t i = 0; i < 256; i++) {
+                if (a.classes[i] >= a.n_classes) {
+                        return false;
+                }
+        }
+        for (size_t i = 0; i < (size_t)a.n_states * a.n_classes; i++) {
+                if (a.next[i] >= a.n_states) {
+                        return false;
+                }
+        }
+        for (uint32_t i = 0; i < a.n_states; i++) {
+                if (a.output[i] >= a.n_outputs) {
+                        return false;
+                }
+        }
+        if (a.strings[header->strings_size - 1] != '\0') {
+                return false;
+        }
+        for (uint32_t i = 0; i < a.n_patterns; i++) {
+                if (a.patterns[i] >= header->strings_size) {
+                        return false;
+                }
+                if (a.targets[i] != LSI_PATTERN_NO_TARGET && a.targets[i] >= header->strings_size) {
+                        return false;
+                }
+        }
+        /* Probing stops at the first empty bucket, so there must be one */
+        for (uint32_t i = 0; i < a.n_exact_buckets; i++) {
+                if (a.exact_buckets[i] > a.n_patterns) {
+                        return false;
+                }
+                have_empty |= a.exact_buckets[i] == 0;
+        }
+        if (a.n_exact_buckets > 0 && !have_empty) {
+                return false;
+        }
+
+        *out = a;
+        return true;
+}
+
+/**
+ * Map the database at @path and select the profile for @app_id
+ */
+static bool lsi_rules_db_map(const char *path, uint32_t app_id, LsiRules *rules)
+{
+        const LsiRulesDbHeader *header = NULL;
+        const LsiRulesDbProfile *profiles = NULL;
+        const LsiRulesDbProfile *profile = NULL;
+        struct stat st = { 0 };
+        void *map = NULL;
+        size_t size = 0;
+        bool ret = false;
+        int fd = -1;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return false;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LsiRulesDbHeader)) {
+                goto end;
+        }
+        size = (size_t)st.st_size;
+
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+                goto end;
+        }
+
+        header = map;
+        profiles = (const LsiRulesDbProfile *)(header + 1);
+        if (memcmp(header->magic, LSI_RULES_DB_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != LSI_RULES_DB_VERSION || header->n_profiles == 0 ||
+            header->n_profiles > LSI_RULES_DB_MAX_PROFILES ||
+            (size - sizeof(*header)) / sizeof(*profiles) < header->n_profiles ||
+            profiles[0].app_id != 0) {
+                goto invalid;
+        }
+
+        profile = lsi_rules_db_find_profile(profiles, header->n_profiles, app_id);
+        if (!lsi_rules_db_validate(map, size, profile->offset, &mapped_rules)) {
+                goto invalid;
+        }
+
+        rules->patterns = &mapped_rules;
+        rules->profile = profile->app_id;
+        mapped_db = map;
+        mapped_db_size = size;
+        rules->stamp = 14695981039346656037ull;
+        rules->stamp = lsi_rules_db_mix(rules->stamp, (uint64_t)st.st_dev);
+        rules->stamp = lsi_rules_db_mix(rules->stamp, (uint64_t)st.st_ino);
+        rules->stamp = lsi_rules_db_mix(rules->stamp, (uint64_t)st.st_size);
+        rules->stamp = lsi_rules_db_mix(rules->stamp, (uint64_t)st.st_mtim.tv_sec);
+        rules->stamp = lsi_rules_db_mix(rules->stamp, (uint64_t)st.st_mtim.tv_nsec);
+        ret = true;
+        goto end;
+
+invalid:
+        lsi_log_debug("rules: ignoring invalid database %s", path);
+        munmap(map, size);
+
+end:
+        close(fd);
+        return ret;
+}
+
+/**
+ * Select the builtin tables for @app_id
+ */
+static void lsi_rules_db_builtin(uint32_t app_id, LsiRules *rules)
+{
+        rules->patterns = &lsi_builtin_patterns;
+        rules->profile = 0;
+
+        for (const LsiAppProfile *p = lsi_builtin_profiles; app_id && p->patterns; p++) {
+                if (p->app_id == app_id) {
+                        rules->patterns = p->patterns;
+                        rules->profile = app_id;
+                        break;
+                }
+        }
+
+        /* Every builtin table changes together, so one stamp covers them */
+        rules->stamp = lsi_automaton_stamp(&lsi_builtin_patterns);
+        for (const LsiAppProfile *p = lsi_builtin_profiles; p->patterns; p++) {
+                rules->stamp = lsi_rules_db_mix(rules->stamp, p->app_id);
+                rules->stamp = lsi_rules_db_mix(rules->stamp, lsi_automaton_stamp(p->patterns));
+        }
+}
+
+void lsi_rules_db_load(uint32_t app_id, LsiRules *rules)
+{
+        char *paths[] = { NULL, LSI_RULES_DB_SYSTEM_FILE, LSI_RULES_DB_VENDOR_FILE };
+        bool mapped = false;
+
+        paths[0] = lsi_rules_db_user_file();
+        for (size_t i = 0; i < ARRAY_SIZE(paths) && !mapped; i++) {
+                if (!paths[i]) {
+                        continue;
+                }
+                mapped = lsi_rules_db_map(paths[i], app_id, rules);
+                if (mapped) {
+                        lsi_log_debug("rules: using %s (%u patterns)",
+                                      paths[i],
+                                      rules->patterns->n_patterns);
+                }
+        }
+        free(paths[0]);
+
+        if (!mapped) {
+                lsi_rules_db_builtin(app_id, rules);
+        }
+        if (rules->profile != 0) {
+                lsi_log_debug("rules: using the profile for app %u", rules->profile);
+        }
+}
+
+void lsi_rules_db_foreach_profile(const LsiRules *rules, LsiRulesProfileFunc func,
+                                  void *userdata)
+{
+        const LsiRulesDbHeader *header = mapped_db;
+        const LsiRulesDbProfile *profiles = NULL;
+
+        if (rules->patterns != &mapped_rules || !mapped_db) {
+                for (const LsiAppProfile *p = lsi_builtin_profiles; p->patterns; p++) {
+                        func(p->app_id, p->patterns, userdata);
+                }
+                return;
+        }
+
+        /* The profile table was checked by lsi_rules_db_map(), the blocks weren't */
+        profiles = (const LsiRulesDbProfile *)(header + 1);
+        for (uint32_t i = 1; i < header->n_profiles; i++) {
+                LsiAutomaton patterns;
+
+                if (lsi_rules_db_validate(mapped_db,
+                                          mapped_db_size,
+                                          profiles[i].offset,
+                                          &patterns)) {
+                        func(profiles[i].app_id, &patterns, userdata);
+                }
+        }
+}
+
+bool lsi_rules_db_has_local(void)
+{
+        autofree(char) *user = lsi_rules_db_user_file();
+
+        if (user && access(user, F_OK) == 0) {
+                return true;
+        }
+        return access(LSI_RULES_DB_SYSTEM_FILE, F_OK) == 0;
+}
+
+void lsi_rules_db_unload(LsiRules *rules)
+{
+        if (rules->patterns == &mapped_rules && mapped_db) {
+                munmap(mapped_db, mapped_db_size);
+                mapped_db = NULL;
+                mapped_db_size = 0;
+                memset(&mapped_rules, 0, sizeof(mapped_rules));
+        }
+        rules->patterns = NULL;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
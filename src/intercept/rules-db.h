@@ -0,0 +1,171 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "matcher.h"
+
+/**
+ * Compiled rules database, written by lsi-rulec.
+ *
+ *      header | profiles[n_profiles] | automaton blocks
+ *
+ * The first profile always holds the global rules (app ID 0), the rest are
+ * sorted by app ID. Each automaton block is a fixed header followed by every
+ * LsiAutomaton array in an order that keeps each naturally aligned, so a
+ * read-only mapping can be used directly without any parsing. The layout is
+ * identical for 32-bit and 64-bit processes.
+ */
+#define LSI_RULES_DB_MAGIC "LSIRULES"
+#define LSI_RULES_DB_VERSION 5
+
+/**
+ * Name of the database within each configuration layer, i.e.
+ * ~/.config/linux-steam-integration-intercept.db
+ */
+#define LSI_RULES_DB_FILE "linux-steam-integration-intercept.db"
+
+/**
+ * Limits enforced when loading so that a corrupt file can't make the
+ * layout computation overflow.
+ */
+#define LSI_RULES_DB_MAX_STATES 65536
+#define LSI_RULES_DB_MAX_BUCKETS 4096
+#define LSI_RULES_DB_MAX_STRINGS (1024 * 1024)
+#define LSI_RULES_DB_MAX_PROFILES 65536
+
+typedef struct LsiRulesDbHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_profiles;
+} LsiRulesDbHeader;
+
+typedef struct LsiRulesDbProfile {
+        uint32_t app_id;
+        uint32_t padding;
+        uint64_t offset; /**<Start of the automaton block, 8-byte aligned */
+} LsiRulesDbProfile;
+
+typedef struct LsiRulesDbAutomaton {
+        uint32_t n_states;
+        uint32_t n_classes;
+        uint32_t n_outputs;
+        uint32_t n_patterns;
+        uint32_t n_exact_buckets;
+        uint32_t strings_size;
+        uint32_t group_start[LSI_N_PATTERN_GROUPS + 1];
+} LsiRulesDbAutomaton;
+
+/**
+ * Byte offset of each array within an automaton block
+ */
+typedef struct LsiRulesDbLayout {
+        size_t masks;
+        size_t patterns;
+        size_t targets;
+        size_t exact_buckets;
+        size_t next;
+        size_t output;
+        size_t classes;
+        size_t strings;
+        size_t size;
+} LsiRulesDbLayout;
+
+/**
+ * Compute the layout described by @header, shared by the writer and loader.
+ *
+ * @returns false if the counts are outside of the supported limits
+ */
+static inline bool lsi_rules_db_layout(const LsiRulesDbAutomaton *header,
+                                       LsiRulesDbLayout *layout)
+{
+        if (header->n_states == 0 || header->n_states > LSI_RULES_DB_MAX_STATES ||
+            header->n_classes == 0 || header->n_classes > 256 || header->n_outputs == 0 ||
+            header->n_outputs > LSI_RULES_DB_MAX_STATES || header->n_patterns > LSI_PATTERN_MAX ||
+            header->n_exact_buckets > LSI_RULES_DB_MAX_BUCKETS || header->strings_size == 0 ||
+            header->strings_size > LSI_RULES_DB_MAX_STRINGS) {
+                return false;
+        }
+
+        layout->masks = sizeof(LsiRulesDbAutomaton);
+        layout->patterns =
+            layout->masks + (size_t)header->n_outputs * LSI_PATTERN_WORDS * sizeof(uint64_t);
+        layout->targets = layout->patterns + header->n_patterns * sizeof(uint32_t);
+        layout->exact_buckets = layout->targets + header->n_patterns * sizeof(uint32_t);
+        layout->next = layout->exact_buckets + header->n_exact_buckets * sizeof(uint32_t);
+        layout->output =
+            layout->next + (size_t)header->n_states * header->n_classes * sizeof(uint16_t);
+        layout->classes = layout->output + header->n_states * sizeof(uint16_t);
+        layout->strings = layout->classes + 256;
+        layout->size = layout->strings + header->strings_size;
+        return true;
+}
+
+/**
+ * The rules selected for this process
+ */
+typedef struct LsiRules {
+        const LsiAutomaton *patterns;
+        uint32_t profile; /**<App ID of the selected profile, 0 for the global rules */
+        uint64_t stamp;   /**<Identity of the rules source, for persistent caches */
+} LsiRules;
+
+typedef void (*LsiRulesProfileFunc)(uint32_t app_id, const LsiAutomaton *patterns,
+                                    void *userdata);
+
+/**
+ * Map the first valid rules database found in the user, system and vendor
+ * configuration locations, in that order, as lsi_config_load() does, and
+ * select the profile for @app_id, or the global rules if it has none.
+ *
+ * The builtin tables are used if no database is usable.
+ */
+void lsi_rules_db_load(uint32_t app_id, LsiRules *rules);
+
+/**
+ * Call @func for every app profile of the database @rules was loaded from,
+ * whichever profile was selected. @patterns is only valid during the call.
+ */
+void lsi_rules_db_foreach_profile(const LsiRules *rules, LsiRulesProfileFunc func,
+                                  void *userdata);
+
+/**
+ * The vendor database is compiled from the same rules as the builtin tables,
+ * so only a user or system database can classify a process differently.
+ *
+ * @returns true if either exists, without mapping it
+ */
+bool lsi_rules_db_has_local(void);
+
+/**
+ * Release the database mapped by lsi_rules_db_load(), after which nothing
+ * may use @rules, or anything found through it, again
+ */
+void lsi_rules_db_unload(LsiRules *rules);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
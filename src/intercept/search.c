@@ -0,0 +1,686 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <elf.h>
+#include <libgen.h>
+#include <link.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "../common/process.h"
+#include "abi-check.h"
+#include "arena.h"
+#include "host-resolver.h"
+#include "mono.h"
+#include "search.h"
+#include "nica/util.h"
+
+/**
+ * The rules every decision is made against
+ */
+static const LsiAutomaton *patterns = &lsi_builtin_patterns;
+
+/**
+ * Whether [vendor-upgrade] is in effect
+ */
+static bool upgrades = false;
+
+static bool lsi_override_replace_with_host(const char *orig_name, const char **soname,
+                                           const char *msg);
+static bool lsi_override_soname(unsigned int flag, const char *orig_name,
+                                const LsiPatternMatch *match, const char **soname);
+static bool lsi_override_arch(unsigned int flag, const char *orig_name, const char **soname);
+
+void lsi_search_init(const LsiAutomaton *rules)
+{
+        patterns = rules;
+        upgrades = getenv(LSI_ABI_UPGRADE_ENV) != NULL;
+}
+
+bool lsi_search_upgrades(void)
+{
+        return upgrades;
+}
+
+/**
+ * lsi_search_steam handles whitelisting for the main Steam processes
+ */
+static char *lsi_search_steam(unsigned int flag, const char *name)
+{
+        const char *soname = NULL;
+        LsiPatternMatch match;
+
+        /* Classify against every pattern group in one pass */
+        lsi_automaton_scan(patterns, name, &match);
+
+        /* Preemptively catch transmutations */
+        if (lsi_override_soname(flag, name, &match, &soname)) {
+                return (char *)soname;
+        }
+
+        if (!lsi_file_exists(name)) {
+                return (char *)name;
+        }
+
+        /* i.e. the i386 half of the runtime's LD_LIBRARY_PATH in a 64-bit process */
+        if (lsi_override_arch(flag, name, &soname)) {
+                if (!soname) {
+                        return NULL;
+                }
+                name = soname;
+                lsi_automaton_scan(patterns, name, &match);
+        }
+
+        /* Find out if its a Steam private lib.. These are relative "./" files too! */
+        if (lsi_pattern_match_any(patterns, &match, LSI_PATTERN_STEAM_PATH) ||
+            strncmp(name, "./", 2) == 0) {
+                if (lsi_pattern_match_any(patterns, &match, LSI_PATTERN_STEAM_ALLOWED)) {
+                        return (char *)name;
+                }
+                lsi_log_debug("blacklisted loading of vendor library: \033[34;1m%s\033[0m", name);
+                return NULL;
+        }
+
+        return (char *)name;
+}
+
+bool lsi_search_is_compat_process(const LsiAutomaton *rules)
+{
+        const char *paths[2] = { lsi_process_execfn(), lsi_process_path() };
+        const char *nom = lsi_process_name();
+        LsiPatternMatch match;
+
+        if (nom && lsi_automaton_exact(rules, LSI_PATTERN_COMPAT_PROCESS, nom) >= 0) {
+                return true;
+        }
+
+        for (size_t i = 0; i < ARRAY_SIZE(paths); i++) {
+                if (!paths[i]) {
+                        continue;
+                }
+                lsi_automaton_scan(rules, paths[i], &match);
+                if (lsi_pattern_match_any(rules, &match, LSI_PATTERN_COMPAT_PATH)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Wine and the container tools arrange their own search paths, and only ever
+ * trip over the half of them built for the other architecture.
+ */
+static char *lsi_search_compat(unsigned int flag, const char *name)
+{
+        const char *soname = NULL;
+
+        if (lsi_file_exists(name) && lsi_override_arch(flag, name, &soname)) {
+                return (char *)soname;
+        }
+        return (char *)name;
+}
+
+/**
+ * Under the Steam runtime everything is left to the runtime, besides the
+ * [hybrid-host] libraries, which are answered with the host build whether
+ * they're asked for by soname or found along the runtime's search path.
+ * Should the host not have a build we'll settle for the runtime's copy.
+ * Steam's own processes keep their [steam-allowed] builds, as steamwebhelper
+ * ships the SwiftShader libEGL and libGLESv2 it renders with.
+ */
+static char *lsi_search_hybrid(InterceptMode mode, unsigned int flag, const char *name)
+{
+        const char *soname = NULL;
+        LsiPatternMatch match;
+
+        if (lsi_file_exists(name) && lsi_override_arch(flag, name, &soname)) {
+                if (!soname) {
+                        return NULL;
+                }
+                name = soname;
+        }
+
+        lsi_automaton_scan(patterns, name, &match);
+        if (!lsi_pattern_match_any(patterns, &match, LSI_PATTERN_HYBRID_HOST) ||
+            lsi_pattern_match_any(patterns, &match, LSI_PATTERN_VENDOR_ALLOWED)) {
+                return (char *)name;
+        }
+        if (mode == INTERCEPT_MODE_HYBRID_STEAM &&
+            lsi_pattern_match_any(patterns, &match, LSI_PATTERN_STEAM_ALLOWED)) {
+                return (char *)name;
+        }
+
+        if (lsi_override_replace_with_host(name, &soname, "preferring host library")) {
+                return (char *)soname;
+        }
+        return (char *)name;
+}
+
+/**
+ * Every so often a game comes along that does the following:
+ *
+ * open("path") ? dlopen("path").
+ * Except: path = "*.dll", dlopen() is transformed to ".dll.so"
+ *
+ * This is unrelated to the ".la" errors
+ */
+static bool lsi_override_dll_fail(const char *orig_name, const char **soname)
+{
+        size_t len = strlen(orig_name);
+        char path_lookup[PATH_MAX];
+
+        if (len < 7 || len - 3 >= sizeof(path_lookup)) {
+                return false;
+        }
+
+        if (strncmp(orig_name + (len - 7), ".dll.so", 7) != 0) {
+                return false;
+        }
+
+        memcpy(path_lookup, orig_name, len - 3);
+        path_lookup[len - 3] = '\0';
+
+        if (!lsi_file_exists(path_lookup)) {
+                return false;
+        }
+
+        *soname = lsi_arena_intern(path_lookup);
+        if (!*soname) {
+                return false;
+        }
+        lsi_log_debug("fixed invalid suffix dlopen() \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
+                      orig_name,
+                      *soname);
+        return true;
+}
+
+/**
+ * The ELF class and machine ld.so will accept into this process
+ */
+#if UINTPTR_MAX == 0xffffffffffffffff
+#define LSI_ELF_CLASS ELFCLASS64
+#else
+#define LSI_ELF_CLASS ELFCLASS32
+#endif
+
+#if defined(__x86_64__)
+#define LSI_ELF_MACHINE EM_X86_64
+#elif defined(__i386__)
+#define LSI_ELF_MACHINE EM_386
+#elif defined(__aarch64__)
+#define LSI_ELF_MACHINE EM_AARCH64
+#elif defined(__arm__)
+#define LSI_ELF_MACHINE EM_ARM
+#else
+#define LSI_ELF_MACHINE EM_NONE
+#endif
+
+/**
+ * Directory names games and runtimes use to keep 32-bit and 64-bit builds of
+ * the same library apart, as (32-bit, 64-bit) pairs
+ */
+static const char *arch_dirs[][2] = {
+        { "x86", "x86_64" },
+        { "x86", "x64" },
+        { "lib", "lib64" },
+        { "lib32", "lib64" },
+        { "lib32", "lib" },
+        { "i386", "amd64" },
+        { "i386", "x86_64" },
+        { "i386-linux-gnu", "x86_64-linux-gnu" },
+        { "i686", "x86_64" },
+        { "bin32", "bin64" },
+        { "linux32", "linux64" },
+        { "Linux32", "Linux64" },
+};
+
+/**
+ * Determine if @path is an ELF file that ld.so would refuse to load here.
+ * Files we can't identify are left for ld.so to judge.
+ */
+static bool lsi_is_foreign_arch(const char *path)
+{
+        LsiElfIdent ident;
+
+        if (!lsi_file_elf_ident(path, &ident)) {
+                return false;
+        }
+        if (ident.elf_class != LSI_ELF_CLASS) {
+                return true;
+        }
+        return LSI_ELF_MACHINE != EM_NONE && ident.machine != LSI_ELF_MACHINE;
+}
+
+/**
+ * Find the build of @path for this architecture, by swapping one directory
+ * component for its counterpart, i.e. "Plugins/x86/" for "Plugins/x86_64/"
+ * or "lib/i386/" for "lib/amd64/"
+ */
+static const char *lsi_find_arch_sibling(const char *path)
+{
+        const unsigned int want = LSI_ELF_CLASS == ELFCLASS64 ? 1 : 0;
+        const char *end = strrchr(path, '/');
+        char lookup[PATH_MAX];
+
+        /* Closest directory first */
+        while (end && end > path) {
+                const char *start = end - 1;
+                size_t len;
+
+                while (start > path && *start != '/') {
+                        --start;
+                }
+                if (*start != '/') {
+                        break;
+                }
+                len = (size_t)(end - start - 1);
+
+                for (size_t i = 0; i < ARRAY_SIZE(arch_dirs); i++) {
+                        const char *have = arch_dirs[i][!want];
+                        const char *other = arch_dirs[i][want];
+                        int ret;
+
+                        if (strlen(have) != len || strncmp(start + 1, have, len) != 0) {
+                                continue;
+                        }
+                        ret = snprintf(lookup,
+                                       sizeof(lookup),
+                                       "%.*s/%s%s",
+                                       (int)(start - path),
+                                       path,
+                                       other,
+                                       end);
+                        if (ret < 0 || (size_t)ret >= sizeof(lookup)) {
+                                continue;
+                        }
+                        if (lsi_file_exists(lookup) && !lsi_is_foreign_arch(lookup)) {
+                                return lsi_arena_intern(lookup);
+                        }
+                }
+                end = start;
+        }
+
+        return NULL;
+}
+
+/**
+ * Candidates built for another architecture are spared the trip through
+ * ld.so's open, read and reject cycle.
+ *
+ * Explicit requests, i.e. Mono games looking in the /x86/ plugin directory
+ * from a 64-bit process, are redirected to the build for this architecture
+ * when one exists next to it, and refused otherwise.
+ *
+ * Search path candidates are refused like any blacklisted library, as ld.so
+ * skips a candidate that la_objsearch answers with NULL and carries on with
+ * the next directory.
+ *
+ * @returns True if @orig_name is foreign, with @soname set to the
+ * replacement, or NULL to refuse it
+ */
+static bool lsi_override_arch(unsigned int flag, const char *orig_name, const char **soname)
+{
+        *soname = NULL;
+
+        if (!strchr(orig_name, '/') || !lsi_is_foreign_arch(orig_name)) {
+                return false;
+        }
+
+        if ((flag & LA_SER_ORIG) != LA_SER_ORIG) {
+                lsi_log_debug("skipping library for another architecture: \033[34;1m%s\033[0m",
+                              orig_name);
+                return true;
+        }
+
+        *soname = lsi_find_arch_sibling(orig_name);
+        if (!*soname) {
+                lsi_log_debug("blocked library for another architecture: \033[34;1m%s\033[0m",
+                              orig_name);
+                return true;
+        }
+        lsi_log_debug(
+            "fixed invalid architecture dlopen() \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
+            orig_name,
+            *soname);
+        return true;
+}
+
+/**
+ * Internal helper for path replacement to host lib
+ */
+static bool lsi_override_replace_with_host(const char *orig_name, const char **soname,
+                                           const char *msg)
+{
+        char path_copy[PATH_MAX];
+        const char *host_path = NULL;
+        char *small_name = NULL;
+
+        if (strlen(orig_name) >= sizeof(path_copy)) {
+                return false;
+        }
+        strcpy(path_copy, orig_name);
+
+        small_name = basename(path_copy);
+
+        /* Try to find a system variant of the library for this process
+         * architecture instead of allowing the process to dlopen() the
+         * vendored version.
+         */
+        host_path = lsi_host_resolver_find(small_name);
+        if (!host_path) {
+                return false;
+        }
+
+        /* We hit a match but it was identical to our expectation */
+        if (strcmp(host_path, orig_name) == 0) {
+                return false;
+        }
+
+        *soname = host_path;
+        if (!msg) {
+                return true;
+        }
+        lsi_log_debug("%s \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m", msg, orig_name, host_path);
+        return true;
+}
+
+/**
+ * lsi_override_dlopen is used to override simple dlopen() requests typically
+ * used by Mono games, i.e.:
+ *
+ * <dllmap dll="SDL2.dll" os="linux" cpu="x86-64" target="./lib64/libSDL2-2.0.so.0"/>
+ *
+ * We'll attempt to do a trivial lookup for "/usr/./lib64/libSDL2-2.0.so.0 in this
+ * case.
+ */
+static bool lsi_override_dlopen(const char *orig_name, const char **soname)
+{
+        if (lsi_override_dll_fail(orig_name, soname)) {
+                return true;
+        }
+
+        if (!lsi_file_exists(orig_name)) {
+                return false;
+        }
+
+        return lsi_override_replace_with_host(orig_name, soname, "intercepting vendor dlopen()");
+}
+
+/**
+ * lsi_override_soname will deal with LA_SER_ORIG entries, i.e. the original
+ * soname request when the linker tries to load a library.
+ *
+ * Certain Steam games (notably Feral Interactive ports) use their own vendored
+ * SDL libraries with changed sonames, which are implicitly blacklisted by the
+ * lsi_blacklist_vendor function.
+ *
+ * As such, we intercept those renamed libraries, and convert their names back
+ * to the ABI stable system libraries on the fly.
+ */
+static bool lsi_override_soname(unsigned int flag, const char *orig_name,
+                                const LsiPatternMatch *match, const char **soname)
+{
+        const LsiPatternGroup group = LSI_PATTERN_VENDOR_TRANSMUTE;
+
+        *soname = NULL;
+
+        /* We only need to deal with LA_SER_ORIG */
+        if ((flag & LA_SER_ORIG) != LA_SER_ORIG) {
+                return false;
+        }
+
+        /* Don't transform dlopen */
+        if (strstr(orig_name, "/")) {
+                return lsi_override_dlopen(orig_name, soname);
+        }
+
+        for (int i = lsi_pattern_match_next(patterns, match, group, -1); i >= 0;
+             i = lsi_pattern_match_next(patterns, match, group, i)) {
+                const char *target = lsi_automaton_target(patterns, group, i);
+
+                /* Ensure we're not just replacing the same thing here as the
+                 * string would be identical, no real replacement would happen,
+                 * and ld will be confused about memory and die.
+                 */
+                if (streq(orig_name, target)) {
+                        continue;
+                }
+                *soname = target;
+                lsi_log_debug(
+                    "transforming vendor soname: \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
+                    orig_name,
+                    *soname);
+
+                return true;
+        }
+
+        return false;
+}
+
+/**
+ * Vendored libraries matching the blacklist may still be explicitly allowed,
+ * typically by an app profile.
+ */
+static inline bool lsi_is_vendor_blacklisted(const LsiPatternMatch *match)
+{
+        return lsi_pattern_match_any(patterns, match, LSI_PATTERN_VENDOR_BLACKLIST) &&
+               !lsi_pattern_match_any(patterns, match, LSI_PATTERN_VENDOR_ALLOWED);
+}
+
+/**
+ * If the library exists locally, and we're attempting to load this from a
+ * relative location, strongly attempt to actually use the system-version instead.
+ *
+ * Thus, if our CWD is our LD_LIBRARY_PATH and contains "libfreetype.so.6", we'll
+ * try to use the host version of the library if that exists, instead of relying
+ * on the locally vendored, potentially insecure/buggy version.
+ */
+static bool lsi_override_local(unsigned int flag, const char *orig_name,
+                               const LsiPatternMatch *match, const char **soname)
+{
+        *soname = NULL;
+
+        /* We only need to deal with LA_SER_ORIG */
+        if ((flag & LA_SER_ORIG) != LA_SER_ORIG) {
+                return false;
+        }
+
+        /* We only care about relative paths */
+        if (strstr(orig_name, "/")) {
+                return false;
+        }
+
+        /* We also only care about relative paths */
+        if (!lsi_file_exists(orig_name)) {
+                return false;
+        }
+
+        /* Resolve all paths back to the real library path version if they exist */
+        if (!lsi_is_vendor_blacklisted(match)) {
+                return false;
+        }
+        return lsi_override_replace_with_host(orig_name, soname, "forcing use of host library");
+}
+
+/**
+ * Outdated vendored libraries are swapped for the host build, but only when
+ * it's a drop-in replacement for everything the vendored copy exports.
+ */
+static bool lsi_override_upgrade(const char *name, const LsiPatternMatch *match,
+                                 const char **soname)
+{
+        const char *host_path = NULL;
+
+        if (!upgrades || !strchr(name, '/')) {
+                return false;
+        }
+        if (!lsi_pattern_match_any(patterns, match, LSI_PATTERN_VENDOR_UPGRADE) ||
+            lsi_pattern_match_any(patterns, match, LSI_PATTERN_VENDOR_ALLOWED)) {
+                return false;
+        }
+        if (!lsi_override_replace_with_host(name, &host_path, NULL)) {
+                return false;
+        }
+        if (!lsi_abi_check(name, host_path)) {
+                lsi_log_debug("keeping vendor library, host ABI differs: \033[34;1m%s\033[0m",
+                              name);
+                return false;
+        }
+        *soname = host_path;
+        lsi_log_debug("upgrading vendor library \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
+                      name,
+                      host_path);
+        return true;
+}
+
+/**
+ * Mono and Unity try a long list of names for each DllImport, in several
+ * directories, before one of them loads. Answer the first guess with the
+ * library the game ships (or dllmaps) for it so the rest never happen.
+ *
+ * Anything that would load as-is is left alone, including bare names the
+ * host already provides.
+ */
+static bool lsi_override_mono_probe(unsigned int flag, const char *orig_name,
+                                    const char **soname)
+{
+        *soname = NULL;
+
+        /* We only need to deal with LA_SER_ORIG */
+        if ((flag & LA_SER_ORIG) != LA_SER_ORIG) {
+                return false;
+        }
+
+        *soname = lsi_mono_resolve(patterns, orig_name);
+        if (!*soname) {
+                return false;
+        }
+
+        if (lsi_file_exists(orig_name) ||
+            (!strchr(orig_name, '/') && lsi_host_resolver_find(orig_name))) {
+                *soname = NULL;
+                return false;
+        }
+
+        lsi_log_debug("collapsed Mono probe \033[31;1m%s\033[0m -> \033[34;1m%s\033[0m",
+                      orig_name,
+                      *soname);
+        return true;
+}
+
+static char *lsi_blacklist_vendor(unsigned int flag, const char *name)
+{
+        bool file_exists = false;
+        const char *override_soname = NULL;
+        LsiPatternMatch match;
+
+        /* The resolved plugin is then treated like any other request */
+        if (lsi_override_mono_probe(flag, name, &override_soname)) {
+                name = override_soname;
+        }
+
+        /* Find out if it exists */
+        file_exists = lsi_file_exists(name);
+
+        /* Wrong architecture builds never get as far as ld.so */
+        if (file_exists && lsi_override_arch(flag, name, &override_soname)) {
+                if (!override_soname) {
+                        return NULL;
+                }
+                name = override_soname;
+        }
+
+        /* Classify against every pattern group in one pass */
+        lsi_automaton_scan(patterns, name, &match);
+
+        /* Find out if we have to rename some libraries on the fly */
+        if (lsi_override_soname(flag, name, &match, &override_soname)) {
+                return (char *)override_soname;
+        }
+
+        /* Locally exists due to directory foobar */
+        if (lsi_override_local(flag, name, &match, &override_soname)) {
+                return (char *)override_soname;
+        }
+
+        /* Find out if its a Steam private lib.. These are relative "./" files too! */
+        if (lsi_pattern_match_any(patterns, &match, LSI_PATTERN_STEAM_PATH) ||
+            lsi_pattern_match_any(patterns, &match, LSI_PATTERN_LIBRARY_PATH) ||
+            strncmp(name, "./", 2) == 0) {
+                if (!lsi_is_vendor_blacklisted(&match)) {
+                        if (file_exists && lsi_override_upgrade(name, &match, &override_soname)) {
+                                return (char *)override_soname;
+                        }
+                        /* Allowed to exist */
+                        return (char *)name;
+                }
+                if (file_exists) {
+                        lsi_log_debug("blacklisted loading of vendor library: \033[34;1m%s\033[0m",
+                                      name);
+                }
+                return NULL;
+        }
+
+        return (char *)name;
+}
+
+char *lsi_search_decide(InterceptMode mode, unsigned int flag, const char *name)
+{
+        switch (mode) {
+        case INTERCEPT_MODE_STEAM:
+                return lsi_search_steam(flag, name);
+        case INTERCEPT_MODE_VENDOR_OFFENDER:
+                return lsi_blacklist_vendor(flag, name);
+        case INTERCEPT_MODE_COMPAT:
+                return lsi_search_compat(flag, name);
+        case INTERCEPT_MODE_HYBRID:
+        case INTERCEPT_MODE_HYBRID_STEAM:
+                return lsi_search_hybrid(mode, flag, name);
+        case INTERCEPT_MODE_NONE:
+        default:
+                return (char *)name;
+        }
+}
+
+bool lsi_search_is_cacheable(InterceptMode mode, unsigned int flag, const char *name,
+                             const char *result)
+{
+        const char *resolved = NULL;
+
+        if (mode != INTERCEPT_MODE_VENDOR_OFFENDER || (flag & LA_SER_ORIG) != LA_SER_ORIG) {
+                return true;
+        }
+        if (!result || result == name || strchr(name, '/')) {
+                return true;
+        }
+        resolved = lsi_mono_resolve(patterns, name);
+        return !resolved || resolved[0] != '/';
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
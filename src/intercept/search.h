@@ -0,0 +1,88 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+
+#include "matcher.h"
+
+/**
+ * We support a number of modes, but we mostly exist to make Steam behave
+ */
+typedef enum {
+        INTERCEPT_MODE_NONE = 0,
+        INTERCEPT_MODE_STEAM,
+        INTERCEPT_MODE_VENDOR_OFFENDER,
+        INTERCEPT_MODE_COMPAT,       /**<Wine, Proton and the runtime container tools */
+        INTERCEPT_MODE_HYBRID,       /**<Steam runtime, with the host builds of [hybrid-host] */
+        INTERCEPT_MODE_HYBRID_STEAM, /**<Hybrid mode for Steam itself, sparing [steam-allowed] */
+} InterceptMode;
+
+/**
+ * Set by the shim when Steam runs with its own runtime, but the libraries
+ * listed in [hybrid-host] should come from the host
+ */
+#define LSI_HYBRID_ENV "LSI_USE_HYBRID_RUNTIME"
+
+/**
+ * Make all following decisions against @rules
+ */
+void lsi_search_init(const LsiAutomaton *rules);
+
+/**
+ * Determine if the opt-in [vendor-upgrade] rules are in effect, which
+ * changes the decisions made, so persistent caches must account for it.
+ */
+bool lsi_search_upgrades(void);
+
+/**
+ * Determine if the running process is one of Wine, Proton or the Steam
+ * Runtime's container tools, either by its exact name in [compat-process] of
+ * @rules or by its executable (or the script it runs) lying within
+ * [compat-path]. These set up their own library environment and get
+ * INTERCEPT_MODE_COMPAT.
+ */
+bool lsi_search_is_compat_process(const LsiAutomaton *rules);
+
+/**
+ * Evaluate a single la_objsearch request for a process in the given @mode,
+ * without consulting any of the caches. Safe to call from several threads
+ * at once.
+ *
+ * @returns @name to pass it through untouched, NULL to blacklist it, or the
+ * replacement, which remains valid for the process lifetime.
+ */
+char *lsi_search_decide(InterceptMode mode, unsigned int flag, const char *name);
+
+/**
+ * Determine if the @result of lsi_search_decide() may be remembered for
+ * @name, in memory or on disk. Mono probes for a bare name are answered from
+ * the plugins of whichever game is running, found via its executable and
+ * working directory, so they have to be decided afresh every time.
+ */
+bool lsi_search_is_cacheable(InterceptMode mode, unsigned int flag, const char *name,
+                             const char *result);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
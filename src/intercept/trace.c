@@ -0,0 +1,418 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+#include "trace.h"
+
+/**
+ * Traces are written to $LSI_INTERCEPT_TRACE/intercept-$pid.json when the
+ * process exits, in the Chrome trace event format so they can be loaded
+ * straight into chrome://tracing or Perfetto. Timestamps come from
+ * CLOCK_MONOTONIC so traces from several processes line up when merged.
+ */
+#define LSI_TRACE_ENV "LSI_INTERCEPT_TRACE"
+
+typedef enum {
+        LSI_TRACE_SEARCH = 1,
+        LSI_TRACE_OPEN,
+        LSI_TRACE_CLOSE,
+        LSI_TRACE_LINK_MAP,
+        LSI_TRACE_PREINIT,
+} LsiTraceKind;
+
+typedef struct LsiTraceEvent {
+        LsiTraceKind kind;
+        LsiTraceSource source;
+        unsigned int flag;
+        uint32_t object; /**<Index + 1 into trace_objects, 0 if unknown */
+        bool blocked;
+        pid_t tid;
+        uint64_t ts;
+        uint64_t dur;
+        char *name;
+        char *result;
+} LsiTraceEvent;
+
+bool lsi_trace_active = false;
+
+static char *trace_dir = NULL;
+
+/* Events before trace_first were inherited across fork() and belong to the parent */
+static pid_t trace_pid = 0;
+static size_t trace_first = 0;
+
+static LsiTraceEvent *trace_events = NULL;
+static size_t n_trace_events = 0;
+static size_t trace_events_size = 0;
+
+/* Object names, indexed by the cookie we hand out in la_objopen, minus one */
+static char **trace_objects = NULL;
+static size_t n_trace_objects = 0;
+
+/* Start of the current link map update */
+static uint64_t activity_start = 0;
+static unsigned int activity_flag = 0;
+
+void lsi_trace_init(void)
+{
+        const char *dir = getenv(LSI_TRACE_ENV);
+
+        if (!dir || !*dir) {
+                return;
+        }
+        trace_dir = strdup(dir);
+        trace_pid = getpid();
+        lsi_trace_active = trace_dir != NULL;
+}
+
+/**
+ * Forked children inherit our events, which the parent will write itself, so
+ * skip those. The objects are kept as the child shares the same link map.
+ */
+static void lsi_trace_check_fork(void)
+{
+        pid_t pid = getpid();
+
+        if (pid != trace_pid) {
+                trace_pid = pid;
+                trace_first = n_trace_events;
+        }
+}
+
+uint64_t lsi_trace_now(void)
+{
+        struct timespec ts = { 0 };
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Append a new event, returning NULL if we're out of memory
+ */
+static LsiTraceEvent *lsi_trace_push(LsiTraceKind kind, uint64_t ts)
+{
+        LsiTraceEvent *event = NULL;
+
+        lsi_trace_check_fork();
+        if (n_trace_events == trace_events_size) {
+                size_t size = trace_events_size ? trace_events_size * 2 : 256;
+                LsiTraceEvent *events = realloc(trace_events, size * sizeof(LsiTraceEvent));
+                if (!events) {
+                        return NULL;
+                }
+                trace_events = events;
+                trace_events_size = size;
+        }
+
+        event = &trace_events[n_trace_events++];
+        memset(event, 0, sizeof(*event));
+        event->kind = kind;
+        event->ts = ts;
+        event->tid = (pid_t)syscall(SYS_gettid);
+        return event;
+}
+
+/**
+ * Resolve a cookie we handed out back to an object index + 1
+ */
+static inline uint32_t lsi_trace_object(const uintptr_t *cookie)
+{
+        if (!cookie || *cookie == 0 || *cookie > n_trace_objects) {
+                return 0;
+        }
+        return (uint32_t)*cookie;
+}
+
+void lsi_trace_search(const char *name, const char *result, unsigned int flag,
+                      const uintptr_t *cookie, LsiTraceSource source, uint64_t start)
+{
+        uint64_t end = lsi_trace_now();
+        LsiTraceEvent *event = lsi_trace_push(LSI_TRACE_SEARCH, start);
+
+        if (!event) {
+                return;
+        }
+        event->dur = end - start;
+        event->flag = flag;
+        event->source = source;
+        event->object = lsi_trace_object(cookie);
+        event->name = strdup(name);
+        event->blocked = result == NULL;
+        if (result && result != name) {
+                event->result = strdup(result);
+        }
+}
+
+void lsi_trace_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
+{
+        const char *name = map->l_name && *map->l_name ? map->l_name : program_invocation_name;
+        LsiTraceEvent *event = NULL;
+        char **objects = NULL;
+        char *copy = NULL;
+
+        copy = strdup(name);
+        if (!copy) {
+                return;
+        }
+        objects = realloc(trace_objects, (n_trace_objects + 1) * sizeof(char *));
+        if (!objects) {
+                free(copy);
+                return;
+        }
+        trace_objects = objects;
+        trace_objects[n_trace_objects++] = copy;
+        *cookie = n_trace_objects;
+
+        event = lsi_trace_push(LSI_TRACE_OPEN, lsi_trace_now());
+        if (event) {
+                event->object = (uint32_t)n_trace_objects;
+                event->flag = (unsigned int)lmid;
+        }
+}
+
+void lsi_trace_objclose(const uintptr_t *cookie)
+{
+        LsiTraceEvent *event = lsi_trace_push(LSI_TRACE_CLOSE, lsi_trace_now());
+
+        if (event) {
+                event->object = lsi_trace_object(cookie);
+        }
+}
+
+void lsi_trace_activity(const uintptr_t *cookie, unsigned int flag)
+{
+        uint64_t now = lsi_trace_now();
+        LsiTraceEvent *event = NULL;
+
+        if (flag != LA_ACT_CONSISTENT) {
+                activity_start = now;
+                activity_flag = flag;
+                return;
+        }
+        if (activity_start == 0) {
+                return;
+        }
+
+        event = lsi_trace_push(LSI_TRACE_LINK_MAP, activity_start);
+        if (event) {
+                event->dur = now - activity_start;
+                event->flag = activity_flag;
+                event->object = lsi_trace_object(cookie);
+        }
+        activity_start = 0;
+}
+
+void lsi_trace_preinit(const uintptr_t *cookie)
+{
+        LsiTraceEvent *event = lsi_trace_push(LSI_TRACE_PREINIT, lsi_trace_now());
+
+        if (event) {
+                event->object = lsi_trace_object(cookie);
+        }
+}
+
+/**
+ * Write @s as a JSON string literal
+ */
+static void lsi_trace_write_string(FILE *fp, const char *s)
+{
+        fputc('"', fp);
+        for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+                if (*c == '"' || *c == '\\') {
+                        fputc('\\', fp);
+                        fputc(*c, fp);
+                } else if (*c < 0x20) {
+                        fprintf(fp, "\\u%04x", *c);
+                } else {
+                        fputc(*c, fp);
+                }
+        }
+        fputc('"', fp);
+}
+
+static const char *lsi_trace_object_name(uint32_t object)
+{
+        return object ? trace_objects[object - 1] : "unknown";
+}
+
+/**
+ * Human readable LA_SER_* search origin
+ */
+static const char *lsi_trace_search_origin(unsigned int flag)
+{
+        static const struct {
+                unsigned int flag;
+                const char *name;
+        } origins[] = {
+                { LA_SER_ORIG, "orig" },       { LA_SER_LIBPATH, "libpath" },
+                { LA_SER_RUNPATH, "runpath" }, { LA_SER_CONFIG, "config" },
+                { LA_SER_DEFAULT, "default" }, { LA_SER_SECURE, "secure" },
+        };
+
+        for (size_t i = 0; i < ARRAY_SIZE(origins); i++) {
+                if (flag & origins[i].flag) {
+                        return origins[i].name;
+                }
+        }
+        return "unknown";
+}
+
+static const char *lsi_trace_source_name(LsiTraceSource source)
+{
+        switch (source) {
+        case LSI_TRACE_SOURCE_MEMORY:
+                return "decision-cache";
+        case LSI_TRACE_SOURCE_DISK:
+                return "disk-cache";
+        case LSI_TRACE_SOURCE_RULES:
+                return "rules";
+        case LSI_TRACE_SOURCE_NONE:
+        default:
+                return "none";
+        }
+}
+
+static void lsi_trace_write_event(FILE *fp, const LsiTraceEvent *event, pid_t pid)
+{
+        const char *decision = NULL;
+
+        fputs(",\n{\"pid\":", fp);
+        fprintf(fp, "%d,\"tid\":%d,\"ts\":%.3f", pid, event->tid, (double)event->ts / 1000.0);
+
+        switch (event->kind) {
+        case LSI_TRACE_SEARCH:
+                decision = event->blocked ? "block" : event->result ? "replace" : "pass";
+                fprintf(fp, ",\"dur\":%.3f,\"ph\":\"X\",\"cat\":\"search\",\"name\":",
+                        (double)event->dur / 1000.0);
+                lsi_trace_write_string(fp, event->name);
+                fputs(",\"args\":{\"requester\":", fp);
+                lsi_trace_write_string(fp, lsi_trace_object_name(event->object));
+                fprintf(fp,
+                        ",\"origin\":\"%s\",\"source\":\"%s\"",
+                        lsi_trace_search_origin(event->flag),
+                        lsi_trace_source_name(event->source));
+                if (event->result) {
+                        fputs(",\"result\":", fp);
+                        lsi_trace_write_string(fp, event->result);
+                }
+                fprintf(fp, ",\"decision\":\"%s\"}}", decision);
+                break;
+        case LSI_TRACE_OPEN:
+        case LSI_TRACE_CLOSE:
+                fprintf(fp,
+                        ",\"ph\":\"i\",\"s\":\"t\",\"cat\":\"object\",\"name\":\"%s\"",
+                        event->kind == LSI_TRACE_OPEN ? "open" : "close");
+                fputs(",\"args\":{\"object\":", fp);
+                lsi_trace_write_string(fp, lsi_trace_object_name(event->object));
+                if (event->kind == LSI_TRACE_OPEN) {
+                        fprintf(fp, ",\"lmid\":%u", event->flag);
+                }
+                fputs("}}", fp);
+                break;
+        case LSI_TRACE_LINK_MAP:
+                fprintf(fp,
+                        ",\"dur\":%.3f,\"ph\":\"X\",\"cat\":\"link-map\",\"name\":\"%s\"}",
+                        (double)event->dur / 1000.0,
+                        event->flag == LA_ACT_DELETE ? "unload" : "load");
+                break;
+        case LSI_TRACE_PREINIT:
+                fputs(",\"ph\":\"i\",\"s\":\"p\",\"cat\":\"startup\",\"name\":\"preinit\"}", fp);
+                break;
+        default:
+                fputs(",\"ph\":\"i\",\"name\":\"unknown\"}", fp);
+                break;
+        }
+}
+
+/**
+ * Write every recorded event out, the linker won't call us again after this
+ */
+__attribute__((destructor)) static void lsi_trace_shutdown(void)
+{
+        char *path = NULL;
+        FILE *fp = NULL;
+
+        if (!lsi_trace_active) {
+                return;
+        }
+        lsi_trace_active = false;
+        lsi_trace_check_fork();
+
+        if (asprintf(&path, "%s/intercept-%d.json", trace_dir, trace_pid) < 0) {
+                path = NULL;
+                goto end;
+        }
+        fp = fopen(path, "we");
+        if (!fp) {
+                lsi_log_warn("Unable to write trace %s: %s", path, strerror(errno));
+                goto end;
+        }
+
+        fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", fp);
+        fprintf(fp,
+                "{\"pid\":%d,\"ph\":\"M\",\"name\":\"process_name\",\"args\":{\"name\":",
+                trace_pid);
+        lsi_trace_write_string(fp, program_invocation_short_name);
+        fputs("}}", fp);
+        for (size_t i = trace_first; i < n_trace_events; i++) {
+                lsi_trace_write_event(fp, &trace_events[i], trace_pid);
+        }
+        fputs("\n]}\n", fp);
+
+        if (fclose(fp) != 0) {
+                lsi_log_warn("Unable to write trace %s: %s", path, strerror(errno));
+        } else {
+                lsi_log_debug("trace: wrote %zu events to %s", n_trace_events - trace_first, path);
+        }
+
+end:
+        free(path);
+        for (size_t i = 0; i < n_trace_events; i++) {
+                free(trace_events[i].name);
+                free(trace_events[i].result);
+        }
+        free(trace_events);
+        trace_events = NULL;
+        n_trace_events = trace_events_size = trace_first = 0;
+        for (size_t i = 0; i < n_trace_objects; i++) {
+                free(trace_objects[i]);
+        }
+        free(trace_objects);
+        trace_objects = NULL;
+        n_trace_objects = 0;
+        free(trace_dir);
+        trace_dir = NULL;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
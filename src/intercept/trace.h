@@ -0,0 +1,85 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <link.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Where an la_objsearch decision came from
+ */
+typedef enum {
+        LSI_TRACE_SOURCE_NONE = 0,   /**<Intercept isn't active for this process */
+        LSI_TRACE_SOURCE_MEMORY,     /**<In-process decision cache */
+        LSI_TRACE_SOURCE_DISK,       /**<Persistent decision cache */
+        LSI_TRACE_SOURCE_RULES,      /**<Freshly evaluated against the rules */
+} LsiTraceSource;
+
+/**
+ * Set when LSI_INTERCEPT_TRACE names a directory to write traces into
+ */
+extern bool lsi_trace_active;
+
+/**
+ * Enable tracing if requested by the environment. Called once from la_version.
+ */
+void lsi_trace_init(void);
+
+/**
+ * Monotonic timestamp in nanoseconds
+ */
+uint64_t lsi_trace_now(void);
+
+/**
+ * Record a completed la_objsearch, from @start until now. @cookie is the
+ * requesting object, as tagged by lsi_trace_objopen.
+ */
+void lsi_trace_search(const char *name, const char *result, unsigned int flag,
+                      const uintptr_t *cookie, LsiTraceSource source, uint64_t start);
+
+/**
+ * Record an object being opened, tagging @cookie so later searches made on
+ * behalf of this object can name it.
+ */
+void lsi_trace_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie);
+
+/**
+ * Record an object being closed
+ */
+void lsi_trace_objclose(const uintptr_t *cookie);
+
+/**
+ * Record the start (LA_ACT_ADD/LA_ACT_DELETE) or end (LA_ACT_CONSISTENT) of
+ * a link map update.
+ */
+void lsi_trace_activity(const uintptr_t *cookie, unsigned int flag);
+
+/**
+ * Record the point where loading is complete and constructors start running
+ */
+void lsi_trace_preinit(const uintptr_t *cookie);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -134,6 +134,27 @@ bool lsi_config_load(LsiConfig *config)
                 map_val = NULL;
         }
 
+        /* Do we want libintercept without the audit? */
+        map_val = nc_hashmap_get(nc_hashmap_get(mconfig, "Steam"), "use-intercept-preload");
+        if (map_val) {
+                config->use_intercept_preload = lsi_is_boolean_true(map_val);
+                map_val = NULL;
+        }
+
+        /* Do we want outdated vendored libraries replaced? */
+        map_val = nc_hashmap_get(nc_hashmap_get(mconfig, "Steam"), "use-intercept-upgrades");
+        if (map_val) {
+                config->use_intercept_upgrades = lsi_is_boolean_true(map_val);
+                map_val = NULL;
+        }
+
+        /* Do we want the Steam runtime with some host libraries? */
+        map_val = nc_hashmap_get(nc_hashmap_get(mconfig, "Steam"), "use-hybrid-runtime");
+        if (map_val) {
+                config->use_hybrid_runtime = lsi_is_boolean_true(map_val);
+                map_val = NULL;
+        }
+
         /* Check if 32-bit is being forced */
         map_val = nc_hashmap_get(nc_hashmap_get(mconfig, "Steam"), "force-32bit");
         if (map_val) {
@@ -182,12 +203,16 @@ bool lsi_config_store(LsiConfig *config)
         }
         if (fprintf(fp,
                     "[Steam]\nuse-native-runtime = %s\nforce-32bit = %s\nuse-libintercept = "
-                    "%s\nuse-libredirect = %s\nuse-unity-hack = %s\n",
+                    "%s\nuse-libredirect = %s\nuse-unity-hack = %s\nuse-intercept-preload = "
+                    "%s\nuse-intercept-upgrades = %s\nuse-hybrid-runtime = %s\n",
                     lsi_bool_to_string(config->use_native_runtime),
                     lsi_bool_to_string(config->force_32),
                     lsi_bool_to_string(config->use_libintercept),
                     lsi_bool_to_string(config->use_libredirect),
-                    lsi_bool_to_string(config->use_unity_hack)) < 0) {
+                    lsi_bool_to_string(config->use_unity_hack),
+                    lsi_bool_to_string(config->use_intercept_preload),
+                    lsi_bool_to_string(config->use_intercept_upgrades),
+                    lsi_bool_to_string(config->use_hybrid_runtime)) < 0) {
                 return false;
         }
         return true;
@@ -204,6 +229,9 @@ void lsi_config_load_defaults(LsiConfig *config)
         config->use_libintercept = true;
         config->use_libredirect = true;
         config->use_unity_hack = true;
+        config->use_intercept_preload = false;
+        config->use_intercept_upgrades = false;
+        config->use_hybrid_runtime = false;
 }
 
 void lsi_report_failure(const char *s, ...)
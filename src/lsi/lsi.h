@@ -26,11 +26,14 @@
  * Current Linux Steam Integration settings.
  */
 typedef struct LsiConfig {
-        bool force_32;           /**<Do we force 32-bit? */
-        bool use_native_runtime; /**<Do we force our native runtime? */
-        bool use_libintercept;   /**<Do we force libintercept? */
-        bool use_libredirect;    /**<Do we force libredirect? */
-        bool use_unity_hack;     /**<Do we enable unity3d hack? */
+        bool force_32;              /**<Do we force 32-bit? */
+        bool use_native_runtime;     /**<Do we force our native runtime? */
+        bool use_libintercept;       /**<Do we force libintercept? */
+        bool use_libredirect;        /**<Do we force libredirect? */
+        bool use_unity_hack;         /**<Do we enable unity3d hack? */
+        bool use_intercept_preload;  /**<Do we use libredirect in place of LD_AUDIT? */
+        bool use_intercept_upgrades; /**<Do we swap outdated vendored libraries? */
+        bool use_hybrid_runtime;     /**<Do we use host graphics libs with the Steam runtime? */
 } LsiConfig;
 
 /**
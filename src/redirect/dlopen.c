@@ -0,0 +1,253 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <link.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/files.h"
+#include "../common/log.h"
+#include "../common/process.h"
+#include "../common/stats.h"
+#include "../intercept/cache.h"
+#include "../intercept/host-resolver.h"
+#include "../intercept/matcher.h"
+#include "../intercept/overlay.h"
+#include "../intercept/rules-db.h"
+#include "nica/util.h"
+
+#include "private.h"
+
+/**
+ * Without the rtld-audit module ld.so never consults us. DT_NEEDED entries
+ * are steered by the overlay the shim places on LD_LIBRARY_PATH, and dlopen()
+ * requests get the same decisions la_objsearch would have made, here.
+ */
+void lsi_dlopen_startup(LsiRedirectTable *lsi_table)
+{
+        const char *root = getenv(LSI_OVERLAY_ENV);
+        const char *nom = lsi_process_name();
+        LsiRules rules = { 0 };
+
+        if (!root || !*root || !nom) {
+                return;
+        }
+
+        lsi_rules_db_load(lsi_get_steam_app_id(), &rules);
+        lsi_search_init(rules.patterns);
+
+        if (lsi_automaton_exact(rules.patterns, LSI_PATTERN_STEAM_PROCESS, nom) < 0) {
+                lsi_table->intercept.mode = lsi_search_is_compat_process(rules.patterns)
+                                                ? INTERCEPT_MODE_COMPAT
+                                                : INTERCEPT_MODE_VENDOR_OFFENDER;
+                return;
+        }
+        lsi_table->intercept.mode = INTERCEPT_MODE_STEAM;
+
+        /* Steam launches the games, so it keeps the overlay for its own class current */
+        if (rules.profile == 0 && !lsi_overlay_prepare(root, &rules)) {
+                lsi_log_warn("unable to prepare the library overlay in %s", root);
+        }
+}
+
+/**
+ * Why the last dlopen() in this thread was refused by us rather than by
+ * ld.so, reported by the next dlerror() in its place
+ */
+static __thread char dlopen_error[256];
+static __thread bool dlopen_error_pending = false;
+
+/**
+ * Fail a dlopen() of @name as ld.so would have, had la_objsearch refused it
+ */
+static void *lsi_dlopen_refuse(const char *name)
+{
+        snprintf(dlopen_error,
+                 sizeof(dlopen_error),
+                 "%s: cannot open shared object file: refused by linux-steam-integration",
+                 name);
+        dlopen_error_pending = true;
+        return NULL;
+}
+
+char *lsi_dlopen_error(LsiRedirectTable *lsi_table)
+{
+        if (dlopen_error_pending) {
+                dlopen_error_pending = false;
+                return dlopen_error;
+        }
+        return lsi_table->dlerror();
+}
+
+/**
+ * Make a decision as la_objsearch would, through the same in-process cache
+ */
+static char *lsi_dlopen_decide(InterceptMode mode, unsigned int flag, const char *name)
+{
+        char *ret = NULL;
+
+        if (lsi_decision_cache_lookup(name, flag, mode, &ret)) {
+                return ret;
+        }
+        ret = lsi_search_decide(mode, flag, name);
+        if (!lsi_search_is_cacheable(mode, flag, name, ret)) {
+                return ret;
+        }
+        return lsi_decision_cache_store(name, flag, mode, ret);
+}
+
+/**
+ * ld.so searches for a bare name using the DT_RPATH and DT_RUNPATH of the
+ * object calling dlopen(), which is now us. Walk the search path of the real
+ * @caller instead, deciding on every candidate as la_objsearch would, and
+ * only leave ld.so.cache and the default directories to ld.so.
+ *
+ * Once anything was refused, ld.so mustn't search by name again as it would
+ * find the refused candidate all the same, so the host build is loaded by
+ * path instead, if there is one.
+ */
+static void *lsi_dlopen_search(LsiRedirectTable *lsi_table, const void *caller, const char *name,
+                               int flags)
+{
+        InterceptMode mode = lsi_table->intercept.mode;
+        struct link_map *map = NULL;
+        Dl_serinfo size_info = { 0 };
+        Dl_serinfo *info = NULL;
+        Dl_info dl_info = { 0 };
+        const char *host = NULL;
+        bool refused = false;
+        void *handle = NULL;
+
+        /* Already loaded under this name, so ld.so wouldn't search at all */
+        handle = lsi_table->dlopen(name, flags | RTLD_NOLOAD);
+        if (handle) {
+                return handle;
+        }
+
+        if (!dladdr1(caller, &dl_info, (void **)&map, RTLD_DL_LINKMAP) || !map) {
+                goto fallback;
+        }
+        if (dlinfo(map, RTLD_DI_SERINFOSIZE, &size_info) != 0) {
+                goto fallback;
+        }
+        info = malloc(size_info.dls_size);
+        if (!info) {
+                goto fallback;
+        }
+        info->dls_size = size_info.dls_size;
+        info->dls_cnt = size_info.dls_cnt;
+        if (dlinfo(map, RTLD_DI_SERINFO, info) != 0) {
+                goto fallback;
+        }
+
+        for (unsigned int i = 0; i < info->dls_cnt; i++) {
+                const Dl_serpath *entry = &info->dls_serpath[i];
+                char candidate[PATH_MAX];
+                const char *path = candidate;
+                int len;
+
+                /* ld.so.cache is consulted ahead of these */
+                if (entry->dls_flags & LA_SER_DEFAULT) {
+                        break;
+                }
+                len = snprintf(candidate, sizeof(candidate), "%s/%s", entry->dls_name, name);
+                if (len < 0 || (size_t)len >= sizeof(candidate)) {
+                        continue;
+                }
+                if (!lsi_file_exists(candidate)) {
+                        continue;
+                }
+                /* Refused, so carry on with the next directory as ld.so would */
+                path = lsi_dlopen_decide(mode, entry->dls_flags, candidate);
+                if (!path) {
+                        refused = true;
+                        continue;
+                }
+                handle = lsi_table->dlopen(path, flags);
+                if (handle) {
+                        goto end;
+                }
+        }
+
+        if (refused) {
+                host = lsi_host_resolver_find(name);
+                handle = host ? lsi_table->dlopen(host, flags) : lsi_dlopen_refuse(name);
+                goto end;
+        }
+
+fallback:
+        handle = lsi_table->dlopen(name, flags);
+end:
+        free(info);
+        return handle;
+}
+
+/**
+ * Account for a dlopen() decision in the session statistics
+ */
+static void lsi_dlopen_count(const char *name, const char *ret, uint64_t start)
+{
+        lsi_stats_add(LSI_STAT_HOOK_NS, lsi_stats_now() - start);
+        lsi_stats_add(LSI_STAT_LOOKUPS, 1);
+        if (!ret) {
+                lsi_stats_add(LSI_STAT_BLACKLISTED, 1);
+        } else if (ret != name && !streq(ret, name)) {
+                lsi_stats_add(strchr(ret, '/') ? LSI_STAT_HOST_REPLACED : LSI_STAT_TRANSMUTED, 1);
+        }
+}
+
+void *lsi_dlopen_redirect(LsiRedirectTable *lsi_table, const void *caller, const char *p,
+                          int flags)
+{
+        InterceptMode mode = lsi_table->intercept.mode;
+        const char *name = NULL;
+        uint64_t start = 0;
+
+        /* Without the overlay there are no decisions to make, so stay out of ld.so's way */
+        if (mode == INTERCEPT_MODE_NONE) {
+                return lsi_table->dlopen(p, flags);
+        }
+        dlopen_error_pending = false;
+
+        start = lsi_stats ? lsi_stats_now() : 0;
+        name = lsi_dlopen_decide(mode, LA_SER_ORIG, p);
+        if (lsi_stats) {
+                lsi_dlopen_count(p, name, start);
+        }
+        if (!name) {
+                return lsi_dlopen_refuse(p);
+        }
+
+        /* Paths don't depend on who asked for them */
+        if (strchr(name, '/')) {
+                return lsi_table->dlopen(name, flags);
+        }
+        return lsi_dlopen_search(lsi_table, caller, name, flags);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
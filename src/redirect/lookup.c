@@ -0,0 +1,134 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lookup.h"
+#include "redirect.h"
+
+/**
+ * Smallest hash table we'll allocate, kept at most half full
+ */
+#define LSI_REDIRECT_MIN_BUCKETS 16
+
+static inline void lsi_redirect_filter_set(uint64_t *filter, uint32_t bit)
+{
+        bit &= LSI_REDIRECT_FILTER_BITS - 1;
+        filter[bit / 64] |= 1ull << (bit % 64);
+}
+
+static LsiRedirectIndexEntry *lsi_redirect_index_slot(LsiRedirectIndexEntry *buckets,
+                                                      size_t n_buckets, uint64_t hash,
+                                                      const char *path)
+{
+        size_t mask = n_buckets - 1;
+
+        for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+                LsiRedirectIndexEntry *e = &buckets[i];
+                if (!e->redirect) {
+                        return e;
+                }
+                if (e->hash == hash && strcmp(e->redirect->path_source, path) == 0) {
+                        return e;
+                }
+        }
+}
+
+static bool lsi_redirect_index_grow(LsiRedirectIndex *self)
+{
+        size_t n_buckets = self->n_buckets ? self->n_buckets * 2 : LSI_REDIRECT_MIN_BUCKETS;
+        LsiRedirectIndexEntry *buckets = NULL;
+
+        buckets = calloc(n_buckets, sizeof(LsiRedirectIndexEntry));
+        if (!buckets) {
+                return false;
+        }
+
+        for (size_t i = 0; i < self->n_buckets; i++) {
+                LsiRedirectIndexEntry *e = &self->buckets[i];
+                const char *source = NULL;
+
+                if (!e->redirect) {
+                        continue;
+                }
+                source = e->redirect->path_source;
+                *lsi_redirect_index_slot(buckets, n_buckets, e->hash, source) = *e;
+        }
+
+        free(self->buckets);
+        self->buckets = buckets;
+        self->n_buckets = n_buckets;
+        return true;
+}
+
+bool lsi_redirect_index_insert(LsiRedirectIndex *self, LsiRedirect *redirect)
+{
+        const char *source = redirect->path_source;
+        const char *base = strrchr(source, '/');
+        LsiRedirectIndexEntry *e = NULL;
+        uint64_t hash;
+        size_t len;
+
+        if ((self->n_entries + 1) * 2 > self->n_buckets && !lsi_redirect_index_grow(self)) {
+                return false;
+        }
+
+        hash = lsi_redirect_hash(source, strlen(source));
+        e = lsi_redirect_index_slot(self->buckets, self->n_buckets, hash, source);
+        if (!e->redirect) {
+                ++self->n_entries;
+        }
+        e->hash = hash;
+        e->redirect = redirect;
+
+        base = base ? base + 1 : source;
+        len = strlen(base);
+        hash = lsi_redirect_hash(base, len);
+        self->lengths |= lsi_redirect_length_bit(len);
+        lsi_redirect_filter_set(self->filter, (uint32_t)hash);
+        lsi_redirect_filter_set(self->filter, (uint32_t)(hash >> 32));
+        return true;
+}
+
+LsiRedirect *lsi_redirect_index_find(const LsiRedirectIndex *self, const char *path)
+{
+        LsiRedirectIndexEntry *e = NULL;
+        uint64_t hash;
+
+        if (!self->n_entries) {
+                return NULL;
+        }
+        hash = lsi_redirect_hash(path, strlen(path));
+        e = lsi_redirect_index_slot(self->buckets, self->n_buckets, hash, path);
+        return e->redirect;
+}
+
+void lsi_redirect_index_free(LsiRedirectIndex *self)
+{
+        free(self->buckets);
+        memset(self, 0, sizeof(*self));
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
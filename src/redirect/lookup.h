@@ -0,0 +1,142 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size of the Bloom filter over source basenames, in bits. Must be a power
+ * of two no larger than 2^32.
+ */
+#define LSI_REDIRECT_FILTER_BITS 512
+#define LSI_REDIRECT_FILTER_WORDS (LSI_REDIRECT_FILTER_BITS / 64)
+
+/**
+ * Basenames this long or longer share the last bit of the length mask
+ */
+#define LSI_REDIRECT_LENGTH_MAX 63
+
+struct LsiRedirect;
+
+typedef struct LsiRedirectIndexEntry {
+        uint64_t hash;                /**<Hash of the canonical source path */
+        struct LsiRedirect *redirect; /**<Owned by the profile */
+} LsiRedirectIndexEntry;
+
+/**
+ * Path redirects of a single operation, keyed by their canonical source.
+ *
+ * Applications pass relative, symlinked and otherwise untidy paths, so a
+ * path has to be canonicalized before it can be compared with a source.
+ * The final component is the one part that survives canonicalization, as
+ * long as it isn't a symlink itself, so a mask of source basename lengths
+ * and a Bloom filter over source basenames turn away nearly every path
+ * before any system call is made. Only the rest are resolved and looked up.
+ */
+typedef struct LsiRedirectIndex {
+        uint64_t lengths;                           /**<Bit per source basename length */
+        uint64_t filter[LSI_REDIRECT_FILTER_WORDS]; /**<Two bits per source basename */
+        size_t n_entries;
+        size_t n_buckets; /**<Power of two, or 0 while empty */
+        LsiRedirectIndexEntry *buckets;
+} LsiRedirectIndex;
+
+/**
+ * FNV-1a over the first @len bytes of @s
+ */
+static inline uint64_t lsi_redirect_hash(const char *s, size_t len)
+{
+        uint64_t h = 14695981039346656037ull;
+
+        for (size_t i = 0; i < len; i++) {
+                h ^= (uint8_t)s[i];
+                h *= 1099511628211ull;
+        }
+        return h;
+}
+
+static inline uint64_t lsi_redirect_length_bit(size_t len)
+{
+        return 1ull << (len < LSI_REDIRECT_LENGTH_MAX ? len : LSI_REDIRECT_LENGTH_MAX);
+}
+
+static inline bool lsi_redirect_filter_test(const uint64_t *filter, uint32_t bit)
+{
+        bit &= LSI_REDIRECT_FILTER_BITS - 1;
+        return (filter[bit / 64] & (1ull << (bit % 64))) != 0;
+}
+
+/**
+ * Determine if @path, as passed by the application, could possibly name one
+ * of the redirect sources. This never touches the filesystem.
+ *
+ * @returns false if @path is certainly not redirected
+ */
+static inline bool lsi_redirect_index_filter(const LsiRedirectIndex *self, const char *path)
+{
+        const char *base = path;
+        const char *c = path;
+        uint64_t hash;
+        size_t len;
+
+        if (!self->lengths) {
+                return false;
+        }
+
+        for (; *c; c++) {
+                if (*c == '/') {
+                        base = c + 1;
+                }
+        }
+        len = (size_t)(c - base);
+        if (!(self->lengths & lsi_redirect_length_bit(len))) {
+                return false;
+        }
+
+        hash = lsi_redirect_hash(base, len);
+        return lsi_redirect_filter_test(self->filter, (uint32_t)hash) &&
+               lsi_redirect_filter_test(self->filter, (uint32_t)(hash >> 32));
+}
+
+/**
+ * Add @redirect, replacing any earlier redirect of the same source
+ *
+ * @returns false if out of memory
+ */
+bool lsi_redirect_index_insert(LsiRedirectIndex *self, struct LsiRedirect *redirect);
+
+/**
+ * Find the redirect for the canonical path @path
+ *
+ * @returns The redirect, or NULL if @path isn't a source
+ */
+struct LsiRedirect *lsi_redirect_index_find(const LsiRedirectIndex *self, const char *path);
+
+/**
+ * Release the storage of the index, but not the redirects within it
+ */
+void lsi_redirect_index_free(LsiRedirectIndex *self);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
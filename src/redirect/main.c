@@ -11,8 +11,13 @@
 
 #define _GNU_SOURCE
 
+/* open() and open64() etc. are both defined here, so neither may alias the other */
+#undef _FILE_OFFSET_BITS
+
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -29,6 +34,8 @@
 #include "../common/common.h"
 #include "../common/files.h"
 #include "../common/log.h"
+#include "../common/process.h"
+#include "../common/stats.h"
 #include "nica/util.h"
 
 #include "private.h"
@@ -37,11 +44,11 @@
 
 #define _STRINGIFY(x) #x
 
-#define SYMBOL_BINDING(l, x)                                                                       \
+#define SYMBOL_BINDING(x, ret, params)                                                             \
         {                                                                                          \
-                .handle = &lsi_table.handles.l, .name = _STRINGIFY(x),                             \
+                .handle = &lsi_table.handles.libc, .name = _STRINGIFY(x),                          \
                 .func = (void **)(&lsi_table.x), .func_size = sizeof(lsi_table.x)                  \
-        }
+        },
 
 /**
  * Whether we've initialised yet or not.
@@ -87,11 +94,8 @@ static LsiRedirectProfile *lsi_profile = NULL;
  * all of our needed dlsym() functions from libc.so.6.
  */
 static LsiSymbolBinding lsi_libc_bindings[] = {
-        SYMBOL_BINDING(libc, open),
-        SYMBOL_BINDING(libc, fopen64),
-#ifdef HAVE_SNAPD_SUPPORT
-        SYMBOL_BINDING(libc, getpwuid),
-#endif
+        LSI_REDIRECT_LIBC_SYMBOLS(SYMBOL_BINDING)
+        LSI_REDIRECT_SNAPD_SYMBOLS(SYMBOL_BINDING)
 };
 
 /**
@@ -152,6 +156,18 @@ static void lsi_redirect_init_tables(void)
 
         lsi_init = true;
 
+#ifdef HAVE_LIBINTERCEPT
+        /* We replace dlopen() ourselves, so the real one has to be found before
+         * anything, including us, calls it.
+         */
+        if (!lsi_redirect_bind_function(RTLD_NEXT,
+                                        "dlopen",
+                                        (void **)&lsi_table.dlopen,
+                                        sizeof(lsi_table.dlopen))) {
+                goto failed;
+        }
+#endif
+
         /* Try to explicitly open libc. We can't safely rely on RTLD_NEXT
          * as we might be dealing with a strange link order
          */
@@ -193,19 +209,25 @@ __attribute__((constructor)) static void lsi_redirect_init(void)
 {
         /* Ensure we're open. */
         lsi_redirect_init_tables();
-        autofree(char) *process_name = NULL;
+        /* The source index turns nearly every path away before it gets resolved */
+        lsi_file_cache_init(LSI_FILE_CACHE_DISABLE);
+        lsi_stats_attach();
         char **paths = NULL;
         char **orig = NULL;
 
-        /* Absolute path to the process for fine-grained matching */
-        process_name = lsi_get_process_name();
-
-        if (!process_name) {
-                fputs("Out of memory!\n", stderr);
+        /* Generators match against this, nothing to do if we can't tell who we are */
+        if (!lsi_process_name()) {
                 return;
         }
 
         lsi_unity_startup(&lsi_table);
+#ifdef HAVE_LIBINTERCEPT
+        lsi_dlopen_startup(&lsi_table);
+        /* Standing in for libintercept, which isn't loaded to watch anything itself */
+        if (lsi_table.intercept.mode != INTERCEPT_MODE_NONE) {
+                lsi_file_cache_init(LSI_FILE_CACHE_WATCH);
+        }
+#endif
 
         /* Grab the steam installation directories */
         orig = paths = lsi_get_steam_paths();
@@ -213,7 +235,7 @@ __attribute__((constructor)) static void lsi_redirect_init(void)
         /* For each path try to form a valid profile for the process name and Steam directory */
         while (*paths) {
                 for (size_t i = 0; i < ARRAY_SIZE(generators); i++) {
-                        lsi_profile = generators[i](process_name, *paths);
+                        lsi_profile = generators[i](*paths);
                         if (lsi_profile) {
                                 goto use_profile;
                         }
@@ -245,106 +267,282 @@ clean_array:
 }
 
 /**
- * Get a redirect path from the table if it exists, otherwise return NULL
+ * Get a redirect path from the table if it exists, otherwise return NULL.
+ * Relative paths are relative to @dirfd, as with openat()
  */
-static char *lsi_get_redirect_path(const char *syscall_id, LsiRedirectOperation op, const char *p)
+static char *lsi_get_redirect_path(const char *syscall_id, LsiRedirectOperation op, int dirfd,
+                                   const char *p)
 {
+        const LsiRedirectIndex *index = &lsi_profile->op_index[op];
+        char fd_path[PATH_MAX];
         autofree(char) *path = NULL;
         LsiRedirect *redirect = NULL;
 
-        /* Get the absolute path here */
-        path = realpath(p, NULL);
-        if (!path) {
+        /* Nearly every asset the game reads is turned away here, without a syscall */
+        if (!lsi_redirect_index_filter(index, p)) {
                 return NULL;
         }
 
-        /* find a valid replacement */
-        for (redirect = lsi_profile->op_table[op]; redirect; redirect = redirect->next) {
-                /* Currently we only known path replacements */
-                if (redirect->type != LSI_REDIRECT_PATH) {
-                        continue;
-                }
-                if (strcmp(redirect->path_source, path) != 0) {
-                        continue;
-                }
-                if (!lsi_file_exists(redirect->path_target)) {
-                        lsi_log_warn("Replacement path does not exist: %s", redirect->path_target);
+        /* The kernel resolves the directory of the descriptor for us. Descriptors are
+         * reused and procfs never raises inotify events, so this can't be cached. */
+        if (dirfd != AT_FDCWD && p[0] != '/') {
+                if (snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d/%s", dirfd, p) >=
+                    (int)sizeof(fd_path)) {
                         return NULL;
                 }
-                lsi_log_info("%s(): Replaced '%s' with '%s'",
-                             syscall_id,
-                             path,
-                             redirect->path_target);
-                return strdup(redirect->path_target);
+                path = realpath(fd_path, NULL);
+        } else {
+                /* Get the absolute path here */
+                path = lsi_file_realpath(p);
+        }
+        if (!path) {
+                return NULL;
         }
 
-        /* Got nothin' */
-        return NULL;
+        /* find a valid replacement */
+        redirect = lsi_redirect_index_find(index, path);
+        if (!redirect) {
+                /* Got nothin' */
+                return NULL;
+        }
+        if (!lsi_file_exists(redirect->path_target)) {
+                lsi_log_warn("Replacement path does not exist: %s", redirect->path_target);
+                return NULL;
+        }
+        lsi_log_info("%s(): Replaced '%s' with '%s'", syscall_id, path, redirect->path_target);
+        return strdup(redirect->path_target);
 }
 
-_nica_public_ int open(const char *p, int flags, ...)
+/**
+ * Look up a redirect, accounting for it in the session statistics
+ */
+static char *lsi_redirect_lookup(const char *syscall_id, LsiRedirectOperation op, int dirfd,
+                                 const char *p)
 {
-        va_list va;
-        mode_t mode;
-        LsiRedirectOperation op = LSI_OPERATION_OPEN;
-        autofree(char) *replacement = NULL;
+        uint64_t start;
+        char *ret = NULL;
+
+        if (!lsi_stats) {
+                return lsi_get_redirect_path(syscall_id, op, dirfd, p);
+        }
+
+        start = lsi_stats_now();
+        ret = lsi_get_redirect_path(syscall_id, op, dirfd, p);
+        lsi_stats_add(LSI_STAT_HOOK_NS, lsi_stats_now() - start);
+        if (ret) {
+                lsi_stats_add(LSI_STAT_REDIRECTED, 1);
+        }
+        return ret;
+}
 
+/**
+ * Every hook of the open family comes through here, so they all share the
+ * same fast path and the same rules. Processes without a profile pay for
+ * little more than the two flag checks.
+ *
+ * @returns The replacement for @p, to be freed by the caller, or NULL to
+ * use @p as is
+ */
+static inline char *lsi_redirect_open_path(const char *syscall_id, int dirfd, const char *p)
+{
         /* Must ensure we're **really** initialised, as we might see open happen
          * before the constructor..
          */
         lsi_redirect_init_tables();
 
-        /* Grab the mode_t */
-        va_start(va, flags);
-        mode = va_arg(va, mode_t);
-        va_end(va);
+        if (!p) {
+                return NULL;
+        }
 
         lsi_maybe_init_unity3d(&lsi_table, p);
 
         /* Not interested in this guy apparently */
         if (!lsi_override) {
-                goto fallback_open;
+                return NULL;
         }
+        return lsi_redirect_lookup(syscall_id, LSI_OPERATION_OPEN, dirfd, p);
+}
 
-        replacement = lsi_get_redirect_path("open", op, p);
-        if (replacement) {
-                return lsi_table.open(replacement, flags, mode);
-        }
+/**
+ * The mode argument is only passed along with flags that may create a file
+ */
+static inline bool lsi_open_needs_mode(int flags)
+{
+        return (flags & O_CREAT) == O_CREAT || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+/**
+ * Grab the mode_t of an open() style call into @mode, following @flags
+ */
+#define LSI_OPEN_MODE(flags, mode)                                                                 \
+        do {                                                                                       \
+                if (lsi_open_needs_mode(flags)) {                                                  \
+                        va_list va;                                                                \
+                        va_start(va, flags);                                                       \
+                        mode = va_arg(va, mode_t);                                                 \
+                        va_end(va);                                                                \
+                }                                                                                  \
+        } while (0)
+
+_nica_public_ int open(const char *p, int flags, ...)
+{
+        autofree(char) *replacement = NULL;
+        mode_t mode = 0;
 
-fallback_open:
-        return lsi_table.open(p, flags, mode);
+        LSI_OPEN_MODE(flags, mode);
+        replacement = lsi_redirect_open_path("open", AT_FDCWD, p);
+
+        return lsi_table.open(replacement ? replacement : p, flags, mode);
 }
 
-_nica_public_ FILE *fopen64(const char *p, const char *modes)
+_nica_public_ int open64(const char *p, int flags, ...)
 {
-        LsiRedirectOperation op = LSI_OPERATION_OPEN;
         autofree(char) *replacement = NULL;
+        mode_t mode = 0;
 
-        /* Must ensure we're **really** initialised, as we might see open happen
-         * before the constructor..
-         */
-        lsi_redirect_init_tables();
+        LSI_OPEN_MODE(flags, mode);
+        replacement = lsi_redirect_open_path("open64", AT_FDCWD, p);
 
-        lsi_maybe_init_unity3d(&lsi_table, p);
+        return lsi_table.open64(replacement ? replacement : p, flags, mode);
+}
 
-        /* Not interested in this guy apparently */
-        if (!lsi_override) {
-                goto fallback_open;
-        }
+_nica_public_ int __open_2(const char *p, int flags)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("__open_2", AT_FDCWD, p);
+
+        return lsi_table.__open_2(replacement ? replacement : p, flags);
+}
+
+_nica_public_ int __open64_2(const char *p, int flags)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("__open64_2", AT_FDCWD, p);
+
+        return lsi_table.__open64_2(replacement ? replacement : p, flags);
+}
+
+_nica_public_ int openat(int dirfd, const char *p, int flags, ...)
+{
+        autofree(char) *replacement = NULL;
+        mode_t mode = 0;
+
+        LSI_OPEN_MODE(flags, mode);
+        replacement = lsi_redirect_open_path("openat", dirfd, p);
+
+        return lsi_table.openat(dirfd, replacement ? replacement : p, flags, mode);
+}
+
+_nica_public_ int openat64(int dirfd, const char *p, int flags, ...)
+{
+        autofree(char) *replacement = NULL;
+        mode_t mode = 0;
+
+        LSI_OPEN_MODE(flags, mode);
+        replacement = lsi_redirect_open_path("openat64", dirfd, p);
+
+        return lsi_table.openat64(dirfd, replacement ? replacement : p, flags, mode);
+}
+
+_nica_public_ int __openat_2(int dirfd, const char *p, int flags)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("__openat_2", dirfd, p);
+
+        return lsi_table.__openat_2(dirfd, replacement ? replacement : p, flags);
+}
+
+_nica_public_ int __openat64_2(int dirfd, const char *p, int flags)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("__openat64_2", dirfd, p);
+
+        return lsi_table.__openat64_2(dirfd, replacement ? replacement : p, flags);
+}
+
+_nica_public_ int creat(const char *p, mode_t mode)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("creat", AT_FDCWD, p);
+
+        return lsi_table.creat(replacement ? replacement : p, mode);
+}
+
+_nica_public_ int creat64(const char *p, mode_t mode)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("creat64", AT_FDCWD, p);
+
+        return lsi_table.creat64(replacement ? replacement : p, mode);
+}
+
+_nica_public_ FILE *fopen(const char *p, const char *modes)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("fopen", AT_FDCWD, p);
 
-        replacement = lsi_get_redirect_path("fopen64", op, p);
         if (replacement) {
-                return lsi_table.fopen64(replacement, modes);
+                return lsi_table.fopen(replacement, modes);
         }
+        if (p && is_unity3d_prefs_file(&lsi_table, p)) {
+                return lsi_unity_redirect(&lsi_table, p, modes);
+        }
+        return lsi_table.fopen(p, modes);
+}
 
-fallback_open:
+_nica_public_ FILE *fopen64(const char *p, const char *modes)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("fopen64", AT_FDCWD, p);
 
-        if (is_unity3d_prefs_file(&lsi_table, p)) {
+        if (replacement) {
+                return lsi_table.fopen64(replacement, modes);
+        }
+        if (p && is_unity3d_prefs_file(&lsi_table, p)) {
                 return lsi_unity_redirect(&lsi_table, p, modes);
         }
         return lsi_table.fopen64(p, modes);
 }
 
+_nica_public_ FILE *freopen(const char *p, const char *modes, FILE *stream)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("freopen", AT_FDCWD, p);
+
+        return lsi_table.freopen(replacement ? replacement : p, modes, stream);
+}
+
+_nica_public_ FILE *freopen64(const char *p, const char *modes, FILE *stream)
+{
+        autofree(char) *replacement = lsi_redirect_open_path("freopen64", AT_FDCWD, p);
+
+        return lsi_table.freopen64(replacement ? replacement : p, modes, stream);
+}
+
+#ifdef HAVE_LIBINTERCEPT
+
+_nica_public_ void *dlopen(const char *p, int flags)
+{
+        /* Must ensure we're **really** initialised, as library constructors
+         * may well dlopen() before ours has run
+         */
+        lsi_redirect_init_tables();
+
+        if (!p) {
+                return lsi_table.dlopen(p, flags);
+        }
+        return lsi_dlopen_redirect(&lsi_table, __builtin_return_address(0), p, flags);
+}
+
+/**
+ * Our own refusals have to be reported through dlerror() too. The real one is
+ * bound here on first use, as binding everything else already calls it.
+ */
+_nica_public_ char *dlerror(void)
+{
+        if (!lsi_table.dlerror) {
+                void *real = dlsym(RTLD_NEXT, "dlerror");
+                memcpy(&lsi_table.dlerror, &real, sizeof(lsi_table.dlerror));
+                if (!lsi_table.dlerror) {
+                        return NULL;
+                }
+        }
+        return lsi_dlopen_error(&lsi_table);
+}
+
+#endif
+
 #ifdef HAVE_SNAPD_SUPPORT
 
 #include <unistd.h>
@@ -13,6 +13,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #include "config.h"
 
@@ -20,26 +21,57 @@
 #include <pwd.h>
 #endif
 
+#ifdef HAVE_LIBINTERCEPT
+#include "../intercept/search.h"
+#endif
+
 /**
- * Handle definitions
+ * Every libc function we interpose, as X(name, return type, parameters).
+ *
+ * Each gets a member of LsiRedirectTable to hold the real function, which
+ * is bound from libc.so.6 on startup, so adding a hook takes one line here
+ * besides the hook itself. The whole open family goes through the same
+ * redirect lookup, as anything missing here is a way around it.
  */
-typedef int (*lsi_open_file)(const char *p, int flags, mode_t mode);
-
-typedef FILE *(*lsi_fopen64_file)(const char *p, const char *modes);
+#define LSI_REDIRECT_LIBC_SYMBOLS(X)                                                               \
+        X(open, int, (const char *, int, ...))                                                     \
+        X(open64, int, (const char *, int, ...))                                                   \
+        X(__open_2, int, (const char *, int))                                                      \
+        X(__open64_2, int, (const char *, int))                                                    \
+        X(openat, int, (int, const char *, int, ...))                                              \
+        X(openat64, int, (int, const char *, int, ...))                                            \
+        X(__openat_2, int, (int, const char *, int))                                               \
+        X(__openat64_2, int, (int, const char *, int))                                             \
+        X(creat, int, (const char *, mode_t))                                                      \
+        X(creat64, int, (const char *, mode_t))                                                    \
+        X(fopen, FILE *, (const char *, const char *))                                             \
+        X(fopen64, FILE *, (const char *, const char *))                                           \
+        X(freopen, FILE *, (const char *, const char *, FILE *))                                   \
+        X(freopen64, FILE *, (const char *, const char *, FILE *))
 
 #ifdef HAVE_SNAPD_SUPPORT
-typedef struct passwd *(*lsi_getpwuid)(uid_t uid);
+#define LSI_REDIRECT_SNAPD_SYMBOLS(X) X(getpwuid, struct passwd *, (uid_t))
+#else
+#define LSI_REDIRECT_SNAPD_SYMBOLS(X)
+#endif
+
+#define LSI_REDIRECT_DECLARE_SYMBOL(name, ret, params) ret(*name) params;
+
+#ifdef HAVE_LIBINTERCEPT
+typedef void *(*lsi_dlopen_file)(const char *p, int flags);
+typedef char *(*lsi_dlerror_func)(void);
 #endif
 
 /**
  * Global storage of handles for nicer organisation.
  */
 typedef struct LsiRedirectTable {
-        lsi_open_file open;
-        lsi_fopen64_file fopen64;
+        LSI_REDIRECT_LIBC_SYMBOLS(LSI_REDIRECT_DECLARE_SYMBOL)
+        LSI_REDIRECT_SNAPD_SYMBOLS(LSI_REDIRECT_DECLARE_SYMBOL)
 
-#ifdef HAVE_SNAPD_SUPPORT
-        lsi_getpwuid getpwuid;
+#ifdef HAVE_LIBINTERCEPT
+        lsi_dlopen_file dlopen;
+        lsi_dlerror_func dlerror;
 #endif
 
         /* Allow future handle opens.. */
@@ -56,6 +88,13 @@ typedef struct LsiRedirectTable {
                 bool failed;
                 bool had_init;
         } unity3d;
+
+#ifdef HAVE_LIBINTERCEPT
+        /* libintercept decisions for dlopen() when there's no LD_AUDIT */
+        struct {
+                InterceptMode mode;
+        } intercept;
+#endif
 } LsiRedirectTable;
 
 void lsi_unity_startup(LsiRedirectTable *lsi_table);
@@ -69,6 +108,14 @@ FILE *lsi_unity_get_config_file(LsiRedirectTable *lsi_table, const char *modes);
 void lsi_unity_trim_copy_config(FILE *from, FILE *to);
 bool is_unity3d_prefs_file(LsiRedirectTable *lsi_table, const char *p);
 
+#ifdef HAVE_LIBINTERCEPT
+/* API Definitions for the dlopen() handler */
+void lsi_dlopen_startup(LsiRedirectTable *lsi_table);
+void *lsi_dlopen_redirect(LsiRedirectTable *lsi_table, const void *caller, const char *p,
+                          int flags);
+char *lsi_dlopen_error(LsiRedirectTable *lsi_table);
+#endif
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
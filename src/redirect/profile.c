@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../common/files.h"
 #include "../common/log.h"
 #include "redirect.h"
 
@@ -42,6 +43,7 @@ void lsi_redirect_profile_free(LsiRedirectProfile *self)
         /* Free all chains */
         for (unsigned int i = 0; i < LSI_NUM_OPERATIONS; i++) {
                 LsiRedirect *r = self->op_table[i];
+                lsi_redirect_index_free(&self->op_index[i]);
                 if (!r) {
                         continue;
                 }
@@ -63,7 +65,12 @@ void lsi_redirect_profile_insert_rule(LsiRedirectProfile *self, LsiRedirect *red
         default:
                 lsi_log_error("Attempted insert of unknown rule into '%s'", self->name);
                 lsi_redirect_free(redirect);
-                break;
+                return;
+        }
+
+        /* Later rules take priority, just as they do within the chain */
+        if (!lsi_redirect_index_insert(&self->op_index[op], redirect)) {
+                lsi_log_error("Out of memory indexing rule for '%s'", self->name);
         }
 
         /* Set head or prepend the rule */
@@ -84,8 +91,8 @@ LsiRedirect *lsi_redirect_new_path_replacement(const char *source_path, const ch
                 return NULL;
         }
         ret->type = LSI_REDIRECT_PATH;
-        ret->path_source = realpath(source_path, NULL);
-        ret->path_target = realpath(target_path, NULL);
+        ret->path_source = lsi_file_realpath(source_path);
+        ret->path_target = lsi_file_realpath(target_path);
 
         if (!ret->path_source || !ret->path_target) {
                 lsi_redirect_free(ret);
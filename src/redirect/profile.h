@@ -18,19 +18,19 @@
 
 /**
  * Generator function is used to attempt creation of profiles based on the
- * steam directory
+ * steam directory, when the running process is the one the profile is for
  */
-typedef LsiRedirectProfile *(*lsi_profile_generator_func)(char *process_name, char *steam_root);
+typedef LsiRedirectProfile *(*lsi_profile_generator_func)(char *steam_root);
 
 /**
  * Profile generator for Ark survival evolved
  */
-LsiRedirectProfile *lsi_redirect_profile_new_ark(char *process_name, char *steam_root);
+LsiRedirectProfile *lsi_redirect_profile_new_ark(char *steam_root);
 
 /**
  * Profile generator for Project Highrise
  */
-LsiRedirectProfile *lsi_redirect_profile_new_project_highrise(char *process_name, char *steam_root);
+LsiRedirectProfile *lsi_redirect_profile_new_project_highrise(char *steam_root);
 
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
@@ -14,14 +14,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../common/files.h"
 #include "../common/log.h"
+#include "../common/process.h"
 #include "nica/util.h"
 #include "profile.h"
 #include "redirect.h"
 
 #define ARK_BASE "steamapps/common/ARK/ShooterGame"
 #define ARK_CONTENT ARK_BASE "/Content"
-#define ARK_BINARY ARK_BASE "/Binaries/Linux/ShooterGame"
+#define ARK_BINARY_NAME "ShooterGame"
+#define ARK_BINARY ARK_BASE "/Binaries/Linux/" ARK_BINARY_NAME
 
 /**
  * This generator function is responsible for supporting ARK: Survival Evolved
@@ -29,7 +32,7 @@
  * Simply it redirects the executable to open the correct asset when TheCenter
  * DLC is installed.
  */
-LsiRedirectProfile *lsi_redirect_profile_new_ark(char *process_name, char *steam_path)
+LsiRedirectProfile *lsi_redirect_profile_new_ark(char *steam_path)
 {
         LsiRedirectProfile *p = NULL;
         LsiRedirect *redirect = NULL;
@@ -38,18 +41,23 @@ LsiRedirectProfile *lsi_redirect_profile_new_ark(char *process_name, char *steam
         autofree(char) *match_process = NULL;
         autofree(char) *test_process = NULL;
 
+        /* Nothing to resolve unless the name already matches */
+        if (!lsi_process_has_name(ARK_BINARY_NAME)) {
+                return NULL;
+        }
+
         if (asprintf(&match_process, "%s/%s", steam_path, ARK_BINARY) < 0) {
                 return NULL;
         }
 
         /* Check it even exists */
-        test_process = realpath(match_process, NULL);
+        test_process = lsi_file_realpath(match_process);
         if (!test_process) {
                 return NULL;
         }
 
         /* Check the process name now */
-        if (strcmp(test_process, process_name) != 0) {
+        if (!lsi_process_has_path(test_process)) {
                 return NULL;
         }
 
@@ -17,6 +17,7 @@
 
 #include "../common/files.h"
 #include "../common/log.h"
+#include "../common/process.h"
 #include "nica/util.h"
 #include "profile.h"
 #include "redirect.h"
@@ -25,10 +26,11 @@
 #define PHR_PREF_FILE "unity3d/SomaSim/Project Highrise/prefs/prefs.txt"
 
 #if UINTPTR_MAX == 0xffffffffffffffff
-#define PHR_BINARY "steamapps/common/Project Highrise/Game.x86_64"
+#define PHR_BINARY_NAME "Game.x86_64"
 #else
-#define PHR_BINARY "steamapps/common/Project Highrise/Game.x86"
+#define PHR_BINARY_NAME "Game.x86"
 #endif
+#define PHR_BINARY "steamapps/common/Project Highrise/" PHR_BINARY_NAME
 
 /**
  * This generator function is responsible for supporting: Project Highrise
@@ -39,7 +41,7 @@
  *
  * This is a temporary workaround and we'll let them know what we found.
  */
-LsiRedirectProfile *lsi_redirect_profile_new_project_highrise(char *process_name, char *steam_path)
+LsiRedirectProfile *lsi_redirect_profile_new_project_highrise(char *steam_path)
 {
         LsiRedirectProfile *p = NULL;
         LsiRedirect *redirect = NULL;
@@ -49,18 +51,23 @@ LsiRedirectProfile *lsi_redirect_profile_new_project_highrise(char *process_name
         autofree(char) *test_process = NULL;
         autofree(char) *config_dir = NULL;
 
+        /* Nothing to resolve unless the name already matches */
+        if (!lsi_process_has_name(PHR_BINARY_NAME)) {
+                return NULL;
+        }
+
         if (asprintf(&match_process, "%s/%s", steam_path, PHR_BINARY) < 0) {
                 return NULL;
         }
 
         /* Check it even exists */
-        test_process = realpath(match_process, NULL);
+        test_process = lsi_file_realpath(match_process);
         if (!test_process) {
                 return NULL;
         }
 
         /* Check the process name now */
-        if (strcmp(test_process, process_name) != 0) {
+        if (!lsi_process_has_path(test_process)) {
                 return NULL;
         }
 
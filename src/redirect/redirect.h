@@ -14,6 +14,8 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "lookup.h"
+
 /**
  * The type of redirect required
  */
@@ -48,11 +50,15 @@ typedef enum { LSI_OPERATION_OPEN = 0, LSI_NUM_OPERATIONS } LsiRedirectOperation
  * op, i.e:
  *
  *      op_table[LSI_OPERATION_OPEN]
+ *
+ * The path redirects of each op are also indexed by source, which is what
+ * the hooks look them up through.
  */
 typedef struct LsiRedirectProfile {
         char *name; /**< Name for this profile */
 
-        LsiRedirect *op_table[LSI_NUM_OPERATIONS]; /* vtable information */
+        LsiRedirect *op_table[LSI_NUM_OPERATIONS];     /* vtable information */
+        LsiRedirectIndex op_index[LSI_NUM_OPERATIONS]; /* path redirects by source */
 } LsiRedirectProfile;
 
 /**
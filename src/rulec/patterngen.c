@@ -0,0 +1,230 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rules.h"
+
+/**
+ * Build-time helper: compile the intercept pattern tables into static const
+ * C tables describing one Aho-Corasick automaton for the global rules, and
+ * one for each app profile.
+ *
+ *      lsi-patterngen [-D name[=value]]... patterns.rules patterns.c
+ */
+
+static void emit_u16(FILE *fp, const char *prefix, const char *name, const uint16_t *data,
+                     size_t n)
+{
+        fprintf(fp, "static const uint16_t %s_%s[%zu] = {", prefix, name, n);
+        for (size_t i = 0; i < n; i++) {
+                fprintf(fp, "%s%u,", i % 16 ? " " : "\n        ", data[i]);
+        }
+        fputs("\n};\n\n", fp);
+}
+
+static void emit_u32(FILE *fp, const char *prefix, const char *name, const uint32_t *data,
+                     size_t n)
+{
+        fprintf(fp, "static const uint32_t %s_%s[%zu] = {", prefix, name, n);
+        for (size_t i = 0; i < n; i++) {
+                fprintf(fp, "%s0x%" PRIx32 ",", i % 8 ? " " : "\n        ", data[i]);
+        }
+        fputs("\n};\n\n", fp);
+}
+
+/**
+ * Emit the tables for @a with every array named after @prefix, and the
+ * automaton itself as @symbol
+ */
+static void emit_automaton(FILE *fp, const LsiAutomatonBuild *a, const char *prefix,
+                           const char *symbol)
+{
+        fprintf(fp, "static const uint8_t %s_classes[256] = {", prefix);
+        for (size_t i = 0; i < 256; i++) {
+                fprintf(fp, "%s%u,", i % 16 ? " " : "\n        ", a->classes[i]);
+        }
+        fputs("\n};\n\n", fp);
+
+        emit_u16(fp, prefix, "next", a->next, (size_t)a->n_states * a->n_classes);
+        emit_u16(fp, prefix, "output", a->output, a->n_states);
+
+        fprintf(fp,
+                "static const uint64_t %s_masks[%zu] = {",
+                prefix,
+                (size_t)a->n_outputs * LSI_PATTERN_WORDS);
+        for (size_t i = 0; i < (size_t)a->n_outputs * LSI_PATTERN_WORDS; i++) {
+                fprintf(fp, "%s0x%" PRIx64 "ull,", i % 4 ? " " : "\n        ", a->masks[i]);
+        }
+        fputs("\n};\n\n", fp);
+
+        emit_u32(fp, prefix, "group_start", a->group_start, LSI_N_PATTERN_GROUPS + 1);
+        emit_u32(fp, prefix, "patterns", a->patterns, a->n_patterns ? a->n_patterns : 1);
+        emit_u32(fp, prefix, "targets", a->targets, a->n_patterns ? a->n_patterns : 1);
+        if (a->n_exact_buckets > 0) {
+                emit_u32(fp, prefix, "exact_buckets", a->exact_buckets, a->n_exact_buckets);
+        }
+
+        /* Patterns are plain sonames, but play it safe with escapes */
+        fprintf(fp, "static const char %s_strings[] =", prefix);
+        for (uint32_t i = 0; i < a->strings_size; i++) {
+                if (i == 0 || a->strings[i - 1] == '\0') {
+                        fputs("\n        \"", fp);
+                }
+                unsigned char c = (unsigned char)a->strings[i];
+                if (c == '\0') {
+                        fputs("\\0\"", fp);
+                } else if (c == '"' || c == '\\' || c < 0x20 || c > 0x7e) {
+                        fprintf(fp, "\\%03o", c);
+                } else {
+                        fputc(c, fp);
+                }
+        }
+        fputs(";\n\n", fp);
+
+        fprintf(fp,
+                "%s = {\n"
+                "        .n_states = %u,\n"
+                "        .n_classes = %u,\n"
+                "        .n_outputs = %u,\n"
+                "        .n_patterns = %u,\n"
+                "        .n_exact_buckets = %u,\n"
+                "        .classes = %s_classes,\n"
+                "        .next = %s_next,\n"
+                "        .output = %s_output,\n"
+                "        .masks = %s_masks,\n"
+                "        .group_start = %s_group_start,\n"
+                "        .patterns = %s_patterns,\n"
+                "        .targets = %s_targets,\n",
+                symbol,
+                a->n_states,
+                a->n_classes,
+                a->n_outputs,
+                a->n_patterns,
+                a->n_exact_buckets,
+                prefix,
+                prefix,
+                prefix,
+                prefix,
+                prefix,
+                prefix,
+                prefix);
+        if (a->n_exact_buckets > 0) {
+                fprintf(fp, "        .exact_buckets = %s_exact_buckets,\n", prefix);
+        } else {
+                fputs("        .exact_buckets = NULL,\n", fp);
+        }
+        fprintf(fp, "        .strings = %s_strings,\n};\n\n", prefix);
+}
+
+static bool emit_rules(const LsiCompiledRules *rules, const char *source, const char *path)
+{
+        FILE *fp = fopen(path, "w");
+        const char *source_name = strrchr(source, '/');
+        char prefix[32];
+        char symbol[64];
+
+        if (!fp) {
+                fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+                return false;
+        }
+
+        fprintf(fp,
+                "/* Generated by lsi-patterngen from %s - do not edit */\n\n"
+                "#include <stddef.h>\n\n"
+                "#include \"matcher.h\"\n\n",
+                source_name ? source_name + 1 : source);
+
+        emit_automaton(fp,
+                       &rules->automata[0],
+                       "global",
+                       "const LsiAutomaton lsi_builtin_patterns");
+        for (size_t i = 1; i < rules->n_automata; i++) {
+                snprintf(prefix, sizeof(prefix), "app_%u", rules->app_ids[i]);
+                snprintf(symbol, sizeof(symbol), "static const LsiAutomaton %s", prefix);
+                emit_automaton(fp, &rules->automata[i], prefix, symbol);
+        }
+
+        fputs("const LsiAppProfile lsi_builtin_profiles[] = {\n", fp);
+        for (size_t i = 1; i < rules->n_automata; i++) {
+                fprintf(fp, "        { %u, &app_%u },\n", rules->app_ids[i], rules->app_ids[i]);
+        }
+        fputs("        { 0, NULL },\n};\n", fp);
+
+        if (fclose(fp) != 0) {
+                fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+                return false;
+        }
+        return true;
+}
+
+int main(int argc, char **argv)
+{
+        LsiRuleSet rules = { 0 };
+        LsiCompiledRules compiled = { 0 };
+        int ret = EXIT_FAILURE;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "D:")) != -1) {
+                switch (opt) {
+                case 'D':
+                        if (!lsi_rule_set_define(&rules, optarg)) {
+                                goto end;
+                        }
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (argc - optind != 2) {
+                goto usage;
+        }
+
+        if (!lsi_rule_set_parse(&rules, argv[optind])) {
+                goto end;
+        }
+        if (!lsi_rule_set_compile(&rules, &compiled)) {
+                goto end;
+        }
+        if (emit_rules(&compiled, argv[optind], argv[optind + 1])) {
+                ret = EXIT_SUCCESS;
+        }
+        goto end;
+
+usage:
+        fprintf(stderr, "usage: %s [-D name[=value]]... input.rules output.c\n", argv[0]);
+
+end:
+        lsi_compiled_rules_clear(&compiled);
+        lsi_rule_set_clear(&rules);
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,83 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rules.h"
+
+/**
+ * Compile a readable intercept rules file into the binary database that
+ * liblsi-intercept maps at startup.
+ *
+ *      lsi-rulec [-D name[=value]]... intercept.rules linux-steam-integration-intercept.db
+ *
+ * The result may be placed in the user config directory or SYSTEMCONFDIR to
+ * override the vendor rules shipped with the package.
+ */
+int main(int argc, char **argv)
+{
+        LsiRuleSet rules = { 0 };
+        LsiCompiledRules compiled = { 0 };
+        int ret = EXIT_FAILURE;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "D:")) != -1) {
+                switch (opt) {
+                case 'D':
+                        if (!lsi_rule_set_define(&rules, optarg)) {
+                                goto end;
+                        }
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (argc - optind != 2) {
+                goto usage;
+        }
+
+        if (!lsi_rule_set_parse(&rules, argv[optind])) {
+                goto end;
+        }
+        if (!lsi_rule_set_compile(&rules, &compiled)) {
+                goto end;
+        }
+        if (lsi_rules_db_write(&compiled, argv[optind + 1])) {
+                ret = EXIT_SUCCESS;
+        }
+        goto end;
+
+usage:
+        fprintf(stderr, "usage: %s [-D name[=value]]... input.rules output.db\n", argv[0]);
+
+end:
+        lsi_compiled_rules_clear(&compiled);
+        lsi_rule_set_clear(&rules);
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
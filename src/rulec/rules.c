@@ -0,0 +1,857 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "rules.h"
+
+/**
+ * Section names, in LsiPatternGroup order
+ */
+static const char *group_names[LSI_N_PATTERN_GROUPS] = {
+        "steam-allowed",  "vendor-blacklist", "vendor-transmute", "steam-path",
+        "library-path",   "vendor-allowed",   "steam-process",    "vendor-upgrade",
+        "compat-process", "compat-path",      "hybrid-host",
+};
+
+/**
+ * Upper bound on the app IDs sharing one section
+ */
+#define LSI_SECTION_MAX_APPS 32
+
+bool lsi_rule_set_define(LsiRuleSet *self, const char *define)
+{
+        char **defines = realloc(self->defines, sizeof(char *) * (self->n_defines + 1));
+        if (!defines) {
+                return false;
+        }
+        self->defines = defines;
+        self->defines[self->n_defines] = strdup(define);
+        if (!self->defines[self->n_defines]) {
+                return false;
+        }
+        ++self->n_defines;
+        return true;
+}
+
+/**
+ * Find the define called @name (of @len bytes), returning the full define
+ */
+static const char *lsi_rule_set_lookup(const LsiRuleSet *self, const char *name, size_t len)
+{
+        for (size_t i = 0; i < self->n_defines; i++) {
+                const char *d = self->defines[i];
+                if (strncmp(d, name, len) == 0 && (d[len] == '\0' || d[len] == '=')) {
+                        return d;
+                }
+        }
+        return NULL;
+}
+
+/**
+ * Expand "@name@" references within @in into a new string
+ */
+static char *lsi_rule_set_expand(const LsiRuleSet *self, const char *in, const char *path,
+                                 int line)
+{
+        char *ret = NULL;
+        size_t len = 0;
+        FILE *mem = open_memstream(&ret, &len);
+
+        if (!mem) {
+                return NULL;
+        }
+
+        for (const char *c = in; *c; c++) {
+                const char *end = NULL;
+                const char *def = NULL;
+
+                if (*c != '@' || !(end = strchr(c + 1, '@'))) {
+                        fputc(*c, mem);
+                        continue;
+                }
+                def = lsi_rule_set_lookup(self, c + 1, (size_t)(end - c - 1));
+                if (!def || !strchr(def, '=')) {
+                        fprintf(stderr,
+                                "%s:%d: no value defined for '%.*s'\n",
+                                path,
+                                line,
+                                (int)(end - c - 1),
+                                c + 1);
+                        fclose(mem);
+                        free(ret);
+                        return NULL;
+                }
+                fputs(strchr(def, '=') + 1, mem);
+                c = end;
+        }
+
+        fclose(mem);
+        return ret;
+}
+
+static bool lsi_rule_set_append(LsiRuleSet *self, LsiPatternGroup group, uint32_t app_id,
+                                char *pattern, char *target)
+{
+        LsiRule *rules = realloc(self->rules[group], sizeof(LsiRule) * (self->n_rules[group] + 1));
+        if (!rules) {
+                return false;
+        }
+        self->rules[group] = rules;
+        rules[self->n_rules[group]].pattern = pattern;
+        rules[self->n_rules[group]].target = target;
+        rules[self->n_rules[group]].app_id = app_id;
+        ++self->n_rules[group];
+        return true;
+}
+
+/**
+ * Parse a "[group]" or "[group:appid,appid]" section header
+ */
+static bool lsi_rule_set_section(const char *token, int *group, uint32_t *apps, size_t *n_apps)
+{
+        size_t len = strlen(token);
+        size_t name_len = 0;
+        const char *ids = NULL;
+
+        *group = -1;
+        *n_apps = 0;
+
+        if (len < 3 || token[len - 1] != ']') {
+                return false;
+        }
+        ids = memchr(token + 1, ':', len - 2);
+        name_len = ids ? (size_t)(ids - token - 1) : len - 2;
+
+        for (size_t i = 0; i < ARRAY_SIZE(group_names); i++) {
+                if (strlen(group_names[i]) == name_len &&
+                    strncmp(group_names[i], token + 1, name_len) == 0) {
+                        *group = (int)i;
+                }
+        }
+        if (*group < 0) {
+                return false;
+        }
+
+        /* Global section */
+        if (!ids) {
+                apps[(*n_apps)++] = 0;
+                return true;
+        }
+
+        for (const char *c = ids + 1; c < token + len - 1;) {
+                char *end = NULL;
+                unsigned long id;
+
+                if (*n_apps == LSI_SECTION_MAX_APPS || *c < '0' || *c > '9') {
+                        return false;
+                }
+                errno = 0;
+                id = strtoul(c, &end, 10);
+                if (errno != 0 || id == 0 || id > UINT32_MAX || (*end != ',' && *end != ']')) {
+                        return false;
+                }
+                apps[(*n_apps)++] = (uint32_t)id;
+                c = *end == ',' ? end + 1 : end;
+        }
+        return *n_apps > 0;
+}
+
+bool lsi_rule_set_parse(LsiRuleSet *self, const char *path)
+{
+        FILE *fp = NULL;
+        char *buf = NULL;
+        size_t buf_size = 0;
+        uint32_t apps[LSI_SECTION_MAX_APPS] = { 0 };
+        size_t n_apps = 0;
+        int line = 0;
+        int group = -1;
+        bool ret = false;
+
+        fp = fopen(path, "r");
+        if (!fp) {
+                fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+                return false;
+        }
+
+        while (getline(&buf, &buf_size, fp) > 0) {
+                char *tokens[5] = { 0 };
+                char *save = NULL;
+                char *tok = NULL;
+                char *pattern = NULL;
+                char *target = NULL;
+                int n_tokens = 0;
+                bool want = true;
+
+                ++line;
+
+                /* Comments run to the end of the line */
+                if ((tok = strchr(buf, '#'))) {
+                        *tok = '\0';
+                }
+
+                for (tok = strtok_r(buf, " \t\r\n", &save); tok;
+                     tok = strtok_r(NULL, " \t\r\n", &save)) {
+                        if (n_tokens == (int)ARRAY_SIZE(tokens)) {
+                                fprintf(stderr, "%s:%d: too many tokens\n", path, line);
+                                goto end;
+                        }
+                        tokens[n_tokens++] = tok;
+                }
+
+                if (n_tokens == 0) {
+                        continue;
+                }
+
+                /* New section */
+                if (tokens[0][0] == '[') {
+                        if (n_tokens != 1 ||
+                            !lsi_rule_set_section(tokens[0], &group, apps, &n_apps)) {
+                                fprintf(stderr,
+                                        "%s:%d: invalid section %s\n",
+                                        path,
+                                        line,
+                                        tokens[0]);
+                                goto end;
+                        }
+                        if (lsi_pattern_group_is_exact((LsiPatternGroup)group) && apps[0] != 0) {
+                                fprintf(stderr,
+                                        "%s:%d: [%s] can't be specific to an app\n",
+                                        path,
+                                        line,
+                                        group_names[group]);
+                                goto end;
+                        }
+                        continue;
+                }
+
+                if (group < 0) {
+                        fprintf(stderr, "%s:%d: pattern outside of a section\n", path, line);
+                        goto end;
+                }
+
+                /* pattern [= target] [if [!]define] */
+                int t = 1;
+                if (t < n_tokens && strcmp(tokens[t], "=") == 0) {
+                        if (t + 1 >= n_tokens) {
+                                fprintf(stderr, "%s:%d: missing transmute target\n", path, line);
+                                goto end;
+                        }
+                        target = tokens[t + 1];
+                        t += 2;
+                }
+                if (t < n_tokens && strcmp(tokens[t], "if") == 0 && t + 1 < n_tokens) {
+                        const char *cond = tokens[t + 1];
+                        bool negate = cond[0] == '!';
+                        if (negate) {
+                                ++cond;
+                        }
+                        want = (lsi_rule_set_lookup(self, cond, strlen(cond)) != NULL) != negate;
+                        t += 2;
+                }
+                if (t != n_tokens) {
+                        fprintf(stderr, "%s:%d: unexpected '%s'\n", path, line, tokens[t]);
+                        goto end;
+                }
+                if ((group == LSI_PATTERN_VENDOR_TRANSMUTE) != (target != NULL)) {
+                        fprintf(stderr,
+                                "%s:%d: transmute targets are only valid in [%s]\n",
+                                path,
+                                line,
+                                group_names[LSI_PATTERN_VENDOR_TRANSMUTE]);
+                        goto end;
+                }
+                if (!want) {
+                        continue;
+                }
+
+                /* One copy of the rule per app sharing the section */
+                for (size_t i = 0; i < n_apps; i++) {
+                        char *rule_target = NULL;
+
+                        pattern = lsi_rule_set_expand(self, tokens[0], path, line);
+                        if (!pattern) {
+                                goto end;
+                        }
+                        if (target) {
+                                rule_target = lsi_rule_set_expand(self, target, path, line);
+                                if (!rule_target) {
+                                        free(pattern);
+                                        goto end;
+                                }
+                        }
+                        if (!lsi_rule_set_append(self,
+                                                 (LsiPatternGroup)group,
+                                                 apps[i],
+                                                 pattern,
+                                                 rule_target)) {
+                                free(pattern);
+                                free(rule_target);
+                                goto end;
+                        }
+                }
+        }
+
+        ret = true;
+
+end:
+        free(buf);
+        fclose(fp);
+        return ret;
+}
+
+static int lsi_app_id_compare(const void *a, const void *b)
+{
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+uint32_t *lsi_rule_set_profiles(const LsiRuleSet *self, size_t *n_profiles)
+{
+        uint32_t *ids = NULL;
+        size_t n = 0;
+
+        *n_profiles = 0;
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                n += self->n_rules[g];
+        }
+        ids = calloc(n + 1, sizeof(uint32_t));
+        if (!ids) {
+                return NULL;
+        }
+
+        n = 0;
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                for (uint32_t i = 0; i < self->n_rules[g]; i++) {
+                        if (self->rules[g][i].app_id != 0) {
+                                ids[n++] = self->rules[g][i].app_id;
+                        }
+                }
+        }
+        qsort(ids, n, sizeof(uint32_t), lsi_app_id_compare);
+
+        for (size_t i = 0; i < n; i++) {
+                if (*n_profiles == 0 || ids[*n_profiles - 1] != ids[i]) {
+                        ids[(*n_profiles)++] = ids[i];
+                }
+        }
+        return ids;
+}
+
+void lsi_rule_set_clear(LsiRuleSet *self)
+{
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                for (uint32_t i = 0; i < self->n_rules[g]; i++) {
+                        free(self->rules[g][i].pattern);
+                        free(self->rules[g][i].target);
+                }
+                free(self->rules[g]);
+                self->rules[g] = NULL;
+                self->n_rules[g] = 0;
+        }
+        for (size_t i = 0; i < self->n_defines; i++) {
+                free(self->defines[i]);
+        }
+        free(self->defines);
+        self->defines = NULL;
+        self->n_defines = 0;
+}
+
+/**
+ * Append @s to the string blob, returning its offset
+ */
+static uint32_t lsi_automaton_build_string(LsiAutomatonBuild *self, const char *s)
+{
+        size_t len = strlen(s) + 1;
+        char *strings = realloc(self->strings, self->strings_size + len);
+        uint32_t offset = self->strings_size;
+
+        if (!strings) {
+                return LSI_PATTERN_NO_TARGET;
+        }
+        memcpy(strings + offset, s, len);
+        self->strings = strings;
+        self->strings_size += (uint32_t)len;
+        return offset;
+}
+
+bool lsi_automaton_build(const LsiRuleSet *rules, uint32_t app_id, LsiAutomatonBuild *out)
+{
+        const size_t words = LSI_PATTERN_WORDS;
+        const LsiRule **ordered = NULL;
+        size_t n_rules = 0;
+        int32_t *trie = NULL;
+        uint64_t *state_masks = NULL;
+        uint32_t *fail = NULL;
+        uint32_t *queue = NULL;
+        size_t max_states = 1;
+        uint32_t n_states = 1;
+        uint32_t n_exact = 0;
+        uint32_t index = 0;
+        bool ret = false;
+
+        memset(out, 0, sizeof(*out));
+
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                n_rules += rules->n_rules[g];
+        }
+        ordered = calloc(n_rules ? n_rules : 1, sizeof(LsiRule *));
+        if (!ordered) {
+                return false;
+        }
+
+        /* Select the profile's own rules ahead of the global ones, as
+         * earlier patterns win, then number them contiguously per group */
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                out->group_start[g] = out->n_patterns;
+                for (int pass = app_id ? 0 : 1; pass < 2; pass++) {
+                        uint32_t want = pass == 0 ? app_id : 0;
+                        for (uint32_t i = 0; i < rules->n_rules[g]; i++) {
+                                if (rules->rules[g][i].app_id == want) {
+                                        ordered[out->n_patterns++] = &rules->rules[g][i];
+                                }
+                        }
+                }
+        }
+        out->group_start[LSI_N_PATTERN_GROUPS] = out->n_patterns;
+
+        /* Map bytes to classes */
+        out->n_classes = 1;
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                for (uint32_t i = out->group_start[g]; i < out->group_start[g + 1]; i++) {
+                        const char *p = ordered[i]->pattern;
+                        if (!*p) {
+                                fputs("Empty patterns are not permitted\n", stderr);
+                                goto end;
+                        }
+                        if (lsi_pattern_group_is_exact((LsiPatternGroup)g)) {
+                                ++n_exact;
+                                continue;
+                        }
+                        for (const unsigned char *c = (const unsigned char *)p; *c; c++) {
+                                if (out->classes[*c] == 0) {
+                                        out->classes[*c] = (uint8_t)out->n_classes++;
+                                }
+                        }
+                        max_states += strlen(p);
+                }
+        }
+
+        if (out->n_patterns > LSI_PATTERN_MAX) {
+                fprintf(stderr, "Too many patterns (%u), maximum is %d\n", out->n_patterns,
+                        LSI_PATTERN_MAX);
+                goto end;
+        }
+        if (max_states > UINT16_MAX) {
+                fputs("Pattern set is too large for 16-bit state indices\n", stderr);
+                goto end;
+        }
+
+        trie = malloc(sizeof(int32_t) * max_states * out->n_classes);
+        state_masks = calloc(max_states * words, sizeof(uint64_t));
+        fail = calloc(max_states, sizeof(uint32_t));
+        queue = calloc(max_states, sizeof(uint32_t));
+        out->patterns = calloc(out->n_patterns ? out->n_patterns : 1, sizeof(uint32_t));
+        out->targets = calloc(out->n_patterns ? out->n_patterns : 1, sizeof(uint32_t));
+        if (!trie || !state_masks || !fail || !queue || !out->patterns || !out->targets) {
+                goto end;
+        }
+        memset(trie, 0xff, sizeof(int32_t) * max_states * out->n_classes);
+
+        /* Goto function */
+        for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                for (; index < out->group_start[g + 1]; index++) {
+                        const LsiRule *rule = ordered[index];
+                        uint32_t state = 0;
+
+                        /* Exact groups only need their strings */
+                        for (const unsigned char *c = (const unsigned char *)rule->pattern;
+                             *c && !lsi_pattern_group_is_exact((LsiPatternGroup)g);
+                             c++) {
+                                int32_t *slot = &trie[state * out->n_classes + out->classes[*c]];
+                                if (*slot < 0) {
+                                        *slot = (int32_t)n_states++;
+                                }
+                                state = (uint32_t)*slot;
+                        }
+                        if (state != 0) {
+                                state_masks[state * words + index / 64] |= 1ull << (index % 64);
+                        }
+
+                        out->patterns[index] = lsi_automaton_build_string(out, rule->pattern);
+                        out->targets[index] = rule->target
+                                                  ? lsi_automaton_build_string(out, rule->target)
+                                                  : LSI_PATTERN_NO_TARGET;
+                        if (out->patterns[index] == LSI_PATTERN_NO_TARGET ||
+                            (rule->target && out->targets[index] == LSI_PATTERN_NO_TARGET)) {
+                                goto end;
+                        }
+                }
+        }
+
+        /* Breadth first construction of failure links, filling in the
+         * missing transitions so we end up with a full DFA */
+        out->n_states = n_states;
+        out->next = calloc((size_t)n_states * out->n_classes, sizeof(uint16_t));
+        if (!out->next) {
+                goto end;
+        }
+
+        size_t head = 0, tail = 0;
+        for (uint32_t c = 0; c < out->n_classes; c++) {
+                int32_t s = trie[c];
+                if (s > 0) {
+                        fail[s] = 0;
+                        queue[tail++] = (uint32_t)s;
+                        out->next[c] = (uint16_t)s;
+                } else {
+                        out->next[c] = 0;
+                }
+        }
+        while (head < tail) {
+                uint32_t r = queue[head++];
+
+                /* Inherit everything the suffix state matches */
+                for (size_t w = 0; w < words; w++) {
+                        state_masks[r * words + w] |= state_masks[fail[r] * words + w];
+                }
+
+                for (uint32_t c = 0; c < out->n_classes; c++) {
+                        int32_t s = trie[r * out->n_classes + c];
+                        if (s < 0) {
+                                out->next[r * out->n_classes + c] =
+                                    out->next[fail[r] * out->n_classes + c];
+                                continue;
+                        }
+                        fail[s] = out->next[fail[r] * out->n_classes + c];
+                        queue[tail++] = (uint32_t)s;
+                        out->next[r * out->n_classes + c] = (uint16_t)s;
+                }
+        }
+
+        /* Deduplicate output sets, index 0 is reserved for "no match" */
+        out->output = calloc(n_states, sizeof(uint16_t));
+        out->masks = calloc(words, sizeof(uint64_t));
+        if (!out->output || !out->masks) {
+                goto end;
+        }
+        out->n_outputs = 1;
+        for (uint32_t s = 0; s < n_states; s++) {
+                const uint64_t *mask = &state_masks[s * words];
+                uint32_t o;
+                bool empty = true;
+
+                for (size_t w = 0; w < words && empty; w++) {
+                        empty = mask[w] == 0;
+                }
+                if (empty) {
+                        continue;
+                }
+                for (o = 1; o < out->n_outputs; o++) {
+                        if (memcmp(&out->masks[o * words], mask, words * sizeof(uint64_t)) == 0) {
+                                break;
+                        }
+                }
+                if (o == out->n_outputs) {
+                        uint64_t *masks =
+                            realloc(out->masks, (out->n_outputs + 1) * words * sizeof(uint64_t));
+                        if (!masks) {
+                                goto end;
+                        }
+                        out->masks = masks;
+                        memcpy(&out->masks[o * words], mask, words * sizeof(uint64_t));
+                        ++out->n_outputs;
+                }
+                out->output[s] = (uint16_t)o;
+        }
+
+        /* Hash index for the exact match groups, kept at most half full */
+        if (n_exact > 0) {
+                uint32_t mask;
+
+                out->n_exact_buckets = 8;
+                while (out->n_exact_buckets < n_exact * 2) {
+                        out->n_exact_buckets <<= 1;
+                }
+                out->exact_buckets = calloc(out->n_exact_buckets, sizeof(uint32_t));
+                if (!out->exact_buckets) {
+                        goto end;
+                }
+                mask = out->n_exact_buckets - 1;
+                for (int g = 0; g < LSI_N_PATTERN_GROUPS; g++) {
+                        if (!lsi_pattern_group_is_exact((LsiPatternGroup)g)) {
+                                continue;
+                        }
+                        for (uint32_t i = out->group_start[g]; i < out->group_start[g + 1]; i++) {
+                                uint32_t h = lsi_pattern_hash(ordered[i]->pattern);
+                                while (out->exact_buckets[h & mask] != 0) {
+                                        ++h;
+                                }
+                                out->exact_buckets[h & mask] = i + 1;
+                        }
+                }
+        }
+
+        /* Never hand out an empty blob */
+        if (!out->strings && lsi_automaton_build_string(out, "") == LSI_PATTERN_NO_TARGET) {
+                goto end;
+        }
+
+        ret = true;
+
+end:
+        free(ordered);
+        free(trie);
+        free(state_masks);
+        free(fail);
+        free(queue);
+        if (!ret) {
+                lsi_automaton_build_clear(out);
+        }
+        return ret;
+}
+
+void lsi_automaton_build_clear(LsiAutomatonBuild *self)
+{
+        free(self->next);
+        free(self->output);
+        free(self->masks);
+        free(self->patterns);
+        free(self->targets);
+        free(self->exact_buckets);
+        free(self->strings);
+        memset(self, 0, sizeof(*self));
+}
+
+void lsi_automaton_build_view(const LsiAutomatonBuild *self, LsiAutomaton *view)
+{
+        *view = (LsiAutomaton){
+                .n_states = self->n_states,
+                .n_classes = self->n_classes,
+                .n_outputs = self->n_outputs,
+                .n_patterns = self->n_patterns,
+                .n_exact_buckets = self->n_exact_buckets,
+                .classes = self->classes,
+                .next = self->next,
+                .output = self->output,
+                .masks = self->masks,
+                .group_start = self->group_start,
+                .patterns = self->patterns,
+                .targets = self->targets,
+                .exact_buckets = self->exact_buckets,
+                .strings = self->strings,
+        };
+}
+
+bool lsi_rule_set_compile(const LsiRuleSet *rules, LsiCompiledRules *out)
+{
+        uint32_t *profiles = NULL;
+        size_t n_profiles = 0;
+
+        memset(out, 0, sizeof(*out));
+
+        profiles = lsi_rule_set_profiles(rules, &n_profiles);
+        if (!profiles) {
+                return false;
+        }
+        out->app_ids = calloc(n_profiles + 1, sizeof(uint32_t));
+        out->automata = calloc(n_profiles + 1, sizeof(LsiAutomatonBuild));
+        if (!out->app_ids || !out->automata) {
+                goto bail;
+        }
+
+        /* Global rules first, then each profile in app ID order */
+        for (size_t i = 0; i < n_profiles + 1; i++) {
+                uint32_t app_id = i == 0 ? 0 : profiles[i - 1];
+                if (!lsi_automaton_build(rules, app_id, &out->automata[i])) {
+                        if (app_id != 0) {
+                                fprintf(stderr, "Unable to build the profile for app %u\n", app_id);
+                        }
+                        goto bail;
+                }
+                out->app_ids[i] = app_id;
+                ++out->n_automata;
+        }
+
+        free(profiles);
+        return true;
+
+bail:
+        free(profiles);
+        lsi_compiled_rules_clear(out);
+        return false;
+}
+
+void lsi_compiled_rules_clear(LsiCompiledRules *self)
+{
+        for (size_t i = 0; i < self->n_automata; i++) {
+                lsi_automaton_build_clear(&self->automata[i]);
+        }
+        free(self->automata);
+        free(self->app_ids);
+        memset(self, 0, sizeof(*self));
+}
+
+/**
+ * Write a single automaton block, padded to keep the next block aligned
+ */
+static bool lsi_automaton_build_write_block(const LsiAutomatonBuild *self, FILE *fp)
+{
+        static const char zeroes[8] = { 0 };
+        LsiRulesDbAutomaton header = { 0 };
+        LsiRulesDbLayout layout = { 0 };
+        const struct {
+                const void *data;
+                size_t size;
+        } sections[] = {
+                { &header, sizeof(header) },
+                { self->masks, (size_t)self->n_outputs * LSI_PATTERN_WORDS * sizeof(uint64_t) },
+                { self->patterns, self->n_patterns * sizeof(uint32_t) },
+                { self->targets, self->n_patterns * sizeof(uint32_t) },
+                { self->exact_buckets, self->n_exact_buckets * sizeof(uint32_t) },
+                { self->next, (size_t)self->n_states * self->n_classes * sizeof(uint16_t) },
+                { self->output, self->n_states * sizeof(uint16_t) },
+                { self->classes, sizeof(self->classes) },
+                { self->strings, self->strings_size },
+        };
+
+        header.n_states = self->n_states;
+        header.n_classes = self->n_classes;
+        header.n_outputs = self->n_outputs;
+        header.n_patterns = self->n_patterns;
+        header.n_exact_buckets = self->n_exact_buckets;
+        header.strings_size = self->strings_size;
+        memcpy(header.group_start, self->group_start, sizeof(header.group_start));
+
+        if (!lsi_rules_db_layout(&header, &layout)) {
+                fputs("Automaton exceeds the rules database limits\n", stderr);
+                return false;
+        }
+
+        /* Sections are written back to back, matching lsi_rules_db_layout() */
+        for (size_t i = 0; i < ARRAY_SIZE(sections); i++) {
+                if (sections[i].size && fwrite(sections[i].data, sections[i].size, 1, fp) != 1) {
+                        return false;
+                }
+        }
+        if (layout.size % 8 && fwrite(zeroes, 8 - layout.size % 8, 1, fp) != 1) {
+                return false;
+        }
+        return true;
+}
+
+bool lsi_rules_db_write(const LsiCompiledRules *rules, const char *path)
+{
+        const uint32_t *app_ids = rules->app_ids;
+        const LsiAutomatonBuild *automata = rules->automata;
+        size_t n_automata = rules->n_automata;
+        LsiRulesDbHeader header = { 0 };
+        LsiRulesDbProfile *profiles = NULL;
+        char *tmp_path = NULL;
+        FILE *fp = NULL;
+        int fd = -1;
+        bool ret = false;
+
+        profiles = calloc(n_automata, sizeof(LsiRulesDbProfile));
+        if (!profiles) {
+                return false;
+        }
+
+        memcpy(header.magic, LSI_RULES_DB_MAGIC, sizeof(header.magic));
+        header.version = LSI_RULES_DB_VERSION;
+        header.n_profiles = (uint32_t)n_automata;
+
+        if (asprintf(&tmp_path, "%s.XXXXXX", path) < 0) {
+                tmp_path = NULL;
+                goto fail;
+        }
+        fd = mkostemp(tmp_path, O_CLOEXEC);
+        if (fd < 0) {
+                goto fail;
+        }
+        fp = fdopen(fd, "wb");
+        if (!fp) {
+                close(fd);
+                unlink(tmp_path);
+                goto fail;
+        }
+
+        /* Blocks follow the profile table, which is rewritten once the
+         * offsets are known */
+        if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+            fwrite(profiles, sizeof(LsiRulesDbProfile), n_automata, fp) != n_automata) {
+                goto end;
+        }
+        for (size_t i = 0; i < n_automata; i++) {
+                long offset = ftell(fp);
+                if (offset < 0) {
+                        goto end;
+                }
+                profiles[i].app_id = app_ids[i];
+                profiles[i].offset = (uint64_t)offset;
+                if (!lsi_automaton_build_write_block(&automata[i], fp)) {
+                        goto end;
+                }
+        }
+        if (fseek(fp, (long)sizeof(header), SEEK_SET) != 0 ||
+            fwrite(profiles, sizeof(LsiRulesDbProfile), n_automata, fp) != n_automata) {
+                goto end;
+        }
+
+        /* Readers must never see a partial file under the final name */
+        if (fflush(fp) != 0 || fchmod(fd, 00644) != 0 || fsync(fd) != 0) {
+                goto end;
+        }
+        ret = true;
+
+end:
+        if (fclose(fp) != 0) {
+                ret = false;
+        }
+        if (ret && rename(tmp_path, path) != 0) {
+                ret = false;
+        }
+        if (!ret) {
+                unlink(tmp_path);
+        }
+fail:
+        if (!ret) {
+                fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+        }
+        free(tmp_path);
+        free(profiles);
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
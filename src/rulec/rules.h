@@ -0,0 +1,136 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../intercept/matcher.h"
+#include "../intercept/rules-db.h"
+
+/**
+ * A single parsed pattern
+ */
+typedef struct LsiRule {
+        char *pattern;
+        char *target;    /**<NULL if this isn't a transmute */
+        uint32_t app_id; /**<0 for the global rules */
+} LsiRule;
+
+/**
+ * All rules parsed from a source file, grouped by section.
+ */
+typedef struct LsiRuleSet {
+        LsiRule *rules[LSI_N_PATTERN_GROUPS];
+        uint32_t n_rules[LSI_N_PATTERN_GROUPS];
+        char **defines; /**<name or name=value, as passed with -D */
+        size_t n_defines;
+} LsiRuleSet;
+
+/**
+ * Heap allocated automaton with the same shape as LsiAutomaton
+ */
+typedef struct LsiAutomatonBuild {
+        uint32_t n_states;
+        uint32_t n_classes;
+        uint32_t n_outputs;
+        uint32_t n_patterns;
+        uint32_t n_exact_buckets;
+        uint8_t classes[256];
+        uint16_t *next;
+        uint16_t *output;
+        uint64_t *masks;
+        uint32_t group_start[LSI_N_PATTERN_GROUPS + 1];
+        uint32_t *patterns;
+        uint32_t *targets;
+        uint32_t *exact_buckets;
+        char *strings;
+        uint32_t strings_size;
+} LsiAutomatonBuild;
+
+/**
+ * The global automaton followed by one per app profile, sorted by app ID
+ */
+typedef struct LsiCompiledRules {
+        uint32_t *app_ids; /**<0 for the global automaton */
+        LsiAutomatonBuild *automata;
+        size_t n_automata;
+} LsiCompiledRules;
+
+/**
+ * Add a define that the "if" conditions and "@name@" substitutions can see
+ */
+bool lsi_rule_set_define(LsiRuleSet *self, const char *define);
+
+/**
+ * Parse the rules source at @path into @self, reporting errors on stderr
+ */
+bool lsi_rule_set_parse(LsiRuleSet *self, const char *path);
+
+/**
+ * Return the sorted, unique app IDs that have their own rules
+ */
+uint32_t *lsi_rule_set_profiles(const LsiRuleSet *self, size_t *n_profiles);
+
+/**
+ * Release all storage held by @self
+ */
+void lsi_rule_set_clear(LsiRuleSet *self);
+
+/**
+ * Compile the global rules, plus those specific to @app_id if it isn't 0,
+ * into a full DFA
+ */
+bool lsi_automaton_build(const LsiRuleSet *rules, uint32_t app_id, LsiAutomatonBuild *out);
+
+/**
+ * Release all storage held by @self
+ */
+void lsi_automaton_build_clear(LsiAutomatonBuild *self);
+
+/**
+ * Return a read-only view of the built automaton
+ */
+void lsi_automaton_build_view(const LsiAutomatonBuild *self, LsiAutomaton *view);
+
+/**
+ * Compile the global rules and every app profile
+ */
+bool lsi_rule_set_compile(const LsiRuleSet *rules, LsiCompiledRules *out);
+
+/**
+ * Release all storage held by @self
+ */
+void lsi_compiled_rules_clear(LsiCompiledRules *self);
+
+/**
+ * Write a rules database for the intercept module to map at runtime. Running
+ * processes may have @path mapped, so it's replaced via rename() rather than
+ * rewritten in place.
+ */
+bool lsi_rules_db_write(const LsiCompiledRules *rules, const char *path);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -21,10 +21,22 @@
 
 #include "../common/files.h"
 #include "../common/log.h"
+#include "../common/stats.h"
 #include "../nica/files.h"
 #include "config.h"
 #include "lsi.h"
 #include "shim.h"
+#include "nica/util.h"
+
+#ifdef HAVE_LIBINTERCEPT
+#include "../intercept/abi-check.h"
+#include "../intercept/search.h"
+#endif
+
+#if defined(HAVE_LIBINTERCEPT) && defined(HAVE_LIBREDIRECT)
+#include "../intercept/overlay.h"
+#include "../intercept/rules-db.h"
+#endif
 
 /**
  * Required to force Steam into 32-bit detection mode, which is useful for
@@ -273,6 +285,50 @@ static void shim_export_extra(__lsi_unused__ const char *prefix)
 
 static LsiConfig lsi_config = { 0 };
 
+#ifdef HAVE_LIBINTERCEPT
+/**
+ * When asked to, let libredirect take over from the libintercept audit
+ * module, with an overlay of host libraries on LD_LIBRARY_PATH to handle
+ * DT_NEEDED entries.
+ *
+ * @returns true if LD_AUDIT is no longer required
+ */
+static bool shim_set_overlay_path(void)
+{
+#ifdef HAVE_LIBREDIRECT
+        autofree(char) *root = NULL;
+        LsiRules rules = { 0 };
+
+        if (!lsi_config.use_intercept_preload || !lsi_config.use_libredirect) {
+                return false;
+        }
+        root = lsi_overlay_root();
+        if (!root) {
+                return false;
+        }
+
+        /* We can only build our own class, Steam keeps the other one current */
+        lsi_rules_db_load(0, &rules);
+        if (!lsi_overlay_prepare(root, &rules)) {
+                lsi_log_error("failed to prepare the library overlay in %s", root);
+                return false;
+        }
+
+        /* ld.so skips over the class it can't use */
+        for (unsigned int elf_class = 32; elf_class <= 64; elf_class += 32) {
+                autofree(char) *dir = lsi_overlay_class_dir(root, elf_class);
+                if (dir) {
+                        shim_export_merge_vars("LD_LIBRARY_PATH", NULL, dir);
+                }
+        }
+        setenv(LSI_OVERLAY_ENV, root, 1);
+        return true;
+#else
+        return false;
+#endif
+}
+#endif
+
 /* Public API */
 
 bool shim_bootstrap()
@@ -298,11 +354,19 @@ bool shim_bootstrap()
         if (lsi_config.use_native_runtime) {
                 /* Explicitly disable the runtime */
                 setenv("STEAM_RUNTIME", "0", 1);
+                /* Somewhere for the modules to count what they do */
+                if (!lsi_stats_create()) {
+                        lsi_log_debug("session statistics unavailable");
+                }
 #ifdef HAVE_LIBINTERCEPT
                 /* Only use libintercept in combination with native runtime! */
-                if (lsi_config.use_libintercept) {
+                if (lsi_config.use_libintercept && !shim_set_overlay_path()) {
                         shim_set_audit_path(operation_prefix);
                 }
+                /* Opt-in replacement of outdated vendored libraries */
+                if (lsi_config.use_libintercept && lsi_config.use_intercept_upgrades) {
+                        setenv(LSI_ABI_UPGRADE_ENV, "1", 1);
+                }
 #endif
 #ifdef HAVE_LIBREDIRECT
                 /* Only use libredirect in combination with native runtime! */
@@ -320,6 +384,13 @@ bool shim_bootstrap()
                         shim_export_merge_vars("LD_PRELOAD", operation_prefix, lsi_preload_list());
                 }
                 setenv("STEAM_RUNTIME", "1", 1);
+#ifdef HAVE_LIBINTERCEPT
+                /* Keep the runtime, but let libintercept swap in the host graphics stack */
+                if (lsi_config.use_hybrid_runtime) {
+                        setenv(LSI_HYBRID_ENV, "1", 1);
+                        shim_set_audit_path(operation_prefix);
+                }
+#endif
         }
 
         /* Vanilla dbus users suffer a segfault on Steam exit, due to incorrect
@@ -374,6 +445,9 @@ static int shim_execute_internal(const char *command, int argc, char **argv, boo
         }
         n_argv[i + 1 + off] = NULL;
 
+        /* Nothing queued survives the exec */
+        lsi_log_flush();
+
         /* Go execute steam. */
         if (vfunc(exec_command, (char **)n_argv) < 0) {
                 lsi_report_failure("Failed to launch command: %s\n\n%s", command, strerror(errno));
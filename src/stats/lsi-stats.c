@@ -0,0 +1,218 @@
+/*
+ * This file is part of linux-steam-integration.
+ *
+ * Copyright © 2016-2017 Ikey Doherty <ikey@solus-project.com>
+ *
+ * linux-steam-integration is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/stats.h"
+
+/**
+ * Show the counters shared by every LSI module in a session (see LSI_STATS)
+ *
+ *      lsi-stats [-l] [-w seconds] [session]
+ *
+ * Sessions are named by the pid of the shim that started them. Without one,
+ * the most recently started session that is still running is shown.
+ */
+
+/**
+ * Find the segment for @session, or the newest live one if it's 0
+ *
+ * @returns true if one was found, with its path stored in @path
+ */
+static bool stats_find(long session, bool list, char *path, size_t size)
+{
+        const size_t prefix_len = strlen(LSI_STATS_PREFIX);
+        struct dirent *ent = NULL;
+        int64_t newest = -1;
+        DIR *dir = NULL;
+
+        dir = opendir(LSI_STATS_DIR);
+        if (!dir) {
+                return false;
+        }
+        while ((ent = readdir(dir)) != NULL) {
+                const LsiStatsSegment *segment = NULL;
+                char candidate[PATH_MAX];
+                bool alive;
+
+                if (strncmp(ent->d_name, LSI_STATS_PREFIX, prefix_len) != 0) {
+                        continue;
+                }
+                if (snprintf(candidate, sizeof(candidate), "%s/%s", LSI_STATS_DIR, ent->d_name) <
+                    0) {
+                        continue;
+                }
+                segment = lsi_stats_open(candidate);
+                if (!segment) {
+                        continue;
+                }
+                alive = lsi_stats_session_alive(segment);
+
+                if (list) {
+                        printf("%d\t%s\n", segment->session, alive ? "running" : "ended");
+                }
+                if (session ? segment->session == session
+                            : alive && segment->created > newest) {
+                        newest = segment->created;
+                        snprintf(path, size, "%s", candidate);
+                }
+                lsi_stats_close(segment);
+        }
+        closedir(dir);
+        return newest >= 0;
+}
+
+/**
+ * Print every counter, along with its rate since @previous when watching
+ */
+static void stats_print(const LsiStatsSegment *segment, uint64_t *values,
+                        const uint64_t *previous, unsigned int interval)
+{
+        int64_t elapsed = (int64_t)time(NULL) - segment->created;
+
+        for (int i = 0; i < LSI_STAT_MAX; i++) {
+                values[i] = atomic_load_explicit(&segment->counters[i].value, memory_order_relaxed);
+        }
+
+        printf("session %d, %s for %02lld:%02lld:%02lld\n",
+               segment->session,
+               lsi_stats_session_alive(segment) ? "running" : "ended",
+               (long long)(elapsed / 3600),
+               (long long)(elapsed / 60 % 60),
+               (long long)(elapsed % 60));
+
+        for (int i = 0; i < LSI_STAT_MAX; i++) {
+                double rate = previous ? (double)(values[i] - previous[i]) / interval : 0.0;
+
+                if (i == LSI_STAT_HOOK_NS) {
+                        printf("  %-20s %12.3f ms", lsi_stats_describe(i), values[i] / 1e6);
+                        if (previous) {
+                                printf("  %10.3f ms/s", rate / 1e6);
+                        }
+                } else {
+                        printf("  %-20s %12llu",
+                               lsi_stats_describe(i),
+                               (unsigned long long)values[i]);
+                        if (previous) {
+                                printf("  %10.1f /s", rate);
+                        }
+                }
+                if (i == LSI_STAT_CACHE_HITS && values[LSI_STAT_LOOKUPS]) {
+                        printf("  %5.1f%%", 100.0 * values[i] / values[LSI_STAT_LOOKUPS]);
+                }
+                putchar('\n');
+        }
+}
+
+int main(int argc, char **argv)
+{
+        const LsiStatsSegment *segment = NULL;
+        uint64_t values[LSI_STAT_MAX] = { 0 };
+        uint64_t previous[LSI_STAT_MAX] = { 0 };
+        char path[PATH_MAX] = { 0 };
+        unsigned int interval = 0;
+        bool list = false;
+        long session = 0;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "lw:")) != -1) {
+                switch (opt) {
+                case 'l':
+                        list = true;
+                        break;
+                case 'w':
+                        interval = (unsigned int)atoi(optarg);
+                        if (interval < 1) {
+                                goto usage;
+                        }
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+        if (optind < argc - 1) {
+                goto usage;
+        }
+        if (optind == argc - 1) {
+                session = atol(argv[optind]);
+                if (session < 1) {
+                        goto usage;
+                }
+        }
+
+        if (!stats_find(session, list, path, sizeof(path))) {
+                if (list) {
+                        return EXIT_SUCCESS;
+                }
+                if (session) {
+                        fprintf(stderr, "No statistics for session %ld\n", session);
+                } else {
+                        fprintf(stderr, "No running session found, is LSI enabled?\n");
+                }
+                return EXIT_FAILURE;
+        }
+        if (list) {
+                return EXIT_SUCCESS;
+        }
+
+        segment = lsi_stats_open(path);
+        if (!segment) {
+                fprintf(stderr, "Unable to read %s\n", path);
+                return EXIT_FAILURE;
+        }
+
+        stats_print(segment, values, NULL, 0);
+
+        /* Keep refreshing until the session goes away */
+        while (interval && lsi_stats_session_alive(segment)) {
+                memcpy(previous, values, sizeof(values));
+                sleep(interval);
+                if (isatty(STDOUT_FILENO)) {
+                        fputs("\033[H\033[2J", stdout);
+                } else {
+                        putchar('\n');
+                }
+                stats_print(segment, values, previous, interval);
+                fflush(stdout);
+        }
+
+        lsi_stats_close(segment);
+        return EXIT_SUCCESS;
+
+usage:
+        fprintf(stderr, "usage: %s [-l] [-w seconds] [session]\n", argv[0]);
+        fprintf(stderr, "  -l  list known sessions\n");
+        fprintf(stderr, "  -w  refresh every given number of seconds, showing rates\n");
+        return EXIT_FAILURE;
+}
+
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */